@@ -7,6 +7,7 @@
 #include "H2MOD/Modules/CustomVariantSettings/CustomVariantSettings.h"
 #include "H2MOD/Modules/EventHandler/EventHandler.hpp"
 #include "H2MOD/Modules/MapManager/MapManager.h"
+#include "H2MOD/Modules/Networking/NetworkTelemetry/NetworkTelemetry.h"
 
 #include "Util/Hooks/Hook.h"
 
@@ -115,8 +116,14 @@ handle_out_of_band_message_t p_handle_out_of_band_message;
 void __stdcall handle_out_of_band_message_hook(void *thisx, network_address* address, e_network_message_type_collection message_type, int a4, void* packet)
 {
 	/* surprisingly the game doesn't use this too much, pretty much for request-join and time-sync packets */
+	// the peer lookup needs a session, the message is counted as coming from an unknown peer otherwise
+	int peer_index = NONE;
+	if (NetworkSession::GetActiveNetworkSession(nullptr))
+		peer_index = NetworkSession::GetPeerIndexFromNetworkAddress(address);
+	NetworkTelemetry::RecordMessage(_network_telemetry_direction_received, peer_index, message_type, a4);
+
 	LOG_TRACE_NETWORK("{} - Received message: {} from peer index: {}", 
-		__FUNCTION__, GetNetworkMessageName(message_type), NetworkSession::GetPeerIndexFromNetworkAddress(address));
+		__FUNCTION__, GetNetworkMessageName(message_type), peer_index);
 
 	if (!MessageIsCustom(message_type))
 		p_handle_out_of_band_message(thisx, address, message_type, a4, packet);
@@ -135,6 +142,13 @@ void __stdcall handle_channel_message_hook(void *thisx, int network_channel_inde
 	ZeroMemory(&addr, sizeof(network_address));
 	s_network_channel* peer_network_channel = s_network_channel::Get(network_channel_index);
 
+	int channel_peer_index = NONE;
+	bool channel_has_address = peer_network_channel->GetNetworkAddressFromNetworkChannel(&addr);
+	if (channel_has_address && NetworkSession::GetActiveNetworkSession(nullptr))
+		channel_peer_index = NetworkSession::GetPeerIndexFromNetworkAddress(&addr);
+
+	NetworkTelemetry::RecordMessage(_network_telemetry_direction_received, channel_peer_index, message_type, dynamic_data_size);
+
 	switch (message_type)
 	{
 	case _request_map_filename:
@@ -185,6 +199,8 @@ void __stdcall handle_channel_message_hook(void *thisx, int network_channel_inde
 		if (peer_network_channel->channel_state == s_network_channel::e_channel_state::unk_state_5)
 		{
 			s_custom_map_filename* received_data = (s_custom_map_filename*)packet;
+			NetworkTelemetry::RecordResponseReceived(_custom_map_filename, channel_peer_index, received_data->map_download_id);
+
 			if (received_data->map_download_id != NONE)
 			{
 				auto map_download_query = mapManager->GetDownloadQueryById(received_data->map_download_id);
@@ -269,10 +285,10 @@ void __stdcall handle_channel_message_hook(void *thisx, int network_channel_inde
 		break;
 	} // switch (message_type)
 
-	if (peer_network_channel->GetNetworkAddressFromNetworkChannel(&addr))
+	if (channel_has_address)
 	{
 		LOG_TRACE_NETWORK("{} - Received message: {} from peer index: {}, address: {:x}", 
-			__FUNCTION__, GetNetworkMessageName(message_type), NetworkSession::GetPeerIndexFromNetworkAddress(&addr), ntohl(addr.address.ipv4));
+			__FUNCTION__, GetNetworkMessageName(message_type), channel_peer_index, ntohl(addr.address.ipv4));
 	}
 	else
 	{
@@ -308,6 +324,7 @@ void NetworkMessage::SendRequestMapFilename(int mapDownloadId)
 		s_session_observer_channel* observer_channel = NetworkSession::GetPeerObserverChannel(session->session_host_peer_index);
 
 		if (observer_channel->field_1) {
+			NetworkTelemetry::RecordRequestSent(_request_map_filename, session->session_host_peer_index, mapDownloadId);
 			observer->sendNetworkMessage(session->session_index, observer_channel->observer_index, s_network_observer::e_network_message_send_protocol::in_band, _request_map_filename, sizeof(s_request_map_filename), &data);
 
 			LOG_TRACE_NETWORK("{} session host peer index: {}, observer index {}, observer bool unk: {}, session index: {}",
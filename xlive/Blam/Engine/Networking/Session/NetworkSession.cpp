@@ -206,6 +206,23 @@ s_session_observer_channel* NetworkSession::GetPeerObserverChannel(int peerIdx)
 	return &GetActiveNetworkSession()->observer_channels[peerIdx];
 }
 
+// returns NONE (-1) if no peer uses the observer channel
+int NetworkSession::GetPeerIndexFromObserverIndex(int observerIdx)
+{
+	// messages can be sent outside of a session as well
+	s_network_session* session = nullptr;
+	if (!GetActiveNetworkSession(&session))
+		return NONE;
+
+	for (int peerIdx = 0; peerIdx < NETWORK_SESSION_PEERS_MAX; peerIdx++)
+	{
+		if (session->observer_channels[peerIdx].field_1
+			&& session->observer_channels[peerIdx].observer_index == observerIdx)
+			return peerIdx;
+	}
+	return NONE;
+}
+
 wchar_t* NetworkSession::GetGameVariantName()
 {
 	return GetActiveNetworkSession()->parameters[0].game_variant.variant_name;
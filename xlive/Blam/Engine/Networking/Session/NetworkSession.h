@@ -40,6 +40,7 @@ namespace NetworkSession
 	void KickPeer(int peerIdx);
 	void EndGame();
 	s_session_observer_channel* GetPeerObserverChannel(int peerIdx);
+	int GetPeerIndexFromObserverIndex(int observerIdx);
 
 	// peer-player functions
 	int GetPeerIndex(int playerIdx);
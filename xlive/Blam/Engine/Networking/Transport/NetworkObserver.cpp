@@ -3,6 +3,9 @@
 #include "NetworkObserver.h"
 #include "NetworkChannel.h"
 
+#include "Blam/Engine/Networking/Session/NetworkSession.h"
+#include "H2MOD/Modules/Networking/NetworkTelemetry/NetworkTelemetry.h"
+
 #include "Util/Hooks/Hook.h"
 
 s_network_observer_configuration* g_network_configuration;
@@ -142,6 +145,8 @@ void s_network_observer::sendNetworkMessage(int session_index, int observer_inde
 	typedef void(__thiscall* observer_channel_send_message_t)(s_network_observer*, int, int, e_network_message_send_protocol, int, int, void*);
 	auto p_observer_channel_send_message = Memory::GetAddress<observer_channel_send_message_t>(0x1BED40, 0x1B8C1A);
 
+	// only the messages sent by the mod go through here, the game calls the function directly
+	NetworkTelemetry::RecordMessage(_network_telemetry_direction_sent, NetworkSession::GetPeerIndexFromObserverIndex(observer_index), (e_network_message_type_collection)type, size);
 	p_observer_channel_send_message(this, session_index, observer_index, send_out_of_band, type, size, data);
 }
 
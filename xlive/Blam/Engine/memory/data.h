@@ -15,6 +15,49 @@ struct s_bitflags
 		return (m_flags[index / (CHAR_BIT * sizeof(T))] & FLAG(index & (CHAR_BIT * sizeof(T) - 1))) != 0;
 	}
 
+	// returns the index of the first set bit in [index, end), or -1 if none
+	// scans a whole word at a time, skipping the empty ones
+	int find_next_set_bit(int index, int end) const
+	{
+		typedef std::make_unsigned_t<T> word_t;
+		const int word_bits = CHAR_BIT * sizeof(T);
+
+		if (index < 0 || index >= end)
+			return -1;
+
+		int word_index = index / word_bits;
+		// ignore the bits before index in the first word
+		word_t word = (word_t)m_flags[word_index] & ((word_t)~(word_t)0 << (index & (word_bits - 1)));
+
+		while (word == 0)
+		{
+			if (++word_index * word_bits >= end)
+				return -1;
+			word = (word_t)m_flags[word_index];
+		}
+
+		int result = word_index * word_bits + lowest_set_bit(word);
+		return result < end ? result : -1;
+	}
+
+	static int lowest_set_bit(std::make_unsigned_t<T> word)
+	{
+		unsigned long bit_index = 0;
+		if constexpr (sizeof(T) <= sizeof(unsigned long))
+		{
+			_BitScanForward(&bit_index, (unsigned long)word);
+		}
+		else
+		{
+			if (!_BitScanForward(&bit_index, (unsigned long)word))
+			{
+				_BitScanForward(&bit_index, (unsigned long)(word >> 32));
+				bit_index += 32;
+			}
+		}
+		return (int)bit_index;
+	}
+
 	void set_bit(int index, bool state)
 	{
 		if (state)
@@ -83,6 +126,11 @@ public:
 		return reinterpret_cast<T*>(&m_data_array->data[m_data_array->datum_element_size * DATUM_INDEX_TO_ABSOLUTE_INDEX(datum_index)]);
 	};
 
+	T* get_data_at_absolute_index(int absolute_index) const
+	{
+		return reinterpret_cast<T*>(&m_data_array->data[m_data_array->datum_element_size * absolute_index]);
+	}
+
 	T* get_current_datum()
 	{
 		return reinterpret_cast<T*>(&m_data_array->data[m_data_array->datum_element_size * m_current_absolute_index]);
@@ -110,18 +158,40 @@ public:
 	
 	int get_next_absolute_datum_index(int index) const
 	{
-		if (index < 0)
-			return -1;
+		return m_data_array->active_bit_mask.find_next_set_bit(index, m_data_array->next_unused_index);
+	}
 
-		if (index >= m_data_array->next_unused_index)
-			return -1;
+	/*
+		Collects the absolute indices of the next (up to max_count) active datums, after the current one.
+		The iterator advances to the last collected datum, returns the count of indices collected.
+		Lets the caller prefetch the data of a batch before processing it.
+	*/
+	int collect_next_absolute_indices(int* out_indices, int max_count)
+	{
+		int count = 0;
+		int index = m_current_absolute_index;
 
-		while (!m_data_array->active_bit_mask.test_bit(index))
+		while (count < max_count)
 		{
-			if (++index >= m_data_array->next_unused_index)
-				return -1;
+			index = get_next_absolute_datum_index(index + 1);
+			if (index == -1)
+				break;
+
+			out_indices[count++] = index;
 		}
-		return index;
+
+		if (count > 0)
+		{
+			m_current_absolute_index = out_indices[count - 1];
+			m_last_datum_index = DATUM_INDEX_NEW(m_current_absolute_index, *(unsigned short*)(get_data_at_absolute_index(m_current_absolute_index))); // absolute index w/ salt
+		}
+		else
+		{
+			m_last_datum_index = DATUM_INDEX_NONE;
+			m_current_absolute_index = m_data_array->datum_max_elements;
+		}
+
+		return count;
 	}
 
 	int get_current_absolute_index() const
@@ -17,6 +17,92 @@ namespace lazy_blam
 	//datum scenario_datum;
 	//s_tag_table_data tag_table;
 
+	static std::mutex cache_file_mappings_mutex;
+	static std::unordered_map<std::string, std::weak_ptr<cache_file_mapping>> cache_file_mappings;
+
+	cache_file_mapping::~cache_file_mapping()
+	{
+		if (view != nullptr)
+			UnmapViewOfFile(view);
+		if (mapping_handle != NULL)
+			CloseHandle(mapping_handle);
+		if (file_handle != INVALID_HANDLE_VALUE)
+			CloseHandle(file_handle);
+	}
+
+	std::shared_ptr<cache_file_mapping> cache_file_mapping::open(const std::string& map_file)
+	{
+		std::string key(map_file);
+		std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+		std::lock_guard lg(cache_file_mappings_mutex);
+
+		// re-use the mapping if the map is already opened by another instance
+		auto it = cache_file_mappings.find(key);
+		if (it != cache_file_mappings.end())
+		{
+			if (auto mapping = it->second.lock())
+				return mapping;
+		}
+
+		auto mapping = std::make_shared<cache_file_mapping>();
+		LARGE_INTEGER file_size;
+
+		do
+		{
+			mapping->file_handle = CreateFileA(map_file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+			if (mapping->file_handle == INVALID_HANDLE_VALUE)
+				break;
+
+			if (!GetFileSizeEx(mapping->file_handle, &file_size)
+				|| file_size.QuadPart < sizeof(s_cache_header)
+				|| file_size.QuadPart > MAXDWORD)
+				break;
+
+			mapping->mapping_handle = CreateFileMappingA(mapping->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping->mapping_handle == NULL)
+				break;
+
+			mapping->view = (const char*)MapViewOfFile(mapping->mapping_handle, FILE_MAP_READ, 0, 0, 0);
+			if (mapping->view == nullptr)
+				break;
+
+			mapping->size = (size_t)file_size.QuadPart;
+			cache_file_mappings[key] = mapping;
+			return mapping;
+		} while (0);
+
+		LOG_ERROR_GAME("[{}] failed to map {}, error: {}", __FUNCTION__, map_file, GetLastError());
+		return nullptr;
+	}
+
+	bool lazy_blam::read_data(unsigned int offset, void* out_buffer, size_t size)
+	{
+		if (map_mapping != nullptr)
+		{
+			const char* data = get_mapped_data(offset, size);
+			if (data == nullptr)
+				return false;
+
+			memcpy(out_buffer, data, size);
+			return true;
+		}
+
+		map_stream->seekg(offset);
+		map_stream->read((char*)out_buffer, size);
+		return !map_stream->fail();
+	}
+
+	const char* lazy_blam::get_mapped_data(unsigned int offset, size_t size)
+	{
+		if (map_mapping == nullptr
+			|| offset > map_mapping->size
+			|| size > map_mapping->size - offset)
+			return nullptr;
+
+		return map_mapping->view + offset;
+	}
+
 	bool lazy_blam::init_cache_file(std::string map_name)
 	{
 		maps_dir = GetExeDirectoryNarrow() + "\\maps";
@@ -38,15 +124,23 @@ namespace lazy_blam
 				return false;
 		}
 
-		map_stream = new std::ifstream(map_file.c_str(), std::ios::binary | std::ios::in);
+		// map the cache file, fallback to file stream if the address space is too fragmented to map it
+		map_mapping = cache_file_mapping::open(map_file);
+		if (map_mapping == nullptr)
+			map_stream = new std::ifstream(map_file.c_str(), std::ios::binary | std::ios::in);
 
-		map_stream->read((char*)&map_header, sizeof(s_cache_header));
-		map_stream->seekg(map_header.tag_offset + 4);
 		int tag_parent_count;
-		map_stream->read((char*)&tag_parent_count, sizeof(int));
-		map_stream->seekg(map_header.tag_offset + 12);
-		map_stream->read((char*)&scenario_datum, sizeof(datum));
+		if (!read_data(0, &map_header, sizeof(s_cache_header))
+			|| !read_data(map_header.tag_offset + 4, &tag_parent_count, sizeof(int))
+			|| !read_data(map_header.tag_offset + 12, &scenario_datum, sizeof(datum)))
+		{
+			LOG_ERROR_GAME("[{}] failed to read cache header of {}", __FUNCTION__, map_file);
+			close_cache_file();
+			return false;
+		}
 		tag_table = s_tag_table_data();
+		tag_name_index.clear();
+		tag_datum_index.clear();
 
 		tag_table.tag_table_start_unpadded = map_header.tag_offset + 0xC * tag_parent_count + 0x20;;
 		if (map_header.type == s_cache_header::e_scnr_type::MultiplayerSharedScenario)
@@ -60,29 +154,44 @@ namespace lazy_blam
 			tag_table.tag_data_start = map_header.tag_size + map_header.tag_offset;
 		}
 		
-		map_stream->seekg(tag_table.tag_table_start + DATUM_INDEX_TO_ABSOLUTE_INDEX(scenario_datum) * sizeof(tags::tag_instance) + 0x8);
-		map_stream->read((char*)&tag_table.scenario_address, 4);
+		read_data(tag_table.tag_table_start + DATUM_INDEX_TO_ABSOLUTE_INDEX(scenario_datum) * sizeof(tags::tag_instance) + 0x8, &tag_table.scenario_address, 4);
 
 		tags::tag_instance tag_instance;
 		std::string input;
 		int count = 0;
 		int names_pos = map_header.TagNamesBufferOffset;
 
-		while (true) 
-		{
-			map_stream->seekg(tag_table.tag_table_start + count * sizeof(tags::tag_instance));
-			map_stream->read((char*)&tag_instance, sizeof(tags::tag_instance));
+		tag_table.table.reserve(map_header.TagNamesCount);
+		tag_name_index.reserve(map_header.TagNamesCount);
+		tag_datum_index.reserve(map_header.TagNamesCount);
 
+		while (read_data(tag_table.tag_table_start + count * sizeof(tags::tag_instance), &tag_instance, sizeof(tags::tag_instance)))
+		{
 			if (!tag_instance.type.is_class_valid())
 				break;
 
-			map_stream->seekg(names_pos);
-			std::getline(*map_stream, input, '\0');
-			names_pos = map_stream->tellg();
+			if (map_mapping != nullptr)
+			{
+				// names are null terminated, read them straight from the mapping
+				const char* name = get_mapped_data(names_pos, 0);
+				size_t name_length = name != nullptr ? strnlen(name, map_mapping->size - names_pos) : 0;
+				input.assign(name != nullptr ? name : "", name_length);
+				names_pos += name_length + 1;
+			}
+			else
+			{
+				map_stream->seekg(names_pos);
+				std::getline(*map_stream, input, '\0');
+				names_pos = map_stream->tellg();
+			}
 
 			//tag_table.table.emplace_back(tag_instance, input, nullptr);
 			tag_table.table.push_back(lazy_blam_tag_instance(tag_instance, input));
 
+			// first tag with the name wins, same as the linear lookup did
+			tag_name_index.emplace(input, count);
+			tag_datum_index.emplace(tag_instance.datum_index, count);
+
 			++count;
 		}
 		tag_table.tag_count = count;
@@ -93,26 +202,30 @@ namespace lazy_blam
 
 	void lazy_blam::close_cache_file()
 	{
-		map_stream->close();
-		delete map_stream;
+		if (map_stream != nullptr)
+		{
+			map_stream->close();
+			delete map_stream;
+			map_stream = nullptr;
+		}
+		// the mapping is released when the last instance using it closes
+		map_mapping.reset();
 		map_header = s_cache_header();
 	}
 
 	datum lazy_blam::get_datum_from_name(std::string tag_name, blam_tag type)
 	{
-		for (auto& instance : tag_table.table)
-			if (instance.name == tag_name)
-				return instance.datum_index;
+		auto it = tag_name_index.find(tag_name);
+		if (it != tag_name_index.end())
+			return tag_table.table[it->second].datum_index;
 		return -1;
 	}
 
-
-
 	lazy_blam_tag_instance* lazy_blam::get_tag_instance(datum tag_datum)
 	{
-		for (auto& instance : tag_table.table)
-			if (instance.datum_index == tag_datum)
-				return &instance;
+		auto it = tag_datum_index.find(tag_datum);
+		if (it != tag_datum_index.end())
+			return &tag_table.table[it->second];
 		return nullptr;
 	}
 
@@ -121,11 +234,6 @@ namespace lazy_blam
 		return "";
 	}
 
-	std::ifstream* lazy_blam::get_map_stream()
-	{
-		return map_stream;
-	}
-
 	s_cache_header* lazy_blam::get_cache_header()
 	{
 		return &map_header;
@@ -173,8 +281,7 @@ namespace lazy_blam
 	char* lazy_blam::load_tag_data(lazy_blam_tag_instance* instance)
 	{
 		if (instance->data.size == 0) {
-			map_stream->seekg(resolve_data_offset(instance->data_offset));
-			map_stream->read(instance->data.next(instance->size), instance->size);
+			read_data(resolve_data_offset(instance->data_offset), instance->data.next(instance->size), instance->size);
 			switch (instance->type.tag_type) {
 				case blam_tag::tag_group_type::weapon:
 					loader::weapon(this, instance);
@@ -190,6 +297,13 @@ namespace lazy_blam
 		return nullptr;
 	}
 
+	// returns the tag data as stored in the cache file, without copying it
+	// block offsets are not rebased, use load_tag_data/get_tag_data when they are needed
+	const char* lazy_blam::get_raw_tag_data(lazy_blam_tag_instance* instance)
+	{
+		return get_mapped_data(resolve_data_offset(instance->data_offset), instance->size);
+	}
+
 	void lazy_blam::rebase_tag_data(lazy_blam_tag_instance* instance)
 	{
 		auto tag_data_base = int(*Memory::GetAddress<int**>(0x47CD54));
@@ -15,17 +15,40 @@ namespace lazy_blam
 		void globals(lazy_blam_tag_instance* instance, unsigned int base);
 	}
 
+	// read-only mapping of a cache file, shared by all the lazy_blam instances of the same map
+	class cache_file_mapping
+	{
+		public:
+			HANDLE file_handle = INVALID_HANDLE_VALUE;
+			HANDLE mapping_handle = NULL;
+			const char* view = nullptr;
+			size_t size = 0;
+
+			~cache_file_mapping();
+
+			static std::shared_ptr<cache_file_mapping> open(const std::string& map_file);
+	};
+
 	class lazy_blam
 	{
 		private:
 			std::string map_file;
-			std::ifstream* map_stream;
+			// stream backend, used only when the cache file couldn't be mapped
+			std::ifstream* map_stream = nullptr;
+			std::shared_ptr<cache_file_mapping> map_mapping;
 			std::string maps_dir;
 			std::string mods_dir;
 
 			s_cache_header map_header;
 			datum scenario_datum;
 			s_tag_table_data tag_table;
+
+			// tag table lookups
+			std::unordered_map<std::string, size_t> tag_name_index;
+			std::unordered_map<datum, size_t> tag_datum_index;
+
+			bool read_data(unsigned int offset, void* out_buffer, size_t size);
+
 			class loader
 			{
 			public:
@@ -41,7 +64,7 @@ namespace lazy_blam
 			
 			lazy_blam_tag_instance* get_tag_instance(datum tag_datum);
 			std::string get_name_from_datum(datum tag_datum);
-			std::ifstream* get_map_stream();
+			const char* get_mapped_data(unsigned int offset, size_t size);
 			s_cache_header* get_cache_header();
 			s_tag_table_data* get_tag_table();
 			void clear_loaded_tags();
@@ -49,6 +72,7 @@ namespace lazy_blam
 			std::vector<datum> find_tags(blam_tag type);
 
 			char* load_tag_data(lazy_blam_tag_instance* instance);
+			const char* get_raw_tag_data(lazy_blam_tag_instance* instance);
 			static void rebase_tag_data(lazy_blam_tag_instance* instance);
 
 			explicit lazy_blam(std::string map_name)
@@ -58,9 +82,6 @@ namespace lazy_blam
 			template<typename T>
 			T* get_tag_data(datum tag_datum)
 			{
-				auto map_stream = get_map_stream();
-				auto map_header = get_cache_header();
-				auto tag_table = get_tag_table();
 				auto tag_inst = get_tag_instance(tag_datum);
 
 				if (tag_inst == nullptr)
@@ -11,20 +11,22 @@
 		{ \
 			if (!(instance->data_offset <= tag_block.data && tag_block.data <= (instance->data_offset + instance->size)))\
 			{\
-				blam->map_stream->seekg(blam->resolve_data_offset(tag_block.data));\
-				tag_block.data = instance->data_offset + instance->size;\
-				blam->map_stream->read(instance->data.next(tag_block.data_size()), tag_block.data_size());\
-				instance->size += tag_block.data_size();\
+				/* tag_block lives in the instance buffer, which is reallocated by next() */\
+				auto block_file_offset = blam->resolve_data_offset(tag_block.data);\
+				auto block_data_size = tag_block.data_size();\
+				auto block_new_offset = instance->data_offset + instance->size;\
+				tag_block.data = block_new_offset;\
+				blam->read_data(block_file_offset, instance->data.next(block_data_size), block_data_size);\
+				instance->size += block_data_size;\
 				LOG_ERROR_GAME(\
-					"[{}] {} Range:{:x}-{:x} New Offset:{:x} Data Size:{:x} Instance Size: {:x} tag_block: {:x} Tag: {}",\
+					"[{}] {} Range:{:x}-{:x} New Offset:{:x} Data Size:{:x} Instance Size: {:x} Tag: {}",\
 					__FUNCTION__,\
 					#tag_block,\
 					instance->data_offset,\
 					instance->data_offset + instance->size,\
-					tag_block.data,\
-					tag_block.data_size(),\
+					block_new_offset,\
+					block_data_size,\
 					instance->size,\
-					(unsigned long)&tag_block,\
 					instance->name\
 				);\
 			}\
@@ -34,20 +36,22 @@
 	{\
 		if (!(instance->data_offset <= block.block_offset && block.block_offset <= (instance->data_offset + instance->size)))\
 		{\
-			blam->map_stream->seekg(blam->resolve_data_offset(block.block_offset));\
-			block.block_offset = instance->data_offset + instance->size;\
-			blam->map_stream->read(instance->data.next(block.block_size), block.block_size);\
-			instance->size += block.block_size;\
+			/* block lives in the instance buffer, which is reallocated by next() */\
+			auto data_file_offset = blam->resolve_data_offset(block.block_offset);\
+			auto data_size = block.block_size;\
+			auto data_new_offset = instance->data_offset + instance->size;\
+			block.block_offset = data_new_offset;\
+			blam->read_data(data_file_offset, instance->data.next(data_size), data_size);\
+			instance->size += data_size;\
 			LOG_ERROR_GAME(\
-				"[{}] {} Range:{:x}-{:x} New Offset:{:x} Data Size:{:x} Instance Size:{:x} data_block:{:x} tag: {}",\
+				"[{}] {} Range:{:x}-{:x} New Offset:{:x} Data Size:{:x} Instance Size:{:x} tag: {}",\
 				__FUNCTION__,\
 				#block,\
 				instance->data_offset,\
 				instance->data_offset + instance->size,\
-				block.block_offset,\
-				block.block_size,\
+				data_new_offset,\
+				data_size,\
 				instance->size,\
-				(unsigned long)&block,\
 				instance->name\
 			);\
 		}\
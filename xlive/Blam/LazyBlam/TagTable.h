@@ -10,6 +10,15 @@ public:
 	explicit LazyBuffer() : buffer(nullptr) {}
 	~LazyBuffer() { free(buffer); }
 
+	// the buffer is owned, moving the tag table around must not free it twice
+	LazyBuffer(const LazyBuffer& other) = delete;
+	LazyBuffer& operator=(const LazyBuffer& other) = delete;
+	LazyBuffer(LazyBuffer&& other) noexcept : buffer(other.buffer), size(other.size)
+	{
+		other.buffer = nullptr;
+		other.size = 0;
+	}
+
 	void resize(size_t newSize)
 	{
 		if (auto mem = realloc(buffer, newSize))
@@ -47,6 +56,7 @@ struct lazy_blam_tag_instance : tags::tag_instance
 {
 	std::string name;
 	LazyBuffer data;
+	lazy_blam_tag_instance(lazy_blam_tag_instance&& other) = default;
 	lazy_blam_tag_instance(tags::tag_instance instance, std::string name)
 	{
 		this->datum_index = instance.datum_index;
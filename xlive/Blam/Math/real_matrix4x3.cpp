@@ -3,6 +3,8 @@
 #include "real_matrix4x3.h"
 #include "real_vector3d.h"
 
+#include <xmmintrin.h>
+
 void matrix4x3_to_quaternion_rotation(const real_matrix4x3* m, real_quaternion* out_quat)
 {
 	typedef void(__cdecl* matrix4x3_to_quaternion_rotation_t)(const real_matrix4x3*, real_quaternion*);
@@ -37,4 +39,229 @@ void matrix4x3_interpolate(const real_matrix4x3* previous, const real_matrix4x3*
 	// interpolate scale and the position of the node
 	scale_interpolate(previous->scale, target->scale, fractional_ticks, &out_mat->scale);
 	points_interpolate(&previous->position, &target->position, fractional_ticks, &out_mat->position);
-}
\ No newline at end of file
+}
+
+#pragma region structure of arrays interpolation
+// real_matrix4x3 as floats: scale, forward, left, up, position
+#define MATRIX4X3_FLOAT_COUNT (sizeof(real_matrix4x3) / sizeof(float))
+
+static_assert(MATRIX4X3_FLOAT_COUNT == 13, "real_matrix4x3 layout changed");
+
+// loads 4 matrices, out[n] holds float n of each matrix
+static void matrix4x3_load4(const real_matrix4x3* matrices, __m128 out[MATRIX4X3_FLOAT_COUNT])
+{
+	const float* m0 = (const float*)&matrices[0];
+	const float* m1 = (const float*)&matrices[1];
+	const float* m2 = (const float*)&matrices[2];
+	const float* m3 = (const float*)&matrices[3];
+
+	for (int i = 0; i < 12; i += 4)
+	{
+		__m128 r0 = _mm_loadu_ps(m0 + i);
+		__m128 r1 = _mm_loadu_ps(m1 + i);
+		__m128 r2 = _mm_loadu_ps(m2 + i);
+		__m128 r3 = _mm_loadu_ps(m3 + i);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		out[i + 0] = r0;
+		out[i + 1] = r1;
+		out[i + 2] = r2;
+		out[i + 3] = r3;
+	}
+	out[12] = _mm_setr_ps(m0[12], m1[12], m2[12], m3[12]);
+}
+
+// inverse of matrix4x3_load4
+static void matrix4x3_store4(const __m128 in[MATRIX4X3_FLOAT_COUNT], real_matrix4x3* matrices)
+{
+	float* m0 = (float*)&matrices[0];
+	float* m1 = (float*)&matrices[1];
+	float* m2 = (float*)&matrices[2];
+	float* m3 = (float*)&matrices[3];
+
+	for (int i = 0; i < 12; i += 4)
+	{
+		__m128 r0 = in[i + 0];
+		__m128 r1 = in[i + 1];
+		__m128 r2 = in[i + 2];
+		__m128 r3 = in[i + 3];
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(m0 + i, r0);
+		_mm_storeu_ps(m1 + i, r1);
+		_mm_storeu_ps(m2 + i, r2);
+		_mm_storeu_ps(m3 + i, r3);
+	}
+
+	alignas(16) float position_z[4];
+	_mm_store_ps(position_z, in[12]);
+	m0[12] = position_z[0];
+	m1[12] = position_z[1];
+	m2[12] = position_z[2];
+	m3[12] = position_z[3];
+}
+
+static __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// forward, left and up are the rows of the rotation, same as real_matrix4x3::set_rotation
+// the largest quaternion component is taken from the diagonal and the other 3 are derived from it, without branching per lane
+static void matrix4x3_rotation_to_quaternion4(const __m128 m[MATRIX4X3_FLOAT_COUNT], __m128 out_quaternion[4])
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 m00 = m[1], m01 = m[2], m02 = m[3];
+	const __m128 m10 = m[4], m11 = m[5], m12 = m[6];
+	const __m128 m20 = m[7], m21 = m[8], m22 = m[9];
+
+	// 4 times the square of each component
+	__m128 dw = _mm_add_ps(_mm_add_ps(one, m00), _mm_add_ps(m11, m22));
+	__m128 di = _mm_sub_ps(_mm_add_ps(one, m00), _mm_add_ps(m11, m22));
+	__m128 dj = _mm_sub_ps(_mm_add_ps(one, m11), _mm_add_ps(m00, m22));
+	__m128 dk = _mm_sub_ps(_mm_add_ps(one, m22), _mm_add_ps(m00, m11));
+	__m128 d_max = _mm_max_ps(_mm_max_ps(dw, di), _mm_max_ps(dj, dk));
+
+	__m128 mask_w = _mm_cmpeq_ps(dw, d_max);
+	__m128 mask_i = _mm_andnot_ps(mask_w, _mm_cmpeq_ps(di, d_max));
+	__m128 mask_j = _mm_andnot_ps(_mm_or_ps(mask_w, mask_i), _mm_cmpeq_ps(dj, d_max));
+	// k when none of the above
+
+	// d_max is at least 1 for a rotation, no division by 0
+	__m128 largest = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sqrt_ps(d_max));
+	__m128 inverse = _mm_div_ps(_mm_set1_ps(0.25f), largest);
+
+	__m128 a = _mm_mul_ps(_mm_sub_ps(m21, m12), inverse);
+	__m128 b = _mm_mul_ps(_mm_sub_ps(m02, m20), inverse);
+	__m128 c = _mm_mul_ps(_mm_sub_ps(m10, m01), inverse);
+	__m128 e = _mm_mul_ps(_mm_add_ps(m01, m10), inverse);
+	__m128 f = _mm_mul_ps(_mm_add_ps(m02, m20), inverse);
+	__m128 g = _mm_mul_ps(_mm_add_ps(m12, m21), inverse);
+
+	out_quaternion[0] = select4(mask_w, a, select4(mask_i, largest, select4(mask_j, e, f)));
+	out_quaternion[1] = select4(mask_w, b, select4(mask_i, e, select4(mask_j, largest, g)));
+	out_quaternion[2] = select4(mask_w, c, select4(mask_i, f, select4(mask_j, g, largest)));
+	out_quaternion[3] = select4(mask_w, largest, select4(mask_i, a, select4(mask_j, b, c)));
+}
+
+static void matrix4x3_to_soa_cache4(const real_matrix4x3* matrices, float* cache, int padded_count)
+{
+	__m128 m[MATRIX4X3_FLOAT_COUNT];
+	__m128 quaternion[4];
+
+	matrix4x3_load4(matrices, m);
+	matrix4x3_rotation_to_quaternion4(m, quaternion);
+
+	_mm_storeu_ps(&cache[_matrix4x3_soa_quaternion_i * padded_count], quaternion[0]);
+	_mm_storeu_ps(&cache[_matrix4x3_soa_quaternion_j * padded_count], quaternion[1]);
+	_mm_storeu_ps(&cache[_matrix4x3_soa_quaternion_k * padded_count], quaternion[2]);
+	_mm_storeu_ps(&cache[_matrix4x3_soa_quaternion_w * padded_count], quaternion[3]);
+	_mm_storeu_ps(&cache[_matrix4x3_soa_scale * padded_count], m[0]);
+	_mm_storeu_ps(&cache[_matrix4x3_soa_position_x * padded_count], m[10]);
+	_mm_storeu_ps(&cache[_matrix4x3_soa_position_y * padded_count], m[11]);
+	_mm_storeu_ps(&cache[_matrix4x3_soa_position_z * padded_count], m[12]);
+}
+
+// same as the game's quaternion_interpolate_and_normalize followed by quaternion_rotation_to_matrix4x3
+static void matrix4x3_interpolate4(const float* cache, int padded_count, const real_matrix4x3* target, float fractional_ticks, real_matrix4x3* out_matrices)
+{
+	__m128 m[MATRIX4X3_FLOAT_COUNT];
+	__m128 current[4];
+
+	matrix4x3_load4(target, m);
+	matrix4x3_rotation_to_quaternion4(m, current);
+
+	__m128 previous_i = _mm_loadu_ps(&cache[_matrix4x3_soa_quaternion_i * padded_count]);
+	__m128 previous_j = _mm_loadu_ps(&cache[_matrix4x3_soa_quaternion_j * padded_count]);
+	__m128 previous_k = _mm_loadu_ps(&cache[_matrix4x3_soa_quaternion_k * padded_count]);
+	__m128 previous_w = _mm_loadu_ps(&cache[_matrix4x3_soa_quaternion_w * padded_count]);
+
+	__m128 t = _mm_set1_ps(fractional_ticks);
+	__m128 previous_t = _mm_set1_ps(1.0f - fractional_ticks);
+
+	// take the shortest path, flip the target's sign if the quaternions point away from each other
+	__m128 dot = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(previous_i, current[0]), _mm_mul_ps(previous_j, current[1])),
+		_mm_add_ps(_mm_mul_ps(previous_k, current[2]), _mm_mul_ps(previous_w, current[3])));
+	__m128 current_t = _mm_xor_ps(t, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f)));
+
+	__m128 i = _mm_add_ps(_mm_mul_ps(previous_i, previous_t), _mm_mul_ps(current[0], current_t));
+	__m128 j = _mm_add_ps(_mm_mul_ps(previous_j, previous_t), _mm_mul_ps(current[1], current_t));
+	__m128 k = _mm_add_ps(_mm_mul_ps(previous_k, previous_t), _mm_mul_ps(current[2], current_t));
+	__m128 w = _mm_add_ps(_mm_mul_ps(previous_w, previous_t), _mm_mul_ps(current[3], current_t));
+
+	// the normalization folds into the scale of real_matrix4x3::set_rotation
+	__m128 square_length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(i, i), _mm_mul_ps(j, j)), _mm_add_ps(_mm_mul_ps(k, k), _mm_mul_ps(w, w)));
+	__m128 s = _mm_div_ps(_mm_set1_ps(2.0f), _mm_max_ps(square_length, _mm_set1_ps(FLT_MIN)));
+
+	__m128 is = _mm_mul_ps(i, s);
+	__m128 js = _mm_mul_ps(j, s);
+	__m128 ks = _mm_mul_ps(k, s);
+	__m128 iw = _mm_mul_ps(w, is);
+	__m128 jw = _mm_mul_ps(w, js);
+	__m128 kw = _mm_mul_ps(w, ks);
+	__m128 ii = _mm_mul_ps(i, is);
+	__m128 jj = _mm_mul_ps(j, js);
+	__m128 kk = _mm_mul_ps(k, ks);
+	__m128 ij = _mm_mul_ps(i, js);
+	__m128 ik = _mm_mul_ps(i, ks);
+	__m128 jk = _mm_mul_ps(j, ks);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 out[MATRIX4X3_FLOAT_COUNT];
+	out[0] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cache[_matrix4x3_soa_scale * padded_count]), previous_t), _mm_mul_ps(m[0], t));
+	out[1] = _mm_sub_ps(one, _mm_add_ps(jj, kk));
+	out[2] = _mm_sub_ps(ij, kw);
+	out[3] = _mm_add_ps(ik, jw);
+	out[4] = _mm_add_ps(ij, kw);
+	out[5] = _mm_sub_ps(one, _mm_add_ps(ii, kk));
+	out[6] = _mm_sub_ps(jk, iw);
+	out[7] = _mm_sub_ps(ik, jw);
+	out[8] = _mm_add_ps(jk, iw);
+	out[9] = _mm_sub_ps(one, _mm_add_ps(ii, jj));
+	out[10] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cache[_matrix4x3_soa_position_x * padded_count]), previous_t), _mm_mul_ps(m[10], t));
+	out[11] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cache[_matrix4x3_soa_position_y * padded_count]), previous_t), _mm_mul_ps(m[11], t));
+	out[12] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cache[_matrix4x3_soa_position_z * padded_count]), previous_t), _mm_mul_ps(m[12], t));
+
+	matrix4x3_store4(out, out_matrices);
+}
+
+void matrix4x3_to_soa_cache(const real_matrix4x3* matrices, int count, float* out_cache)
+{
+	int padded_count = matrix4x3_soa_padded_count(count);
+	int full_count = count & ~(MATRIX4X3_SOA_LANE_COUNT - 1);
+
+	for (int i = 0; i < full_count; i += MATRIX4X3_SOA_LANE_COUNT)
+		matrix4x3_to_soa_cache4(&matrices[i], &out_cache[i], padded_count);
+
+	if (full_count < count)
+	{
+		// the padding lanes repeat the last matrix
+		real_matrix4x3 tail[MATRIX4X3_SOA_LANE_COUNT];
+		for (int i = 0; i < MATRIX4X3_SOA_LANE_COUNT; i++)
+			tail[i] = matrices[(std::min)(full_count + i, count - 1)];
+
+		matrix4x3_to_soa_cache4(tail, &out_cache[full_count], padded_count);
+	}
+}
+
+void matrix4x3_interpolate_soa(const float* previous_cache, const real_matrix4x3* target, int count, float fractional_ticks, real_matrix4x3* out_matrices)
+{
+	int padded_count = matrix4x3_soa_padded_count(count);
+	int full_count = count & ~(MATRIX4X3_SOA_LANE_COUNT - 1);
+
+	for (int i = 0; i < full_count; i += MATRIX4X3_SOA_LANE_COUNT)
+		matrix4x3_interpolate4(&previous_cache[i], padded_count, &target[i], fractional_ticks, &out_matrices[i]);
+
+	if (full_count < count)
+	{
+		real_matrix4x3 tail[MATRIX4X3_SOA_LANE_COUNT];
+		real_matrix4x3 tail_out[MATRIX4X3_SOA_LANE_COUNT];
+		for (int i = 0; i < MATRIX4X3_SOA_LANE_COUNT; i++)
+			tail[i] = target[(std::min)(full_count + i, count - 1)];
+
+		matrix4x3_interpolate4(&previous_cache[full_count], padded_count, tail, fractional_ticks, tail_out);
+
+		for (int i = full_count; i < count; i++)
+			out_matrices[i] = tail_out[i - full_count];
+	}
+}
+#pragma endregion
@@ -2,4 +2,39 @@
 
 #include "real_math.h"
 
-void matrix4x3_interpolate(const real_matrix4x3* previous, const real_matrix4x3* target, float fractional_ticks, real_matrix4x3* out_mat);
\ No newline at end of file
+void matrix4x3_interpolate(const real_matrix4x3* previous, const real_matrix4x3* target, float fractional_ticks, real_matrix4x3* out_mat);
+
+// structure of arrays interpolation state, so 4 matrices are interpolated at once with SSE
+// the cache holds k_matrix4x3_soa_field_count arrays of matrix4x3_soa_padded_count(count) floats, one after the other
+enum e_matrix4x3_soa_field
+{
+	_matrix4x3_soa_quaternion_i,
+	_matrix4x3_soa_quaternion_j,
+	_matrix4x3_soa_quaternion_k,
+	_matrix4x3_soa_quaternion_w,
+	_matrix4x3_soa_scale,
+	_matrix4x3_soa_position_x,
+	_matrix4x3_soa_position_y,
+	_matrix4x3_soa_position_z,
+
+	k_matrix4x3_soa_field_count
+};
+
+#define MATRIX4X3_SOA_LANE_COUNT 4
+
+inline int matrix4x3_soa_padded_count(int count)
+{
+	return (count + MATRIX4X3_SOA_LANE_COUNT - 1) & ~(MATRIX4X3_SOA_LANE_COUNT - 1);
+}
+
+// floats needed to cache count matrices
+inline int matrix4x3_soa_cache_size(int count)
+{
+	return matrix4x3_soa_padded_count(count) * k_matrix4x3_soa_field_count;
+}
+
+// converts the matrices to the cache, the rotations are stored as quaternions
+void matrix4x3_to_soa_cache(const real_matrix4x3* matrices, int count, float* out_cache);
+// same as calling matrix4x3_interpolate for each matrix, with the previous matrices converted by matrix4x3_to_soa_cache
+// the rotation is interpolated natively instead of going through the game's quaternion functions
+void matrix4x3_interpolate_soa(const float* previous_cache, const real_matrix4x3* target, int count, float fractional_ticks, real_matrix4x3* out_matrices);
@@ -25,6 +25,7 @@
 #include "H2MOD/Modules/MainMenu/MapSlots.h"
 #include "H2MOD/Modules/MainMenu/Ranks.h"
 #include "H2MOD/Modules/MapManager/MapManager.h"
+#include "H2MOD/Modules/Networking/NetworkTelemetry/NetworkTelemetry.h"
 #include "H2MOD/Modules/ObserverMode/ObserverMode.h"
 #include "H2MOD/Modules/OnScreenDebug/OnscreenDebug.h"
 #include "H2MOD/Modules/PlayerRepresentation/PlayerRepresentation.h"
@@ -969,7 +970,7 @@ void H2MOD::RegisterEvents()
 		// Server only callbacks
 		// Setup Events for H2Config_vip_lock
 		if (H2Config_vip_lock)
-			EventHandler::register_callback(vip_lock, EventType::gamelifecycle_change, EventExecutionType::execute_after);
+			EventHandler::register_callback<EventType::gamelifecycle_change>(vip_lock, EventExecutionType::execute_after);
 	}
 	else 
 	{
@@ -1146,6 +1147,7 @@ void H2MOD::Initialize()
 
 	Engine::Objects::apply_biped_object_definition_patches();
 	StatsHandler::Initialize();
+	NetworkTelemetry::Initialize();
 
 	LOG_INFO_GAME("H2MOD - Initialized");
 }
@@ -8,6 +8,7 @@
 #include "H2MOD/Modules/Shell/Config.h"
 #include "H2MOD/Modules/MainLoopPatches/MainGameTime/MainGameTime.h"
 #include "H2MOD/Modules/MapManager/MapManager.h"
+#include "H2MOD/Modules/Networking/NetworkTelemetry/NetworkTelemetry.h"
 #include "H2MOD/Modules/Tweaks/Tweaks.h"
 #include "H2MOD/Tags/MetaLoader/tag_loader.h"
 #include "H2MOD/Utils/Utils.h"
@@ -54,6 +55,7 @@ std::vector<ConsoleCommand*> CommandCollection::commandTable = {
 	new ConsoleCommand("deleteobject", "deletes an object, 1 parameter(s): <int>: object datum index", 1, 1, CommandCollection::DestroyObjectCmd),
 	new ConsoleCommand("warpfix", "(EXPERIMENTAL) increases client position update control threshold", 1, 1, CommandCollection::WarpFixCmd, CommandFlags_::CommandFlag_Hidden),
 	new ConsoleCommand("logxnetconnections", "logs the xnet connections for debugging purposes, 0 parameter(s)", 0, 0, CommandCollection::LogXNetConnectionsCmd, CommandFlags_::CommandFlag_Hidden),
+	new ConsoleCommand("nettelemetry", "logs the network message counters and request latency, 0 - 1 parameter(s): <int>(optional): snapshot file interval in seconds, 0 disables it", 0, 1, CommandCollection::NetworkTelemetryCmd),
 	new ConsoleCommand("spawn", "spawn an object from the list, 4 - 10 parameter(s): "
 		"<string>: object name <int>: count <bool>: same team, near player <float3>: (only if near player false) position xyz, rotation (optional) ijk", 4, 10, CommandCollection::SpawnCmd),
 	new ConsoleCommand("spawnreloadcommandlist", "reload object ids for spawn command from file, 0 parameter(s)", 0, 0, CommandCollection::ReloadSpawnCommandListCmd),
@@ -178,6 +180,35 @@ int CommandCollection::LogXNetConnectionsCmd(const std::vector<std::string>& tok
 	return 0;
 }
 
+int CommandCollection::NetworkTelemetryCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData)
+{
+	ConsoleLog* output = cbData.strOutput;
+
+	if (tokens.size() > 1)
+	{
+		ComVar<int> interval;
+		std::string exception;
+		if (!interval.SetValFromStr(tokens[1], 10, exception))
+		{
+			output->Output(StringFlag_None, command_error_bad_arg);
+			output->Output(StringFlag_None, "	%s", exception.c_str());
+			return 0;
+		}
+		else if (interval.GetVal() < 0)
+		{
+			output->Output(StringFlag_None, "# the interval can't be negative");
+			return 0;
+		}
+
+		NetworkTelemetry::SetSnapshotInterval(interval.GetVal());
+		output->Output(StringFlag_None, interval.GetVal() > 0 ? "# network telemetry snapshot interval set: %i second(s)" : "# network telemetry snapshot disabled", interval.GetVal());
+		return 0;
+	}
+
+	NetworkTelemetry::LogToConsole(output);
+	return 0;
+}
+
 int CommandCollection::LogSelectedMapFilenameCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData)
 {
 	ConsoleLog* output = (ConsoleLog*)cbData.strOutput;
@@ -25,6 +25,7 @@ namespace CommandCollection
 	int IsSessionHostCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData);
 	int DownloadMapCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData);
 	int LogXNetConnectionsCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData);
+	int NetworkTelemetryCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData);
 	int LogSelectedMapFilenameCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData);
 	int RequestFileNameCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData);
 	int ReloadMapsCmd(const std::vector<std::string>& tokens, ConsoleCommandCtxData cbData);
@@ -44,7 +44,7 @@ namespace ImGuiHandler
 				curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 				curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
 				curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-				res = curl_easy_perform(curl);
+				res = curl_interface_perform(curl);
 				if (res == CURLcode::CURLE_OK)
 				{
 					fseek(fp, 0, SEEK_END);
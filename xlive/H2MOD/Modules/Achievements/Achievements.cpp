@@ -20,8 +20,6 @@ void AchievementUnlock(unsigned long long xuid, int achievement_id, XOVERLAPPED*
 	LOG_TRACE_GAME("[H2Mod-Achievement] - Unlocking achievement ID: {:d}", achievement_id);
 
 	CURL *curl;
-	CURLcode res;
-	std::string readBuffer;
 
 
 	curl = curl_interface_init_no_verify();
@@ -42,15 +40,17 @@ void AchievementUnlock(unsigned long long xuid, int achievement_id, XOVERLAPPED*
 		document.Accept(writer);
 
 		std::string url(cartographerURL + "/achievement-api/unlock.php");
+		auto readBuffer = std::make_shared<std::string>();
 
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, readBuffer.get());
 		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, buffer.GetString());
-		res = curl_easy_perform(curl);
-		curl_easy_cleanup(curl);
+		curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, buffer.GetString());
 
+		// sent by the http executor, the handle is cleaned up once it's done
+		if (curl_interface_perform_async(curl, [readBuffer](CURL* curl, CURLcode res) {}) == -1)
+			curl_easy_cleanup(curl);
 	}
 }
 
@@ -68,7 +68,7 @@ void GetAchievements(unsigned long long xuid)
 		curl_easy_setopt(curl, CURLOPT_URL, server_url.c_str());
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-		res = curl_easy_perform(curl);
+		res = curl_interface_perform(curl);
 		curl_easy_cleanup(curl);
 
 		rapidjson::Document document;
@@ -2,12 +2,15 @@
 
 #include "CustomLanguage.h"
 #include "H2MOD/Modules/Shell/Config.h"
+#include "H2MOD/Modules/EventHandler/EventHandler.hpp"
 #include "H2MOD/Modules/OnScreenDebug/OnscreenDebug.h"
 #include "H2MOD/Modules/Shell/Startup/Startup.h"
 #include "H2MOD/Utils/Utils.h"
 
 #include "Util/Hooks/Hook.h"
 
+#include <atomic>
+
 #pragma region Custom Language
 
 std::vector<custom_language*> custom_languages;
@@ -21,11 +24,213 @@ custom_language* current_language = 0;
 int current_language_main = -1;
 int current_language_sub = 0;
 
+#pragma region Label table
+// every label H2GetLabel can return, flattened into one open addressing table keyed by (menu id, label id)
+// the label maps above still own the strings, the table only points into them
+// lookups don't take any lock, writers serialize on label_table_mutex and either update a slot in place
+// or build a new table and swap it in
+// lookups only happen on the game thread, so whatever got replaced is freed once a full game loop tick went by without it
+enum e_label_precedence
+{
+	_label_precedence_cartographer = 1,
+	_label_precedence_custom_language,
+	_label_precedence_cartographer_dynamic
+};
+
+#define LABEL_TABLE_MIN_CAPACITY 1024
+
+struct s_label_table_entry
+{
+	// set last, once the rest of the entry is valid
+	std::atomic<bool> used;
+	int label_menu_id;
+	int label_id;
+	std::atomic<char*> label;
+	std::atomic<int> precedence;
+};
+
+struct s_label_table
+{
+	size_t mask;
+	size_t count;
+	s_label_table_entry* entries;
+};
+
+static std::mutex label_table_mutex;
+static std::atomic<s_label_table*> label_table = nullptr;
+
+void delete_custom_language(custom_language* custom_lang);
+
+// replaced tables, label strings and languages a lookup might still be reading
+struct s_label_garbage
+{
+	std::vector<s_label_table*> tables;
+	std::vector<char*> strings;
+	std::vector<custom_language*> languages;
+};
+
+// retired during the current tick, and during the previous one
+// guarded by label_table_mutex
+static s_label_garbage label_garbage_current;
+static s_label_garbage label_garbage_previous;
+
+// labels the game had to provide while capture was enabled, copied into the current language by write_custom_labels
+static std::mutex captured_labels_mutex;
+static std::vector<std::tuple<int, int, std::string>> captured_labels;
+static std::unordered_set<unsigned long long> captured_label_keys;
+
+static size_t label_table_hash(int label_menu_id, int label_id) {
+	unsigned int hash = (unsigned int)label_menu_id * 0x9E3779B1 + (unsigned int)label_id;
+	hash ^= hash >> 15;
+	hash *= 0x85EBCA6B;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+static s_label_table_entry* label_table_find(const s_label_table* table, int label_menu_id, int label_id) {
+	// the table is never more than half full, so there always is an empty slot to stop at
+	for (size_t i = label_table_hash(label_menu_id, label_id) & table->mask; ; i = (i + 1) & table->mask) {
+		s_label_table_entry* entry = &table->entries[i];
+		if (!entry->used.load(std::memory_order_acquire))
+			return entry;
+		if (entry->label_menu_id == label_menu_id && entry->label_id == label_id)
+			return entry;
+	}
+}
+
+// returns false if the table has to grow first
+static bool label_table_insert(s_label_table* table, int label_menu_id, int label_id, char* label, int precedence) {
+	s_label_table_entry* entry = label_table_find(table, label_menu_id, label_id);
+	if (entry->used.load(std::memory_order_relaxed)) {
+		// lower precedence labels stay hidden behind the current one
+		if (precedence >= entry->precedence.load(std::memory_order_relaxed)) {
+			entry->precedence.store(precedence, std::memory_order_relaxed);
+			entry->label.store(label, std::memory_order_release);
+		}
+		return true;
+	}
+
+	if ((table->count + 1) * 2 > table->mask + 1)
+		return false;
+
+	entry->label_menu_id = label_menu_id;
+	entry->label_id = label_id;
+	entry->label.store(label, std::memory_order_relaxed);
+	entry->precedence.store(precedence, std::memory_order_relaxed);
+	entry->used.store(true, std::memory_order_release);
+	table->count++;
+	return true;
+}
+
+static void label_table_insert_map(s_label_table* table, std::unordered_map<int, std::unordered_map<int, char*>>& label_map, int precedence) {
+	for (auto const &ent1 : label_map) {
+		for (auto const &ent2 : ent1.second) {
+			label_table_insert(table, ent1.first, ent2.first, ent2.second, precedence);
+		}
+	}
+}
+
+static size_t label_map_count(std::unordered_map<int, std::unordered_map<int, char*>>& label_map) {
+	size_t count = 0;
+	for (auto const &ent1 : label_map)
+		count += ent1.second.size();
+	return count;
+}
+
+// resolves every label in precedence order into a new table and swaps it in
+// must be called with label_table_mutex held
+static void label_table_rebuild() {
+	size_t label_count = label_map_count(cartographer_label_map) + label_map_count(cartographer_label_map_dyn);
+	if (current_language)
+		label_count += label_map_count(*current_language->label_map);
+
+	// keep the load under a quarter after a rebuild, so adding labels rarely has to rebuild again
+	size_t capacity = LABEL_TABLE_MIN_CAPACITY;
+	while (capacity < label_count * 4)
+		capacity *= 2;
+
+	s_label_table* table = new s_label_table;
+	table->mask = capacity - 1;
+	table->count = 0;
+	table->entries = new s_label_table_entry[capacity];
+	for (size_t i = 0; i < capacity; i++)
+		table->entries[i].used.store(false, std::memory_order_relaxed);
+
+	label_table_insert_map(table, cartographer_label_map, _label_precedence_cartographer);
+	if (current_language)
+		label_table_insert_map(table, *current_language->label_map, _label_precedence_custom_language);
+	label_table_insert_map(table, cartographer_label_map_dyn, _label_precedence_cartographer_dynamic);
+
+	s_label_table* previous_table = label_table.exchange(table, std::memory_order_acq_rel);
+	if (previous_table)
+		label_garbage_current.tables.push_back(previous_table);
+}
+
+// must be called with label_table_mutex held
+static void label_table_update(int label_menu_id, int label_id, char* label, int precedence) {
+	s_label_table* table = label_table.load(std::memory_order_relaxed);
+	// a rebuild picks up the new label from the label maps
+	if (!table || !label_table_insert(table, label_menu_id, label_id, label, precedence))
+		label_table_rebuild();
+}
+
+// call it after the replacement was published
+// must be called with label_table_mutex held
+static void label_string_retire(char* label) {
+	if (label)
+		label_garbage_current.strings.push_back(label);
+}
+
+static void label_garbage_free(s_label_garbage& garbage) {
+	for (s_label_table* table : garbage.tables) {
+		delete[] table->entries;
+		delete table;
+	}
+	for (char* label : garbage.strings)
+		free(label);
+	for (custom_language* language : garbage.languages)
+		delete_custom_language(language);
+
+	garbage.tables.clear();
+	garbage.strings.clear();
+	garbage.languages.clear();
+}
+
+// game thread, between two ticks no lookup is in flight
+// what got retired during the previous tick can't be referenced anymore, the game had the whole current tick to drop it
+static void label_garbage_collect() {
+	s_label_garbage expired;
+	{
+		std::lock_guard lg(label_table_mutex);
+		std::swap(expired, label_garbage_previous);
+		std::swap(label_garbage_previous, label_garbage_current);
+	}
+	label_garbage_free(expired);
+}
+
+static const s_label_table_entry* label_table_lookup(int label_menu_id, int label_id) {
+	const s_label_table* table = label_table.load(std::memory_order_acquire);
+	if (!table)
+		return nullptr;
+	const s_label_table_entry* entry = label_table_find(table, label_menu_id, label_id);
+	return entry->used.load(std::memory_order_acquire) ? entry : nullptr;
+}
+
+static void capture_missing_label(int label_menu_id, int label_id, const char* label) {
+	unsigned long long key = ((unsigned long long)(unsigned int)label_menu_id << 32) | (unsigned int)label_id;
+	std::lock_guard lg(captured_labels_mutex);
+	if (captured_label_keys.insert(key).second)
+		captured_labels.emplace_back(label_menu_id, label_id, label);
+}
+#pragma endregion
+
 #pragma region File I/O
 
-char* add_label(std::unordered_map<int, std::unordered_map<int, char*>>& label_map, int label_menu_id, int label_id, const char* label) {
+// replaced_label receives the string the new one replaces, it's up to the caller to retire it once the new one is published
+char* add_label(std::unordered_map<int, std::unordered_map<int, char*>>& label_map, int label_menu_id, int label_id, const char* label, char** replaced_label) {
+	*replaced_label = nullptr;
 	if (label_map.count(label_menu_id) && label_map[label_menu_id].count(label_id))
-		free(label_map[label_menu_id][label_id]);
+		*replaced_label = label_map[label_menu_id][label_id];
 	int label_buflen = (label ? strlen(label) : 0) + 1;
 	char* new_label = (char*)calloc(label_buflen, sizeof(char));
 	if (label)
@@ -34,20 +239,23 @@ char* add_label(std::unordered_map<int, std::unordered_map<int, char*>>& label_m
 	return label_map[label_menu_id][label_id] = new_label;
 }
 
-char* add_label(std::unordered_map<int, std::unordered_map<int, char*>>& label_map, int label_menu_id, int label_id, int labelBufferLen) {
+char* add_label(std::unordered_map<int, std::unordered_map<int, char*>>& label_map, int label_menu_id, int label_id, int labelBufferLen, char** replaced_label) {
+	*replaced_label = nullptr;
 	if (label_map.count(label_menu_id) && label_map[label_menu_id].count(label_id))
-		free(label_map[label_menu_id][label_id]);
+		*replaced_label = label_map[label_menu_id][label_id];
 	char* new_label = (char*)calloc(labelBufferLen, sizeof(char));
 	return label_map[label_menu_id][label_id] = new_label;
 }
 
 char* add_cartographer_label(int label_menu_id, int label_id, const char* label, bool is_dynamic) {
-	if (is_dynamic) {
-		return add_label(cartographer_label_map_dyn, label_menu_id, label_id, label);
-	}
-	if (!label)
+	if (!is_dynamic && !label)
 		return 0;
-	return add_label(cartographer_label_map, label_menu_id, label_id, label);
+	std::lock_guard lg(label_table_mutex);
+	char* replaced_label;
+	char* new_label = add_label(is_dynamic ? cartographer_label_map_dyn : cartographer_label_map, label_menu_id, label_id, label, &replaced_label);
+	label_table_update(label_menu_id, label_id, new_label, is_dynamic ? _label_precedence_cartographer_dynamic : _label_precedence_cartographer);
+	label_string_retire(replaced_label);
+	return new_label;
 }
 
 char* add_cartographer_label(int label_menu_id, int label_id, const char* label) {
@@ -55,46 +263,50 @@ char* add_cartographer_label(int label_menu_id, int label_id, const char* label)
 }
 
 char* add_cartographer_label(int label_menu_id, int label_id, int labelBufferLen, bool is_dynamic) {
-	if (is_dynamic) {
-		return add_label(cartographer_label_map_dyn, label_menu_id, label_id, labelBufferLen);
-	}
-	return add_label(cartographer_label_map, label_menu_id, label_id, labelBufferLen);
+	std::lock_guard lg(label_table_mutex);
+	char* replaced_label;
+	char* new_label = add_label(is_dynamic ? cartographer_label_map_dyn : cartographer_label_map, label_menu_id, label_id, labelBufferLen, &replaced_label);
+	label_table_update(label_menu_id, label_id, new_label, is_dynamic ? _label_precedence_cartographer_dynamic : _label_precedence_cartographer);
+	label_string_retire(replaced_label);
+	return new_label;
 }
 
 char* add_cartographer_label(int label_menu_id, int label_id, int labelBufferLen) {
 	return add_cartographer_label(label_menu_id, label_id, labelBufferLen, false);
 }
 
-char* get_cartographer_label(int label_menu_id, int label_id, __int8 is_dynamic) {
-	if (is_dynamic & 0b10) {
-		std::unordered_map<int, std::unordered_map<int, char*>> &label_map = cartographer_label_map_dyn;
-		if (label_map.count(label_menu_id) && label_map[label_menu_id].count(label_id))
-			return label_map[label_menu_id][label_id];
-	}
-	if (is_dynamic & 0b01) {
-		std::unordered_map<int, std::unordered_map<int, char*>> &label_map = cartographer_label_map;
-		if (label_map.count(label_menu_id) && label_map[label_menu_id].count(label_id))
-			return label_map[label_menu_id][label_id];
-	}
-	return 0;
+char* add_custom_label(custom_language* language, int label_menu_id, int label_id, const char* label) {
+	custom_labels_updated = true;
+	std::lock_guard lg(label_table_mutex);
+	char* replaced_label;
+	char* new_label = add_label(*language->label_map, label_menu_id, label_id, label, &replaced_label);
+	// the other languages only make it into the table when they get selected
+	if (language == current_language)
+		label_table_update(label_menu_id, label_id, new_label, _label_precedence_custom_language);
+	label_string_retire(replaced_label);
+	return new_label;
 }
 
-char* get_cartographer_label(int label_menu_id, int label_id) {
-	return get_cartographer_label(label_menu_id, label_id, 0b11);
+static bool custom_label_exists(custom_language* language, int label_menu_id, int label_id) {
+	auto labels = language->label_map->find(label_menu_id);
+	return labels != language->label_map->end() && labels->second.count(label_id) != 0;
 }
 
-char* add_custom_label(custom_language* language, int label_menu_id, int label_id, const char* label) {
-	custom_labels_updated = true;
-	return add_label(*language->label_map, label_menu_id, label_id, label);
-}
+// moves the captured labels into the current language
+static void flush_captured_labels() {
+	std::vector<std::tuple<int, int, std::string>> labels;
+	{
+		std::lock_guard lg(captured_labels_mutex);
+		labels.swap(captured_labels);
+	}
 
-char* get_custom_label(custom_language* language, int label_menu_id, int label_id, const char* label) {
-	std::unordered_map<int, std::unordered_map<int, char*>> &label_map = *language->label_map;
-	if (label_map.count(label_menu_id) && label_map[label_menu_id].count(label_id))
-		return label_map[label_menu_id][label_id];
-	if (label == 0)
-		return 0;
-	return add_custom_label(language, label_menu_id, label_id, label);
+	if (!current_language)
+		return;
+
+	for (auto const &captured : labels) {
+		if (!custom_label_exists(current_language, std::get<0>(captured), std::get<1>(captured)))
+			add_custom_label(current_language, std::get<0>(captured), std::get<1>(captured), std::get<2>(captured).c_str());
+	}
 }
 
 custom_language* get_custom_language(int lang_base, int lang_variant) {
@@ -376,6 +588,7 @@ bool reloadCustomLanguages() {
 }
 
 void write_custom_labels() {
+	flush_captured_labels();
 	if (custom_labels_updated) {
 		bool prev_capture = H2Config_custom_labels_capture_missing;
 		H2Config_custom_labels_capture_missing = false;
@@ -432,29 +645,31 @@ H2GetLabel_t pH2GetLabel;
 char* __stdcall H2GetLabel(int a1, int label_id, int a3, int a4) { //sub_3defd
 	//int label_menu_id = *(int*)(*(int*)a1 + 8 * a3 + 4);
 	int label_menu_id = a3;
-	char* label = get_cartographer_label(label_menu_id, label_id, 0b10);
-	if (label)
-		return label;
-	label = get_custom_label(current_language, label_menu_id, label_id, 0);
-	if (label)
+	// dynamic cartographer labels, then the current language, then the static cartographer labels
+	const s_label_table_entry* entry = label_table_lookup(label_menu_id, label_id);
+	char* label = 0;
+	int precedence = 0;
+	if (entry) {
+		label = entry->label.load(std::memory_order_acquire);
+		precedence = entry->precedence.load(std::memory_order_relaxed);
+	}
+	if (precedence >= _label_precedence_custom_language)
 		return label;
-	label = get_cartographer_label(label_menu_id, label_id, 0b01);
 	if (!label && a1)
 		label = pH2GetLabel(a1, label_id, a3, a4);
 	//if (strcmp(label, "PROFILE NAME") == 0) {
 	//	return label;//in order to breakpoint and get label_id's.
 	//}
-	if (!H2Config_custom_labels_capture_missing) {
-		return label;
-	}
-	return get_custom_label(current_language, label_menu_id, label_id, label);
+	// don't touch the language from the render path, write_custom_labels picks these up
+	if (H2Config_custom_labels_capture_missing && label)
+		capture_missing_label(label_menu_id, label_id, label);
+	return label;
 }
 
 char* H2ServerGetLabel(int label_menu_id, int label_id) {
-	char* label = get_cartographer_label(label_menu_id, label_id, 0b10);
-	if (label)
-		return label;
-	return get_cartographer_label(label_menu_id, label_id, 0b01);
+	// there is no custom language on the server, so the table only holds cartographer labels
+	const s_label_table_entry* entry = label_table_lookup(label_menu_id, label_id);
+	return entry ? entry->label.load(std::memory_order_acquire) : 0;
 }
 
 char* H2CustomLanguageGetLabel(int label_menu_id, int label_id) {
@@ -567,6 +782,12 @@ __declspec(naked) char* nak_c00031b97()
 
 void setCustomLanguage(int main, int variant) {
 	H2Config_custom_labels_capture_missing = false;
+	// the captured labels belong to the language being replaced
+	flush_captured_labels();
+	{
+		std::lock_guard lg(captured_labels_mutex);
+		captured_label_keys.clear();
+	}
 
 	if (main >= 0 && main <= 7)
 		current_language_main = main;
@@ -585,8 +806,12 @@ void setCustomLanguage(int main, int variant) {
 
 	custom_language* old_language = current_language;
 	int language_id = *(int*)((char*)H2BaseAddr + 0x412818);
-	if ((current_language = get_custom_language(language_id, variant)) == 0)
-		current_language = get_custom_language(language_id, 0);
+	{
+		std::lock_guard lg(label_table_mutex);
+		if ((current_language = get_custom_language(language_id, variant)) == 0)
+			current_language = get_custom_language(language_id, 0);
+		label_table_rebuild();
+	}
 	current_language_sub = current_language->lang_variant;
 
 	addDebugText("language_code = %dx%d", current_language_main, current_language_sub);
@@ -598,7 +823,9 @@ void setCustomLanguage(int main, int variant) {
 		sub_31dff();
 	}
 	if (current_language_isGarbage) {
-		delete_custom_language(old_language);
+		// the retired table still points into its labels
+		std::lock_guard lg(label_table_mutex);
+		label_garbage_current.languages.push_back(old_language);
 		current_language_isGarbage = false;
 	}
 }
@@ -680,6 +907,9 @@ static void overrideCoreH2Labels() {
 } 
 
 void InitCustomLanguage() {
+	// the server has the cartographer labels in the table as well
+	EventHandler::register_callback<EventType::game_loop>(label_garbage_collect, EventExecutionType::execute_after);
+
 	if (!H2IsDediServer) {
 		setGameLanguage();
 
@@ -705,4 +935,10 @@ void DeinitCustomLanguage() {
 	if (!H2IsDediServer) {
 		write_custom_labels();
 	}
+
+	// the run loop is gone by now, nothing can look up labels anymore
+	EventHandler::remove_callback<EventType::game_loop>(label_garbage_collect, EventExecutionType::execute_after);
+	std::lock_guard lg(label_table_mutex);
+	label_garbage_free(label_garbage_previous);
+	label_garbage_free(label_garbage_current);
 }
@@ -247,10 +247,10 @@ namespace CustomVariantSettings
 	{
 		ApplyHooks();
 		
-		EventHandler::register_callback(OnGameLifeCycleUpdate, EventType::gamelifecycle_change);
-		EventHandler::register_callback(OnMatchCountdown, EventType::countdown_start, EventExecutionType::execute_after);
-		EventHandler::register_callback(OnNetworkPlayerEvent, EventType::network_player, EventExecutionType::execute_after);
-		EventHandler::register_callback(ApplyCurrentSettings, EventType::blue_screen, EventExecutionType::execute_after);
-		EventHandler::register_callback(OnPlayerSpawn, EventType::player_spawn, EventExecutionType::execute_after);
+		EventHandler::register_callback<EventType::gamelifecycle_change>(OnGameLifeCycleUpdate);
+		EventHandler::register_callback<EventType::countdown_start>(OnMatchCountdown, EventExecutionType::execute_after);
+		EventHandler::register_callback<EventType::network_player>(OnNetworkPlayerEvent, EventExecutionType::execute_after);
+		EventHandler::register_callback<EventType::blue_screen>(ApplyCurrentSettings, EventExecutionType::execute_after);
+		EventHandler::register_callback<EventType::player_spawn>(OnPlayerSpawn, EventExecutionType::execute_after);
 	}
 }
\ No newline at end of file
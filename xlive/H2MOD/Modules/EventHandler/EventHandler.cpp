@@ -2,16 +2,4 @@
 
 #include "EventHandler.hpp"
 
-std::map<EventType, std::vector<EventCallback>> event_map =
-{
-	{ EventType::network_player,	{} },
-	{ EventType::gamelifecycle_change,	{} },
-	{ EventType::game_loop,			{} },
-	{ EventType::server_command,	{} },
-	{ EventType::map_load,			{} },
-	{ EventType::countdown_start,	{} },
-	{ EventType::player_control,	{} },
-	{ EventType::blue_screen,		{} },
-	{ EventType::player_spawn,		{} },
-	{ EventType::object_damage,		{} }
-};
\ No newline at end of file
+EventHandler::s_event_callback_table EventHandler::event_callback_table;
\ No newline at end of file
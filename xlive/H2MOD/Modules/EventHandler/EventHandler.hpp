@@ -10,6 +10,7 @@
  * Then inside EventHandler you need to create a function alias type use the current ones as an example
  *  - CountdownStartEvent
  *  - GameStateEvent
+ * add a list for it to s_event_callback_table and bind the two with REGISTER_EVENT_CALLBACK_TYPE
  *
  *  Then where ever the event needs to be triggered you can decide if you want the execution to be before or after
  *  the triggering circumstances
@@ -18,15 +19,26 @@
  *  EventHandler::PlayerControlEventExecute(EventExecutionType::execute_before, &yawChange, &pitchChange);
  *  EventHandler::PlayerControlEventExecute(EventExecutionType::execute_after, &yawChange, &pitchChange);
  *
- *  Registering a callback should only happen in a state where the game engine should not actively be firing any callbacks.
- *  I.E NOT IN GAME.
+ *  Callbacks are registered against the event type, which checks the callback signature at compile time
+ *  EventHandler::register_callback<EventType::game_loop>(onGameTick, EventExecutionType::execute_after);
+ *
+ *  Callbacks may register or remove callbacks while an event is being dispatched, the changes are picked up by the next dispatch.
+ *  The event handler is not thread safe, everything should happen on the game thread.
  */
 
-#define REGISTER_EVENT_EXECUTE_METHOD(function_name, event_type, callback_definition) \
+#define REGISTER_EVENT_EXECUTE_METHOD(function_name, event_type) \
 	template<typename ... Args> \
 	static void function_name(EventExecutionType event_execution_type, Args&& ... args) \
 	{ \
-		execute_callback<callback_definition>(event_execution_type, event_type, std::forward<Args>(args) ...); \
+		execute_callback<event_type>(event_execution_type, std::forward<Args>(args) ...); \
+	} \
+
+#define REGISTER_EVENT_CALLBACK_TYPE(event_type, callback_definition, table_member) \
+	template<> \
+	struct event_callback_traits<event_type> \
+	{ \
+		typedef callback_definition callback_t; \
+		static constexpr auto list = &s_event_callback_table::table_member; \
 	} \
 
 enum class EventType
@@ -50,25 +62,98 @@ enum class EventExecutionType
 	execute_after
 };
 
+#define k_event_execution_type_count 2
+
+template<typename T>
 class EventCallback
 {
 public:
-	void* callback;
-	EventType type;
-	EventExecutionType executionType;
+	T callback;
 	bool runOnce;
-	bool hasRun = false;
+	bool removed = false;
 
-	EventCallback(void* _callback, EventType _type, EventExecutionType _executionType = EventExecutionType::execute_after, bool _runOnce = false) :
+	EventCallback(T _callback, bool _runOnce = false) :
 		callback(_callback),
-		type(_type),
-		executionType(_executionType),
 		runOnce(_runOnce)
 	{
 	}
 };
 
-extern std::map<EventType, std::vector<EventCallback>> event_map;
+/**
+ * \brief Callbacks of a single (EventType, EventExecutionType) pair
+ * entries removed while the list is being dispatched are only flagged and get erased once the outermost dispatch returns
+ * \tparam T event alias type
+ */
+template<typename T>
+class EventCallbackList
+{
+public:
+	void add(T callback, bool run_once)
+	{
+		//Prevent duplicate events
+		remove(callback);
+		callbacks.emplace_back(callback, run_once);
+	}
+
+	void remove(T callback)
+	{
+		for (auto it = callbacks.begin(); it != callbacks.end(); ++it)
+		{
+			if (it->callback == callback && !it->removed)
+			{
+				if (dispatchDepth > 0)
+				{
+					it->removed = true;
+					pendingRemoval = true;
+				}
+				else
+				{
+					callbacks.erase(it);
+				}
+				return;
+			}
+		}
+	}
+
+	template<typename ... Args>
+	void dispatch(Args&& ... args)
+	{
+		if (callbacks.empty())
+			return;
+
+		dispatchDepth++;
+		// callbacks registered by a callback are appended past count and run from the next dispatch
+		// index instead of iterators, the vector can reallocate under us
+		size_t count = callbacks.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			EventCallback<T>& entry = callbacks[i];
+			if (entry.removed)
+				continue;
+
+			T callback = entry.callback;
+			if (entry.runOnce)
+			{
+				// flag before calling, so a nested dispatch doesn't run it again
+				entry.removed = true;
+				pendingRemoval = true;
+			}
+			callback(args ...);
+		}
+		dispatchDepth--;
+
+		if (dispatchDepth == 0 && pendingRemoval)
+		{
+			callbacks.erase(std::remove_if(callbacks.begin(), callbacks.end(), [](const EventCallback<T>& entry) { return entry.removed; }), callbacks.end());
+			pendingRemoval = false;
+		}
+	}
+
+private:
+	std::vector<EventCallback<T>> callbacks;
+	int dispatchDepth = 0;
+	bool pendingRemoval = false;
+};
 
 namespace EventHandler
 {
@@ -89,6 +174,36 @@ namespace EventHandler
 	using PlayerSpawnEventCallback = void(*)(datum PlayerDatum);
 	using ObjectDamageEventCallback = void(*)(datum PlayerDatum, datum KillerDatum);
 
+	struct s_event_callback_table
+	{
+		EventCallbackList<NetworkPlayerEventCallback> network_player[k_event_execution_type_count];
+		EventCallbackList<GameLifeCycleEventCallback> gamelifecycle_change[k_event_execution_type_count];
+		EventCallbackList<GameLoopEventCallback> game_loop[k_event_execution_type_count];
+		EventCallbackList<ServerCommandEventCallback> server_command[k_event_execution_type_count];
+		EventCallbackList<MapLoadEventCallback> map_load[k_event_execution_type_count];
+		EventCallbackList<CountdownStartEventCallback> countdown_start[k_event_execution_type_count];
+		EventCallbackList<PlayerControlEventCallback> player_control[k_event_execution_type_count];
+		EventCallbackList<BlueScreenEventCallback> blue_screen[k_event_execution_type_count];
+		EventCallbackList<PlayerSpawnEventCallback> player_spawn[k_event_execution_type_count];
+		EventCallbackList<ObjectDamageEventCallback> object_damage[k_event_execution_type_count];
+	};
+
+	extern s_event_callback_table event_callback_table;
+
+	template<EventType event_type>
+	struct event_callback_traits;
+
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::network_player, NetworkPlayerEventCallback, network_player);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::gamelifecycle_change, GameLifeCycleEventCallback, gamelifecycle_change);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::game_loop, GameLoopEventCallback, game_loop);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::server_command, ServerCommandEventCallback, server_command);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::map_load, MapLoadEventCallback, map_load);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::countdown_start, CountdownStartEventCallback, countdown_start);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::player_control, PlayerControlEventCallback, player_control);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::blue_screen, BlueScreenEventCallback, blue_screen);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::player_spawn, PlayerSpawnEventCallback, player_spawn);
+	REGISTER_EVENT_CALLBACK_TYPE(EventType::object_damage, ObjectDamageEventCallback, object_damage);
+
 	static const char* get_event_name(EventType event_type)
 	{
 		switch (event_type)
@@ -134,115 +249,68 @@ namespace EventHandler
 	}
 
 	/**
-	 * \brief Grabs the vector from the event map that relates to the corresponding event type
-	 * \param type the event type
-	 * \return std::vector<EventCallback<void*>>
+	 * \brief Grabs the callback list of the given event and execution type from the callback table
+	 * \tparam event_type the event type
+	 * \param execution_type the execution type
+	 * \return EventCallbackList of the event alias type
 	 */
-	static std::vector<EventCallback>* get_vector(EventType type)
+	template<EventType event_type>
+	static auto& get_callback_list(EventExecutionType execution_type)
 	{
-		auto event = event_map.find(type);
-		if (event == event_map.end())
-		{
-			//If the map doesn't contain a vector for the type create one
-			event_map.emplace(std::make_pair(type, std::vector<EventCallback>()));
-			return &event_map[type];
-		}
-
-		return &event->second;
+		return (event_callback_table.*event_callback_traits<event_type>::list)[(int)execution_type];
 	}
 
 	/**
 	 * \brief This function will remove a callback with the matching properties
-	 * \tparam T The type alias for the callback to be removed
+	 * \tparam event_type the event type the callback was registered to
 	 * \param callback pointer to the callback to be removed
 	 * \param execution_type the execution type of the method to be removed
 	 */
-	static void remove_callback(void* callback, EventType event_type, EventExecutionType execution_type)
+	template<EventType event_type>
+	static void remove_callback(typename event_callback_traits<event_type>::callback_t callback, EventExecutionType execution_type)
 	{
-		auto events = get_vector(event_type);
-		for (auto it = events->begin(); it != events->end(); ++it)
-		{
-			if (it->callback == callback && it->type == event_type && it->executionType == execution_type)
-			{
-				events->erase(it);
-				return;
-			}
-		}
+		get_callback_list<event_type>(execution_type).remove(callback);
 	}
 
-	/**
-	 * \brief Erases callbacks that are flagged with run once that have ran
-	 * \tparam T event alias type
-	 * \param execution_type
-	 */
-	static void cleanup_callbacks(EventType event_type, EventExecutionType execution_type)
-	{
-		std::vector<EventCallback>* events = get_vector(event_type);
-		auto it = events->begin();
-		while (it != events->end())
-		{
-			if (it->type == event_type && it->runOnce && it->hasRun && it->executionType == execution_type)
-				it = events->erase(it);
-			else
-				++it;
-		}
-	}
 	/**
 	 * \brief Registers a new callback that will execute off the given parameters
-	 * \tparam T Event Alias type
+	 * \tparam event_type the event type, the callback has to match its alias type
 	 * \param callback point to the callback
 	 * \param execution_type determines if the callback will be ran before or after the execution of the triggering function
 	 * \param run_once flags the callback to only be ran once and then erased afterwards.
 	 */
-	static void register_callback(void* callback, EventType event_type, EventExecutionType execution_type = EventExecutionType::execute_after, bool run_once = false)
+	template<EventType event_type>
+	static void register_callback(typename event_callback_traits<event_type>::callback_t callback, EventExecutionType execution_type = EventExecutionType::execute_after, bool run_once = false)
 	{
-		//Prevent duplicate events
-		remove_callback(callback, event_type, execution_type);
-
-		get_vector(event_type)->emplace_back(callback, event_type, execution_type, run_once);
+		get_callback_list<event_type>(execution_type).add(callback, run_once);
 	}
+
 	/**
 	 * \brief Executes the callbacks based off the given parameters
-	 * \tparam T The Event Alias type of callback's to execute
+	 * \tparam event_type The event type of callback's to execute
 	 * \tparam Args Do not pass anything to this template
-	 * \param execution_type
+	 * \param event_execution_type
 	 * \param args Any arguments that need to be forwarded to the callback's
 	 */
-	template<typename T, typename ... Args>
-	static void execute_callback(EventExecutionType event_execution_type, EventType event_type, Args&& ... args)
+	template<EventType event_type, typename ... Args>
+	static void execute_callback(EventExecutionType event_execution_type, Args&& ... args)
 	{
-		auto execute_callbacks_internal = [&](EventExecutionType execution_type)
-		{
-			std::vector<EventCallback>* events = get_vector(event_type);
-			for (auto it = events->begin(); it != events->end(); ++it) {
-				if (it->type == event_type && it->executionType == execution_type)
-				{
-					((T)it->callback)(std::forward<Args>(args) ...);
-					it->hasRun = true;
-				}
-			}
-			cleanup_callbacks(event_type, execution_type);
-		};
-
 		/*LOG_TRACE_GAME("{} executing callback {} at execution time of: {}", 
 			__FUNCTION__, 
 			get_event_name(event_type),
 			get_event_execution_type(event_execution_type));*/
 
-		execute_callbacks_internal(event_execution_type);
-		//When trying to debug issues in threaded callbacks switch out the two lines, helps trace call stacks
-		//execute_internal(execution_type, true);
-		//std::thread(execute_internal, execution_type, true).detach();
+		get_callback_list<event_type>(event_execution_type).dispatch(std::forward<Args>(args) ...);
 	}
 
-	REGISTER_EVENT_EXECUTE_METHOD(NetworkPlayerEventExecute, EventType::network_player, NetworkPlayerEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(GameLifeCycleEventExecute, EventType::gamelifecycle_change, GameLifeCycleEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(GameLoopEventExecute, EventType::game_loop, GameLoopEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(ServerCommandEventExecute, EventType::server_command, ServerCommandEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(MapLoadEventExecute, EventType::map_load, MapLoadEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(CountdownStartEventExecute, EventType::countdown_start, CountdownStartEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(PlayerControlEventExecute, EventType::player_control, PlayerControlEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(BlueScreenEventExecute, EventType::blue_screen, BlueScreenEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(PlayerSpawnEventExecute, EventType::player_spawn, PlayerSpawnEventCallback);
-	REGISTER_EVENT_EXECUTE_METHOD(ObjectDamageEventExecute, EventType::object_damage, ObjectDamageEventCallback);
+	REGISTER_EVENT_EXECUTE_METHOD(NetworkPlayerEventExecute, EventType::network_player);
+	REGISTER_EVENT_EXECUTE_METHOD(GameLifeCycleEventExecute, EventType::gamelifecycle_change);
+	REGISTER_EVENT_EXECUTE_METHOD(GameLoopEventExecute, EventType::game_loop);
+	REGISTER_EVENT_EXECUTE_METHOD(ServerCommandEventExecute, EventType::server_command);
+	REGISTER_EVENT_EXECUTE_METHOD(MapLoadEventExecute, EventType::map_load);
+	REGISTER_EVENT_EXECUTE_METHOD(CountdownStartEventExecute, EventType::countdown_start);
+	REGISTER_EVENT_EXECUTE_METHOD(PlayerControlEventExecute, EventType::player_control);
+	REGISTER_EVENT_EXECUTE_METHOD(BlueScreenEventExecute, EventType::blue_screen);
+	REGISTER_EVENT_EXECUTE_METHOD(PlayerSpawnEventExecute, EventType::player_spawn);
+	REGISTER_EVENT_EXECUTE_METHOD(ObjectDamageEventExecute, EventType::object_damage);
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include "Blam/Math/BlamMath.h"
 
 #include "H2MOD/GUI/imgui_integration/Console/ImGui_ConsoleImpl.h"
+#include "H2MOD/Modules/EventHandler/EventHandler.hpp"
 #include "Util/Hooks/Hook.h"
 
 
@@ -26,16 +27,58 @@ namespace ObjectInterpolate
 			datum object_idx = DATUM_INDEX_NONE;
 			int node_count;
 			real_matrix4x3* node_ptr;
-			real_matrix4x3 interpolated_nodes[OBJECT_MAX_NODES];
-			real_matrix4x3 previous_node_position[OBJECT_MAX_NODES];
+			// offset of the object's block in node_pool, NONE if it doesn't have one
+			// the block holds the previous tick's nodes as a matrix4x3_to_soa_cache cache, followed by the interpolated nodes
+			int node_pool_offset = NONE;
 			// TODO add unique id's to identify objects
 		} object_states[OBJECT_GAME_STATE_MAX_COUNT];
 
-		bool SameObject(datum object_idx)
+		// node storage for all objects, each block is sized from the object's node count
+		// blocks are addressed by offset, so growing the pool doesn't invalidate them
+		std::vector<float> node_pool;
+		// blocks freed by objects that went away, by node count, reused by the next object with the same count
+		std::vector<int> node_pool_free_blocks[OBJECT_MAX_NODES + 1];
+
+		int NodePoolBlockSize(int node_count)
+		{
+			return matrix4x3_soa_cache_size(node_count) + node_count * (sizeof(real_matrix4x3) / sizeof(float));
+		}
+
+		int NodePoolAllocate(int node_count)
+		{
+			if (node_count <= OBJECT_MAX_NODES && !node_pool_free_blocks[node_count].empty())
+			{
+				int offset = node_pool_free_blocks[node_count].back();
+				node_pool_free_blocks[node_count].pop_back();
+				return offset;
+			}
+
+			int offset = node_pool.size();
+			node_pool.resize(node_pool.size() + NodePoolBlockSize(node_count));
+			return offset;
+		}
+
+		void NodePoolFree(int offset, int node_count)
+		{
+			// blocks too large for the free lists are reclaimed with the rest of the pool on Reset
+			if (node_count <= OBJECT_MAX_NODES)
+				node_pool_free_blocks[node_count].push_back(offset);
+		}
+
+		float* GetPreviousNodeCache(const s_object_interpolation* object_state)
+		{
+			return node_pool.data() + object_state->node_pool_offset;
+		}
+
+		real_matrix4x3* GetInterpolatedNodes(const s_object_interpolation* object_state)
+		{
+			return (real_matrix4x3*)(node_pool.data() + object_state->node_pool_offset + matrix4x3_soa_cache_size(object_state->node_count));
+		}
+
+		// the datum's salt tells apart objects that reused the same slot
+		bool SameObject(datum object_idx, int object_node_count, real_matrix4x3* object_nodes)
 		{
-			int object_node_count;
 			s_object_interpolation* object_state = &object_states[DATUM_INDEX_TO_ABSOLUTE_INDEX(object_idx)];
-			real_matrix4x3* object_nodes = get_object_nodes(object_idx, &object_node_count);
 			bool ret = object_state->valid 
 				&& object_state->object_idx == object_idx 
 				&& object_state->node_count == object_node_count
@@ -44,6 +87,13 @@ namespace ObjectInterpolate
 			return ret;
 		}
 
+		bool SameObject(datum object_idx)
+		{
+			int object_node_count;
+			real_matrix4x3* object_nodes = get_object_nodes(object_idx, &object_node_count);
+			return SameObject(object_idx, object_node_count, object_nodes);
+		}
+
 		bool initialized = false;
 		int object_count;
 		datum object_last_datum_idx;
@@ -66,9 +116,11 @@ namespace ObjectInterpolate
 		while (object_it.get_next_datum())
 		{
 			s_object_interpolation* object_state = &object_states[object_it.get_current_absolute_index()];
-			s_object_data_definition* object_data = object_get_fast_unsafe(object_it.get_current_datum_index());
 
-			if (!SameObject(object_it.get_current_datum_index()))
+			int object_node_count;
+			real_matrix4x3* object_nodes = get_object_nodes(object_it.get_current_datum_index(), &object_node_count);
+
+			if (!SameObject(object_it.get_current_datum_index(), object_node_count, object_nodes))
 			{
 				ResetObject(object_it.get_current_datum_index());
 			}
@@ -77,17 +129,14 @@ namespace ObjectInterpolate
 			{
 				object_count++;
 				object_state->valid = true;
+				object_state->node_pool_offset = NodePoolAllocate(object_node_count);
 			}
 
-			int object_node_count;
-			real_matrix4x3* object_nodes = get_object_nodes(object_it.get_current_datum_index(), &object_node_count);
-			/*if (object_node_count > OBJECT_MAX_NODES)
-				DBGBREAK();*/
-
-			memcpy(object_state->previous_node_position, object_nodes, sizeof(real_matrix4x3) * object_node_count);
 			object_state->object_idx = object_it.get_current_datum_index();
 			object_state->node_count = object_node_count;
 			object_state->node_ptr = object_nodes;
+			// converted once per tick, the render frames until the next tick only convert the current nodes
+			matrix4x3_to_soa_cache(object_nodes, object_node_count, GetPreviousNodeCache(object_state));
 		}
 	}
 
@@ -102,9 +151,6 @@ namespace ObjectInterpolate
 
 		while (object_it.get_next_datum())
 		{
-			s_object_interpolation* object_state = &object_states[object_it.get_current_absolute_index()];
-			s_object_data_definition* object_data = object_get_fast_unsafe(object_it.get_current_datum_index());
-
 			// TODO FIXME add unique object ID to SameObject validation
 			if (!SameObject(object_it.get_current_datum_index()))
 			{
@@ -120,8 +166,8 @@ namespace ObjectInterpolate
 		if (!object_state->valid)
 			return;
 		object_state->object_idx = DATUM_INDEX_NONE;
-		memset(object_state->previous_node_position, 0, sizeof(real_matrix4x3) * object_state->node_count);
-		memset(object_state->interpolated_nodes, 0, sizeof(real_matrix4x3) * object_state->node_count);
+		NodePoolFree(object_state->node_pool_offset, object_state->node_count);
+		object_state->node_pool_offset = NONE;
 		object_state->node_count = 0;
 		object_state->node_ptr = NULL;
 		object_state->valid = false;
@@ -148,12 +194,12 @@ namespace ObjectInterpolate
 		
 		int node_count;
 		real_matrix4x3* current_object_nodes = get_object_nodes(object_idx, &node_count);
+		real_matrix4x3* interpolated_nodes = GetInterpolatedNodes(object_state);
 
-		for (int i = 0; i < object_state->node_count; i++)
-			matrix4x3_interpolate(&object_state->previous_node_position[i], &current_object_nodes[i], Interpolation::GetInterpolateTime(), &object_state->interpolated_nodes[i]);
+		matrix4x3_interpolate_soa(GetPreviousNodeCache(object_state), current_object_nodes, object_state->node_count, Interpolation::GetInterpolateTime(), interpolated_nodes);
 
 		*out_node_count = object_state->node_count;
-		return object_state->interpolated_nodes;
+		return interpolated_nodes;
 	}
 
 	int GetObjectInterpolateCount()
@@ -165,16 +211,45 @@ namespace ObjectInterpolate
 	{
 		initialized = false;
 
-		// int count = object_count;
+		// called every tick until the game time starts, nothing to do if nothing was tracked
+		if (object_count == 0 && node_pool.empty())
+			return;
+
+		// the blocks are reclaimed all at once below, just drop the states
 		for (int i = 0; i < OBJECT_GAME_STATE_MAX_COUNT; i++)
 		{
-			ResetObject(i);
+			s_object_interpolation* object_state = &object_states[i];
+			if (!object_state->valid)
+				continue;
+
+			object_state->valid = false;
+			object_state->object_idx = DATUM_INDEX_NONE;
+			object_state->node_count = 0;
+			object_state->node_ptr = NULL;
+			object_state->node_pool_offset = NONE;
 		}
+		object_count = 0;
+
+		// keep the capacity, the next game on the same map needs about the same
+		node_pool.clear();
+		for (auto& free_blocks : node_pool_free_blocks)
+			free_blocks.clear();
+	}
+
+	void OnMapLoad(e_engine_type engine_type)
+	{
+		Reset();
+
+		// give the memory back, the next map may have a very different object count
+		std::vector<float>().swap(node_pool);
+		for (auto& free_blocks : node_pool_free_blocks)
+			std::vector<int>().swap(free_blocks);
 	}
 
 	void ApplyPatches()
 	{
 		PatchCall(Memory::GetAddressRelative(0x59650A), object_get_node_matrices_hook);
+		EventHandler::register_callback<EventType::map_load>(OnMapLoad, EventExecutionType::execute_before);
 	}
 }
 
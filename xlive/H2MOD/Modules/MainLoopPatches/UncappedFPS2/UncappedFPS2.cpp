@@ -30,5 +30,5 @@ void UncappedFPS2::OnGameLifeCycleChange(e_game_life_cycle state)
 
 void UncappedFPS2::Init()
 {
-	EventHandler::register_callback(UncappedFPS2::OnGameLifeCycleChange, EventType::gamelifecycle_change, EventExecutionType::execute_after);
+	EventHandler::register_callback<EventType::gamelifecycle_change>(UncappedFPS2::OnGameLifeCycleChange, EventExecutionType::execute_after);
 }
@@ -55,6 +55,81 @@ int get_path_from_id(e_directory_id id, LPCWSTR pMore, LPWSTR pszPath, char is_f
 	return p_get_directory_path_by_id(id, pMore, pszPath, is_folder);
 }
 
+// secondary lookup indexes over new_custom_map_entries_buffer
+// s_custom_map_data layout is shared with the game, so these are kept outside of it
+// access is guarded by custom_map_lock
+struct s_custom_map_entry_index
+{
+	// hot copy of the identity fields, in the same order as the entries buffer
+	// keeps the lookups away from the large text blocks of s_custom_map_entry
+	std::vector<s_custom_map_id> identities;
+
+	// entry indexes, in ascending order
+	std::unordered_map<std::string, std::vector<int>> by_sha256_hash;
+	std::unordered_map<std::wstring, std::vector<int>> by_map_name;
+	std::unordered_map<std::wstring, std::vector<int>> by_file_path;
+
+	// set when entries are moved in the buffer, the indexes get rebuilt on the next lookup
+	bool dirty = true;
+
+	static std::string hash_key(const BYTE* hash)
+	{
+		return std::string((const char*)hash, SHA256_HASH_SIZE);
+	}
+
+	// matches the _wcsnicmp(str, other, max_count) comparison used by the game
+	static std::wstring lower_key(const wchar_t* str, size_t max_count)
+	{
+		std::wstring key(str, wcsnlen(str, max_count));
+		for (auto& c : key)
+			c = towlower(c);
+		return key;
+	}
+
+	static const std::vector<int>* find(const std::unordered_map<std::wstring, std::vector<int>>& index, const std::wstring& key)
+	{
+		auto it = index.find(key);
+		return it != index.end() ? &it->second : nullptr;
+	}
+
+	static const std::vector<int>* find(const std::unordered_map<std::string, std::vector<int>>& index, const std::string& key)
+	{
+		auto it = index.find(key);
+		return it != index.end() ? &it->second : nullptr;
+	}
+
+	void clear()
+	{
+		identities.clear();
+		by_sha256_hash.clear();
+		by_map_name.clear();
+		by_file_path.clear();
+	}
+
+	void add(const s_custom_map_entry* entry, int idx)
+	{
+		s_custom_map_id id;
+		memcpy(id.map_sha256_hash, entry->map_sha256_hash, SHA256_HASH_SIZE);
+		wcsncpy(id.map_name, entry->map_name, MAX_MAP_NAME_SIZE);
+		identities.push_back(id);
+
+		by_sha256_hash[hash_key(entry->map_sha256_hash)].push_back(idx);
+		by_map_name[lower_key(entry->map_name, MAX_MAP_NAME_SIZE)].push_back(idx);
+		by_file_path[lower_key(entry->file_path, MAX_MAP_FILE_PATH_SIZE)].push_back(idx);
+	}
+
+	void rebuild(const s_custom_map_entry* entries, int count)
+	{
+		clear();
+		identities.reserve(NEW_MAP_LIMIT);
+		for (int i = 0; i < count; i++)
+			add(&entries[i], i);
+		dirty = false;
+	}
+};
+
+static s_custom_map_entry_index custom_map_entry_index;
+
 // TODO move to util or some other place
 static void* system_heap_alloc(SIZE_T dwBytes)
 {
@@ -67,6 +142,21 @@ void s_custom_map_data::create_custom_map_data_directory()
 	p__create_custom_map_data_directory();
 }
 
+void __thiscall s_custom_map_data::update_entry_index()
+{
+	EnterCriticalSection(custom_map_lock);
+
+	if (custom_map_entry_index.dirty)
+	{
+		if (new_custom_map_entries_buffer != nullptr)
+			custom_map_entry_index.rebuild(new_custom_map_entries_buffer, custom_map_count);
+		else
+			custom_map_entry_index.clear();
+	}
+
+	LeaveCriticalSection(custom_map_lock);
+}
+
 void __thiscall s_custom_map_data::mark_all_cached_maps_for_deletion()
 {
 	EnterCriticalSection(custom_map_lock);
@@ -90,16 +180,23 @@ bool __thiscall s_custom_map_data::remove_marked_for_deletion()
 	bool maps_removed = false;
 	WORD map_count_before_remove = custom_map_count;
 
-	for (int i = 0; i < custom_map_count; )
+	// compact the buffer in a single pass, instead of moving the remaining entries for each removed one
+	int write_idx = 0;
+	for (int i = 0; i < map_count_before_remove; i++)
 	{
 		if (new_custom_map_entries_buffer[i].entry_marked_for_deletion)
-		{
-			remove_entry_by_index(i);
-		}
-		else
-		{
-			i++;
-		}
+			continue;
+
+		if (write_idx != i)
+			memcpy(&new_custom_map_entries_buffer[write_idx], &new_custom_map_entries_buffer[i], sizeof(s_custom_map_entry));
+		write_idx++;
+	}
+
+	if (write_idx < map_count_before_remove)
+	{
+		memset(&new_custom_map_entries_buffer[write_idx], 0, (map_count_before_remove - write_idx) * sizeof(s_custom_map_entry));
+		custom_map_count = write_idx;
+		custom_map_entry_index.dirty = true;
 	}
 
 	maps_removed = map_count_before_remove > custom_map_count;
@@ -339,33 +436,254 @@ void __thiscall s_custom_map_data::load_custom_map_data_cache()
 	this->last_preview_bitmap_index = custom_map_file_cache->last_preview_bitmap_index;
 	this->new_custom_map_entries_buffer = custom_map_file_cache->entries; // we just use the buffer allocated previously
 	this->custom_map_count = custom_map_file_cache->entries_count;
+	custom_map_entry_index.dirty = true;
 
 	LeaveCriticalSection(custom_map_lock);
 }
 
-void __thiscall s_custom_map_data::start_custom_map_sync()
+// max worker threads used to read the headers of new/changed custom maps
+#define CUSTOM_MAP_SYNC_MAX_WORKER_COUNT 8u
+
+typedef std::wstring_convert<std::codecvt_utf8<wchar_t>> custom_map_name_converter_t;
+
+struct s_custom_map_file
 {
-	// this code doesn't need any modifications, just some functions replaced inside it
-	typedef void(__thiscall* file_iterate_custom_map_directory_t)(s_custom_map_data* thisx);
-	auto p_file_iterate_custom_map_directory = Memory::GetAddress<file_iterate_custom_map_directory_t>(0x4D021, 0x419B5);
-	p_file_iterate_custom_map_directory(this);
+	std::wstring file_path;
+	FILETIME file_time;
+	bool changed;
+	bool header_valid;
+	std::wstring fallback_name;
+};
+
+// reads the map header straight from the file
+// doesn't call into the game, so it's safe to run on the sync workers
+static bool read_custom_map_header(const wchar_t* file_path, s_cache_header* header)
+{
+	HANDLE file_handle = CreateFileW(file_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD bytes_read = 0;
+	bool success = ReadFile(file_handle, header, sizeof(s_cache_header), &bytes_read, NULL) && bytes_read == sizeof(s_cache_header);
+	CloseHandle(file_handle);
+	return success;
 }
 
-unsigned int __thiscall s_custom_map_data::get_custom_map_list_ids(s_custom_map_id* out_ids, unsigned int out_ids_count)
+static bool validate_custom_map_header(const wchar_t* file_name, const s_cache_header* header)
+{
+	if (header->magic != 'head' || header->foot != 'foot' || header->file_size <= 0 || header->engine_gen != 8)
+	{
+		LOG_TRACE_FUNCW(L"\"{}\" has invalid header", file_name);
+		return false;
+	}
+	if (header->type > 5 || header->type < 0)
+	{
+		LOG_TRACE_FUNCW(L"\"{}\" has bad scenario type", file_name);
+		return false;
+	}
+	if (strnlen_s(header->name, MAX_MAP_NAME_SIZE) >= 32 || strnlen_s(header->version, 32) >= 32)
+	{
+		LOG_TRACE_FUNCW(L"\"{}\" has invalid version or name string", file_name);
+		return false;
+	}
+	if (!header->is_multiplayer() && !header->is_single_player())
+	{
+		LOG_TRACE_FUNCW(L"\"{}\" is not playable", file_name);
+		return false;
+	}
+	return true;
+}
+
+// the name used if the game fails to read the human readable map name from the scenario
+// the converter isn't thread safe, each thread passes its own
+static std::wstring get_custom_map_fallback_name(const wchar_t* file_name, const s_cache_header* header, custom_map_name_converter_t& converter)
+{
+	std::wstring fallback_name;
+	if (strnlen_s(header->name, sizeof(header->name)) > 0) {
+		fallback_name = converter.from_bytes(header->name, &header->name[sizeof(header->name) - 1]);
+	}
+	else {
+		std::wstring full_file_name = file_name;
+		auto start = full_file_name.find_last_of('\\');
+		fallback_name = full_file_name.substr(start != std::wstring::npos ? start : 0, full_file_name.find_last_not_of('.'));
+	}
+	return fallback_name;
+}
+
+// calls into the game, must not run on the sync workers
+static void read_custom_map_data(s_custom_map_entry* custom_map_entry, const std::wstring& fallback_name)
+{
+	// needed because the game loads the human readable map name and description from scenario after checks
+	// without this the map is just called by it's file name
+
+	// todo move the code for loading the descriptions to our code and get rid of this
+	typedef int (__cdecl* validate_and_add_custom_map_interal_t)(s_custom_map_entry*);
+	auto validate_and_add_custom_map_interal_impl = Memory::GetAddress<validate_and_add_custom_map_interal_t>(0x4F690, 0x56890);
+	if (!validate_and_add_custom_map_interal_impl(custom_map_entry))
+	{
+		LOG_TRACE_FUNCW(L"warning \"{}\" has bad checksums or is blacklisted, map may not work correctly", custom_map_entry->file_path);
+		wcsncpy_s(custom_map_entry->map_name, fallback_name.c_str(), fallback_name.length());
+	}
+}
+
+// checks if the cached entry of the file is still up to date, without opening the map file
+bool __thiscall s_custom_map_data::entry_is_up_to_date(const wchar_t* file_path, const FILETIME* file_time)
 {
 	EnterCriticalSection(custom_map_lock);
-	for (int i = 0; i < custom_map_count; i++)
+
+	bool up_to_date = false;
+	s_custom_map_entry* cached_entry = nullptr;
+	if (find_matching_entries_by_file_path(file_path, &cached_entry, 1) > 0u)
+		up_to_date = CompareFileTime(&cached_entry->file_time, file_time) == 0;
+
+	LeaveCriticalSection(custom_map_lock);
+	return up_to_date;
+}
+
+void __thiscall s_custom_map_data::start_custom_map_sync()
+{
+	std::vector<s_custom_map_file> map_files;
+	std::vector<s_custom_map_file*> changed_map_files;
+
+	// enumerate the custom map folder
+	WIN32_FIND_DATAW find_data;
+	std::wstring folder_path(custom_maps_folder_path);
+	HANDLE find_handle = FindFirstFileW((folder_path + L"*.map").c_str(), &find_data);
+	if (find_handle != INVALID_HANDLE_VALUE)
 	{
-		new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
-		if (out_ids != nullptr
-			&& out_ids_count != 0)
+		do
+		{
+			if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				continue;
+
+			s_custom_map_file map_file;
+			map_file.file_path = folder_path + find_data.cFileName;
+			map_file.file_time = find_data.ftLastWriteTime;
+			map_file.changed = false;
+			map_file.header_valid = false;
+
+			if (map_file.file_path.length() >= MAX_MAP_FILE_PATH_SIZE)
+			{
+				LOG_TRACE_FUNCW(L"\"{}\" path too long, skipping", map_file.file_path);
+				continue;
+			}
+
+			map_files.push_back(std::move(map_file));
+		} while (FindNextFileW(find_handle, &find_data));
+
+		FindClose(find_handle);
+	}
+
+	// skip the maps that didn't change since they were cached
+	for (auto& map_file : map_files)
+	{
+		if (!entry_is_up_to_date(map_file.file_path.c_str(), &map_file.file_time))
+		{
+			map_file.changed = true;
+			changed_map_files.push_back(&map_file);
+		}
+	}
+
+	// read and check the headers of the new/changed maps on a worker pool
+	// the workers don't touch the game or the cache, that happens below on this thread only
+	std::atomic<size_t> next_map_file_idx = 0;
+
+	auto header_worker = [&]()
+	{
+		custom_map_name_converter_t converter;
+		for (size_t i = next_map_file_idx++; i < changed_map_files.size(); i = next_map_file_idx++)
 		{
-			if (i < out_ids_count)
+			s_custom_map_file* map_file = changed_map_files[i];
+			const wchar_t* file_path = map_file->file_path.c_str();
+
+			s_cache_header header;
+			if (read_custom_map_header(file_path, &header) && validate_custom_map_header(file_path, &header))
 			{
-				memcpy(out_ids[i].map_sha256_hash, new_custom_map_entries_buffer[i].map_sha256_hash, SHA256_HASH_SIZE);
-				wcsncpy(out_ids[i].map_name, new_custom_map_entries_buffer[i].map_name, MAX_MAP_NAME_SIZE);
+				map_file->header_valid = true;
+				map_file->fallback_name = get_custom_map_fallback_name(file_path, &header, converter);
 			}
 		}
+	};
+
+	unsigned int worker_count = (std::min)((std::max)(std::thread::hardware_concurrency(), 1u), CUSTOM_MAP_SYNC_MAX_WORKER_COUNT);
+	worker_count = (std::min)(worker_count, (unsigned int)changed_map_files.size());
+
+	std::vector<std::thread> workers;
+	// the current thread is a worker as well
+	for (unsigned int i = 1; i < worker_count; i++)
+		workers.emplace_back(header_worker);
+	header_worker();
+	for (auto& worker : workers)
+		worker.join();
+
+	// the game reads the scenario of each new/changed map one at a time on this thread
+	// this is the slow part of a sync, so it runs before taking the lock to keep the map list usable meanwhile
+	std::vector<s_custom_map_file*> new_map_files;
+	std::vector<s_custom_map_entry> new_map_entries;
+	for (s_custom_map_file* map_file : changed_map_files)
+	{
+		if (map_file->header_valid)
+			new_map_files.push_back(map_file);
+	}
+
+	new_map_entries.resize(new_map_files.size());
+	for (size_t i = 0; i < new_map_files.size(); i++)
+	{
+		s_custom_map_entry* custom_map_new_entry = &new_map_entries[i];
+		ZeroMemory(custom_map_new_entry, sizeof(s_custom_map_entry));
+		wcscpy_s(custom_map_new_entry->file_path, MAX_MAP_FILE_PATH_SIZE, new_map_files[i]->file_path.c_str());
+
+		read_custom_map_data(custom_map_new_entry, new_map_files[i]->fallback_name);
+	}
+
+	// merge, adds the new/changed maps
+	// then removes the entries of the maps that are not present anymore, or failed validation
+	bool maps_added = false;
+
+	EnterCriticalSection(custom_map_lock);
+
+	for (size_t i = 0; i < new_map_files.size(); i++)
+	{
+		if (add_validated_custom_map_entry(&new_map_entries[i], &new_map_files[i]->file_time))
+			maps_added = true;
+		else
+			new_map_files[i]->header_valid = false;
+	}
+
+	mark_all_cached_maps_for_deletion();
+
+	// finding the entry clears the deletion mark
+	for (auto& map_file : map_files)
+	{
+		if (!map_file.changed || map_file.header_valid)
+			find_matching_entries_by_file_path(map_file.file_path.c_str(), nullptr, 0);
+	}
+
+	bool maps_removed = remove_marked_for_deletion();
+	unsigned int map_count = custom_map_count;
+
+	LeaveCriticalSection(custom_map_lock);
+
+	LOG_TRACE_FUNC("{} maps found, {} new/changed, {} maps cached",
+		map_files.size(), changed_map_files.size(), map_count);
+
+	if (maps_added || maps_removed)
+		save_custom_map_data();
+}
+
+unsigned int __thiscall s_custom_map_data::get_custom_map_list_ids(s_custom_map_id* out_ids, unsigned int out_ids_count)
+{
+	EnterCriticalSection(custom_map_lock);
+	update_entry_index();
+
+	for (int i = 0; i < custom_map_count; i++)
+		new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
+
+	if (out_ids != nullptr
+		&& out_ids_count != 0)
+	{
+		unsigned int copy_count = (std::min)(out_ids_count, (unsigned int)custom_map_count);
+		memcpy(out_ids, custom_map_entry_index.identities.data(), copy_count * sizeof(s_custom_map_id));
 	}
 
 	unsigned int map_count = this->custom_map_count;
@@ -378,22 +696,29 @@ unsigned int __thiscall s_custom_map_data::get_custom_map_list_ids_by_map_name(c
 {
 	EnterCriticalSection(custom_map_lock);
 
+	if (new_custom_map_entries_buffer == nullptr
+		|| map_name == nullptr)
+	{
+		LeaveCriticalSection(custom_map_lock);
+		return 0;
+	}
+
+	update_entry_index();
+
 	unsigned int matching_count_found = 0;
 
 	// used by dedicated server
-	for (int i = 0; i < custom_map_count; i++)
+	auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_map_name, s_custom_map_entry_index::lower_key(map_name, MAX_MAP_NAME_SIZE));
+	if (matching_entries != nullptr)
 	{
-		if (!_wcsnicmp(new_custom_map_entries_buffer[i].map_name, map_name, MAX_MAP_NAME_SIZE))
+		for (int i : *matching_entries)
 		{
 			new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
 			if (out_ids != nullptr
 				&& out_ids_count != 0)
 			{
 				if (matching_count_found < out_ids_count)
-				{
-					memcpy(out_ids[matching_count_found].map_sha256_hash, new_custom_map_entries_buffer[i].map_sha256_hash, SHA256_HASH_SIZE);
-					wcsncpy(out_ids[matching_count_found].map_name, new_custom_map_entries_buffer[i].map_name, MAX_MAP_NAME_SIZE);
-				}
+					out_ids[matching_count_found] = custom_map_entry_index.identities[i];
 			}
 
 			matching_count_found++;
@@ -419,21 +744,27 @@ unsigned int __thiscall s_custom_map_data::find_matching_entries_by_file_path(co
 		return 0;
 	}
 
+	update_entry_index();
+
 	unsigned int matching_count_found = 0;
 
-	for (int i = 0; i < custom_map_count; i++)
+	auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_file_path, s_custom_map_entry_index::lower_key(file_path, MAX_MAP_FILE_PATH_SIZE));
+	if (matching_entries == nullptr)
 	{
-		if (!_wcsnicmp(new_custom_map_entries_buffer[i].file_path, file_path, MAX_MAP_FILE_PATH_SIZE))
-		{
-			new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
-			if (out_custom_map_entries)
-			{
-				if (out_custom_map_entries_count > matching_count_found)
-					out_custom_map_entries[matching_count_found] = &new_custom_map_entries_buffer[i];
-			}
+		LeaveCriticalSection(custom_map_lock);
+		return 0;
+	}
 
-			matching_count_found++;
+	for (int i : *matching_entries)
+	{
+		new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
+		if (out_custom_map_entries)
+		{
+			if (out_custom_map_entries_count > matching_count_found)
+				out_custom_map_entries[matching_count_found] = &new_custom_map_entries_buffer[i];
 		}
+
+		matching_count_found++;
 	}
 
 	LeaveCriticalSection(custom_map_lock);
@@ -451,21 +782,27 @@ unsigned int __thiscall s_custom_map_data::find_matching_entries_by_sha256_hash(
 		return 0;
 	}
 
+	update_entry_index();
+
 	unsigned int matching_count_found = 0;
 
-	for (int i = 0; i < custom_map_count; i++)
+	auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_sha256_hash, s_custom_map_entry_index::hash_key(hash));
+	if (matching_entries == nullptr)
 	{
-		if (!memcmp(new_custom_map_entries_buffer[i].map_sha256_hash, hash, SHA256_HASH_SIZE))
-		{
-			new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
-			if (out_custom_map_entries)
-			{
-				if (out_custom_map_entries_count > matching_count_found)
-					out_custom_map_entries[matching_count_found] = &new_custom_map_entries_buffer[i];
-			}
+		LeaveCriticalSection(custom_map_lock);
+		return 0;
+	}
 
-			matching_count_found++;
+	for (int i : *matching_entries)
+	{
+		new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
+		if (out_custom_map_entries)
+		{
+			if (out_custom_map_entries_count > matching_count_found)
+				out_custom_map_entries[matching_count_found] = &new_custom_map_entries_buffer[i];
 		}
+
+		matching_count_found++;
 	}
 
 	LeaveCriticalSection(custom_map_lock);
@@ -477,17 +814,27 @@ unsigned int __thiscall s_custom_map_data::find_matching_entries_by_map_name_and
 	EnterCriticalSection(custom_map_lock);
 
 	if (new_custom_map_entries_buffer == nullptr
-		|| map_name == nullptr)
+		|| map_name == nullptr
+		|| sha256_hash == nullptr)
 	{
 		LeaveCriticalSection(custom_map_lock);
 		return 0;
 	}
 
+	update_entry_index();
+
 	unsigned int matching_count_found = 0;
 
-	for (int i = 0; i < custom_map_count; i++)
+	auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_sha256_hash, s_custom_map_entry_index::hash_key(sha256_hash));
+	if (matching_entries == nullptr)
+	{
+		LeaveCriticalSection(custom_map_lock);
+		return 0;
+	}
+
+	for (int i : *matching_entries)
 	{
-		if (!memcmp(new_custom_map_entries_buffer[i].map_sha256_hash, sha256_hash, SHA256_HASH_SIZE) && !_wcsnicmp(new_custom_map_entries_buffer[i].map_name, map_name, MAX_MAP_NAME_SIZE))
+		if (!_wcsnicmp(custom_map_entry_index.identities[i].map_name, map_name, MAX_MAP_NAME_SIZE))
 		{
 			new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
 			if (out_custom_map_entries)
@@ -515,21 +862,27 @@ unsigned int __thiscall s_custom_map_data::find_matching_entries_by_map_name(con
 		return 0;
 	}
 
+	update_entry_index();
+
 	unsigned int matching_count_found = 0;
 
-	for (int i = 0; i < custom_map_count; i++)
+	auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_map_name, s_custom_map_entry_index::lower_key(map_name, MAX_MAP_NAME_SIZE));
+	if (matching_entries == nullptr)
 	{
-		if (!_wcsnicmp(new_custom_map_entries_buffer[i].map_name, map_name, MAX_MAP_NAME_SIZE))
-		{
-			new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
-			if (out_custom_map_entries)
-			{
-				if (out_custom_map_entries_count > matching_count_found)
-					out_custom_map_entries[matching_count_found] = &new_custom_map_entries_buffer[i];
-			}
+		LeaveCriticalSection(custom_map_lock);
+		return 0;
+	}
 
-			matching_count_found++;
+	for (int i : *matching_entries)
+	{
+		new_custom_map_entries_buffer[i].entry_marked_for_deletion = false;
+		if (out_custom_map_entries)
+		{
+			if (out_custom_map_entries_count > matching_count_found)
+				out_custom_map_entries[matching_count_found] = &new_custom_map_entries_buffer[i];
 		}
+
+		matching_count_found++;
 	}
 
 	LeaveCriticalSection(custom_map_lock);
@@ -588,6 +941,9 @@ void __thiscall s_custom_map_data::remove_entry_by_index(int idx)
 	}
 
 	custom_map_count--;
+
+	// entries after idx moved, indexes are out of date
+	custom_map_entry_index.dirty = true;
 }
 
 bool __thiscall s_custom_map_data::remove_entries_matching_file_path(const s_custom_map_entry* entry)
@@ -595,16 +951,22 @@ bool __thiscall s_custom_map_data::remove_entries_matching_file_path(const s_cus
 	EnterCriticalSection(custom_map_lock);
 
 	bool removed = false;
-	for (int i = 0; i < custom_map_count; )
+
+	if (new_custom_map_entries_buffer != nullptr)
 	{
-		if (!_wcsnicmp(new_custom_map_entries_buffer[i].file_path, entry->file_path, MAX_MAP_FILE_PATH_SIZE))
-		{
-			removed = true;
-			remove_entry_by_index(i);
-		}
-		else
+		update_entry_index();
+
+		auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_file_path, s_custom_map_entry_index::lower_key(entry->file_path, MAX_MAP_FILE_PATH_SIZE));
+		if (matching_entries != nullptr)
 		{
-			i++;
+			// copy, removing entries invalidates the index
+			std::vector<int> entries_to_remove = *matching_entries;
+
+			// remove from last to first, so the remaining indexes stay valid
+			for (auto it = entries_to_remove.rbegin(); it != entries_to_remove.rend(); ++it)
+				remove_entry_by_index(*it);
+
+			removed = !entries_to_remove.empty();
 		}
 	}
 
@@ -617,14 +979,28 @@ bool __thiscall s_custom_map_data::remove_duplicates_by_map_name_and_hash(const
 	EnterCriticalSection(custom_map_lock);
 
 	bool removed = false;
-	for (int i = 0; i < custom_map_count; i++)
+
+	if (new_custom_map_entries_buffer != nullptr)
 	{
-		if (!memcmp(new_custom_map_entries_buffer[i].map_sha256_hash, entry->map_sha256_hash, SHA256_HASH_SIZE) 
-			&& !_wcsnicmp(new_custom_map_entries_buffer[i].map_name, entry->map_name, MAX_MAP_NAME_SIZE))
+		update_entry_index();
+
+		std::vector<int> entries_to_remove;
+		auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_sha256_hash, s_custom_map_entry_index::hash_key(entry->map_sha256_hash));
+		if (matching_entries != nullptr)
+		{
+			for (int i : *matching_entries)
+			{
+				if (!_wcsnicmp(custom_map_entry_index.identities[i].map_name, entry->map_name, MAX_MAP_NAME_SIZE))
+					entries_to_remove.push_back(i);
+			}
+		}
+
+		// remove from last to first, so the remaining indexes stay valid
+		for (auto it = entries_to_remove.rbegin(); it != entries_to_remove.rend(); ++it)
 		{
 			//LOG_TRACE_GAME(L"{} - removed: {} from cache matching cached entry: map name: {} map path: {}",
-				//__FUNCTIONW__, entry->file_path, new_custom_map_entries_buffer[i].map_name, new_custom_map_entries_buffer[i].file_path);
-			remove_entry_by_index(i);
+				//__FUNCTIONW__, entry->file_path, new_custom_map_entries_buffer[*it].map_name, new_custom_map_entries_buffer[*it].file_path);
+			remove_entry_by_index(*it);
 			removed = true;
 		}
 	}
@@ -639,13 +1015,23 @@ bool __thiscall s_custom_map_data::delete_single_entry(const s_custom_map_entry*
 
 	bool removed = false;
 
-	for (int i = 0; i < custom_map_count; i++)
+	if (new_custom_map_entries_buffer != nullptr)
 	{
-		if (!memcmp(&new_custom_map_entries_buffer[i], entry, sizeof(s_custom_map_entry)))
+		update_entry_index();
+
+		// only entries with the same hash can match
+		auto matching_entries = s_custom_map_entry_index::find(custom_map_entry_index.by_sha256_hash, s_custom_map_entry_index::hash_key(entry->map_sha256_hash));
+		if (matching_entries != nullptr)
 		{
-			remove_entry_by_index(i);
-			removed = true;
-			break;
+			for (int i : *matching_entries)
+			{
+				if (!memcmp(&new_custom_map_entries_buffer[i], entry, sizeof(s_custom_map_entry)))
+				{
+					remove_entry_by_index(i);
+					removed = true;
+					break;
+				}
+			}
 		}
 	}
 
@@ -661,7 +1047,13 @@ bool __thiscall s_custom_map_data::add_entry(const s_custom_map_entry* entry)
 
 	if (custom_map_count < NEW_MAP_LIMIT && validate_entry_data(entry, 1) && !entry_is_duplicate(entry))
 	{
-		memcpy(&new_custom_map_entries_buffer[custom_map_count++], entry, sizeof(s_custom_map_entry));
+		memcpy(&new_custom_map_entries_buffer[custom_map_count], entry, sizeof(s_custom_map_entry));
+
+		// appended entry, no need to rebuild the indexes
+		if (!custom_map_entry_index.dirty)
+			custom_map_entry_index.add(&new_custom_map_entries_buffer[custom_map_count], custom_map_count);
+
+		custom_map_count++;
 	}
 	else
 	{
@@ -706,8 +1098,6 @@ void close_cache_header(HANDLE* map_handle)
 	close_cache_header_impl(map_handle);
 }
 
-static std::wstring_convert<std::codecvt_utf8<wchar_t>> wstring_to_string;
-
 int __cdecl validate_and_read_custom_map_data(s_custom_map_entry* custom_map_entry)
 {
 	s_cache_header header;
@@ -715,52 +1105,37 @@ int __cdecl validate_and_read_custom_map_data(s_custom_map_entry* custom_map_ent
 	wchar_t* file_name = custom_map_entry->file_path;
 	if (!open_cache_header(file_name, &header, &map_cache_handle))
 		return false;
-	if (header.magic != 'head' || header.foot != 'foot' || header.file_size <= 0 || header.engine_gen != 8)
-	{
-		LOG_TRACE_FUNCW(L"\"{}\" has invalid header", file_name);
-		return false;
-	}
-	if (header.type > 5 || header.type < 0)
-	{
-		LOG_TRACE_FUNCW(L"\"{}\" has bad scenario type", file_name);
-		return false;
-	}
-	if (strnlen_s(header.name, MAX_MAP_NAME_SIZE) >= 32 || strnlen_s(header.version, 32) >= 32)
-	{
-		LOG_TRACE_FUNCW(L"\"{}\" has invalid version or name string", file_name);
-		return false;
-	}
-	if (!header.is_multiplayer() && !header.is_single_player())
-	{
-		LOG_TRACE_FUNCW(L"\"{}\" is not playable", file_name);
+	if (!validate_custom_map_header(file_name, &header))
 		return false;
-	}
 
 	close_cache_header(&map_cache_handle);
-	// needed because the game loads the human readable map name and description from scenario after checks
-	// without this the map is just called by it's file name
 
-	// todo move the code for loading the descriptions to our code and get rid of this
-	typedef int (__cdecl* validate_and_add_custom_map_interal_t)(s_custom_map_entry*);
-	auto validate_and_add_custom_map_interal_impl = Memory::GetAddress<validate_and_add_custom_map_interal_t>(0x4F690, 0x56890);
-	if (!validate_and_add_custom_map_interal_impl(custom_map_entry))
-	{
-		LOG_TRACE_FUNCW(L"warning \"{}\" has bad checksums or is blacklisted, map may not work correctly", file_name);
-		std::wstring fallback_name;
-		if (strnlen_s(header.name, sizeof(header.name)) > 0) {
-			fallback_name = wstring_to_string.from_bytes(header.name, &header.name[sizeof(header.name) - 1]);
-		}
-		else {
-			std::wstring full_file_name = file_name;
-			auto start = full_file_name.find_last_of('\\');
-			fallback_name = full_file_name.substr(start != std::wstring::npos ? start : 0, full_file_name.find_last_not_of('.'));
-		}
-		wcsncpy_s(custom_map_entry->map_name, fallback_name.c_str(), fallback_name.length());
-	}
+	custom_map_name_converter_t converter;
+	read_custom_map_data(custom_map_entry, get_custom_map_fallback_name(file_name, &header, converter));
 	// load the map even if some of the checks failed, will still mostly work
 	return true;
 }
 
+// the entry has to be validated and read already
+bool __thiscall s_custom_map_data::add_validated_custom_map_entry(s_custom_map_entry* entry, const FILETIME* file_time)
+{
+	EnterCriticalSection(custom_map_lock);
+
+	bool map_loaded = remove_duplicates_write_entry_data_and_add(entry);
+
+	// store the file time, used to skip the map on the next sync
+	s_custom_map_entry* cached_entry = nullptr;
+	if (map_loaded
+		&& file_time != nullptr
+		&& find_matching_entries_by_file_path(entry->file_path, &cached_entry, 1) > 0u)
+	{
+		cached_entry->file_time = *file_time;
+	}
+
+	LeaveCriticalSection(custom_map_lock);
+	return map_loaded;
+}
+
 bool __thiscall s_custom_map_data::add_custom_map_entry_by_map_file_path(const std::wstring& file_path)
 {
 	return add_custom_map_entry_by_map_file_path(file_path.c_str());
@@ -768,20 +1143,25 @@ bool __thiscall s_custom_map_data::add_custom_map_entry_by_map_file_path(const s
 
 bool __thiscall s_custom_map_data::add_custom_map_entry_by_map_file_path(const wchar_t* file_path)
 {
+	WIN32_FILE_ATTRIBUTE_DATA file_attributes;
+	bool file_time_available = GetFileAttributesExW(file_path, GetFileExInfoStandard, &file_attributes) != FALSE;
+
+	// map file didn't change since it was cached, no need to open it again
+	if (file_time_available
+		&& entry_is_up_to_date(file_path, &file_attributes.ftLastWriteTime))
+	{
+		return true;
+	}
+
 	s_custom_map_entry custom_map_new_entry;
 	ZeroMemory(&custom_map_new_entry, sizeof(s_custom_map_entry));
 
 	wcscpy_s(custom_map_new_entry.file_path, MAX_MAP_FILE_PATH_SIZE, file_path);
 
-	bool map_loaded = false;
-	if (validate_and_read_custom_map_data(&custom_map_new_entry)) {
-
-		if (remove_duplicates_write_entry_data_and_add(&custom_map_new_entry)) {
-			map_loaded = true;
-		}
-	}
+	if (!validate_and_read_custom_map_data(&custom_map_new_entry))
+		return false;
 
-	return map_loaded;
+	return add_validated_custom_map_entry(&custom_map_new_entry, file_time_available ? &file_attributes.ftLastWriteTime : nullptr);
 }
 
 void __thiscall s_custom_map_data::initialize()
@@ -801,6 +1181,9 @@ void __thiscall s_custom_map_data::cleanup()
 
 	custom_map_file_data_cache = nullptr;
 
+	custom_map_entry_index.clear();
+	custom_map_entry_index.dirty = true;
+
 	DeleteCriticalSection(custom_map_lock);
 	delete custom_map_lock;
 }
@@ -115,7 +115,8 @@ struct s_custom_map_data
 	void __thiscall load_custom_map_data_cache();
 
 	// goes through all custom maps in directory
-	// and creates a linked list of maps that are not cached/registered
+	// reads the headers of the maps that are not cached/registered or changed since on a worker pool
+	// then validates and adds them in a single pass on the calling thread
 	// and removes custom maps cached entries that are not present anymore in the folder
 	void __thiscall start_custom_map_sync();
 
@@ -128,6 +129,7 @@ struct s_custom_map_data
 	bool __thiscall get_entry_by_id(const s_custom_map_id* custom_map_id, s_custom_map_entry** out_entry);
 
 	bool __thiscall entry_is_duplicate(const s_custom_map_entry* entry);
+	bool __thiscall entry_is_up_to_date(const wchar_t* file_path, const FILETIME* file_time);
 	bool __thiscall validate_entry_data(const s_custom_map_entry* entry, int count);
 
 	bool __thiscall add_entry(const s_custom_map_entry* entry);
@@ -143,7 +145,9 @@ struct s_custom_map_data
 	void __thiscall initialize();
 	void __thiscall cleanup();
 private:
+	bool __thiscall add_validated_custom_map_entry(s_custom_map_entry* entry, const FILETIME* file_time);
 	void __thiscall remove_entry_by_index(int idx);
+	void __thiscall update_entry_index();
 };
 static_assert(sizeof(s_custom_map_data) == 0x24444);
 #pragma pack(pop)
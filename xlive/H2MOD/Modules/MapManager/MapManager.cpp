@@ -11,6 +11,8 @@
 #include "Util/Hooks/Hook.h"
 #include "XLive/xnet/IpManagement/XnIp.h"
 
+#include <condition_variable>
+
 std::unique_ptr<MapManager> mapManager(std::make_unique<MapManager>());
 
 /* String constants below for client/server messages */
@@ -42,6 +44,16 @@ std::string fileReadMode("wb");
 std::string traceTemplate("%s");
 std::string fileSizeDelim("$");
 
+// each parallel range request covers at least this much of the map
+#define MAP_DOWNLOAD_SEGMENT_MIN_SIZE (8 * 1024 * 1024)
+// matches the per host connection limit of the curl executor
+#define MAP_DOWNLOAD_MAX_SEGMENT_COUNT 4
+#define MAP_DOWNLOAD_MAX_ATTEMPTS 5
+#define MAP_DOWNLOAD_STATE_SAVE_INTERVAL std::chrono::seconds(1)
+
+#define MAP_DOWNLOAD_STATE_MAGIC 0x7370646D //'mdps'
+#define MAP_DOWNLOAD_STATE_VERSION 1
+
 std::wstring CUSTOM_MAP = L"Custom Map";
 wchar_t EMPTY_UNICODE_STR = '\0';
 
@@ -421,76 +433,476 @@ MapDownloadQuery::MapDownloadQuery(const std::wstring& _mapToDownload, int _down
 MapDownloadQuery::~MapDownloadQuery() {
 }
 
-size_t write_data(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-	return fwrite(ptr, size, nmemb, stream);
+#pragma region map download
+struct s_map_download;
+
+struct s_map_download_segment
+{
+	s_map_download* download;
+	long long start;
+	// inclusive, NONE if the map size is unknown
+	long long end;
+	// written by the curl executor thread, read by the progress callback and when saving the download state
+	std::atomic<long long> downloaded;
+
+	CURL* curl;
+	bool range_requested;
+	bool first_write;
+
+	// guarded by s_map_download::mutex
+	bool pending;
+	// set once a request for the segment ran to the end, a segment that was never requested isn't complete
+	bool finished;
+	CURLcode result;
+	long response_code;
+
+	bool is_complete() const
+	{
+		if (end == NONE)
+			return !pending && finished && result == CURLE_OK;
+		return start + downloaded == end + 1;
+	}
+};
+
+struct s_map_download
+{
+	MapDownloadQuery* query;
+	std::string url;
+
+	// NONE if the server didn't report it
+	long long file_size;
+	long long file_time;
+	bool accepts_ranges;
+	// the server answered a range request with the whole file
+	bool range_ignored;
+
+	// all segments write into the part file from the curl executor thread
+	FILE* file;
+	long long write_offset;
+
+	int segment_count;
+	s_map_download_segment segments[MAP_DOWNLOAD_MAX_SEGMENT_COUNT];
+
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+// saved next to the part file, so a download can be resumed after leaving the session or restarting the game
+struct s_map_download_state_header
+{
+	DWORD magic;
+	DWORD version;
+	long long file_size;
+	long long file_time;
+	int segment_count;
+};
+
+struct s_map_download_state_segment
+{
+	long long start;
+	long long end;
+	long long downloaded;
+};
+
+static size_t map_download_probe_header(char* buffer, size_t size, size_t nitems, s_map_download* download) {
+	/* received header is nitems * size long in 'buffer' NOT ZERO TERMINATED */
+	const char accept_ranges[] = "Accept-Ranges: bytes";
+	size_t len = size * nitems;
+	if (len >= sizeof(accept_ranges) - 1 && _strnicmp(buffer, accept_ranges, sizeof(accept_ranges) - 1) == 0)
+		download->accepts_ranges = true;
+	return len;
+}
+
+// HEAD request for the map size and whether it can be downloaded in ranges
+static CURLcode map_download_probe(s_map_download* download) {
+	CURL* curl = curl_interface_init_no_verify();
+	if (!curl)
+		return CURLE_FAILED_INIT;
+
+	curl_easy_setopt(curl, CURLOPT_URL, download->url.c_str());
+	curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+	//fail if 404 or any other type of http error
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, map_download_probe_header);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, download);
+	CURLcode res = curl_interface_perform(curl);
+	if (res == CURLE_OK) {
+		curl_off_t content_length = -1;
+		curl_off_t file_time = -1;
+		curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+		curl_easy_getinfo(curl, CURLINFO_FILETIME_T, &file_time);
+		download->file_size = content_length > 0 ? content_length : NONE;
+		download->file_time = file_time;
+	}
+	curl_easy_cleanup(curl);
+
+	// ranges are useless without knowing where the file ends
+	if (download->file_size == NONE)
+		download->accepts_ranges = false;
+	return res;
+}
+
+static void map_download_plan_segments(s_map_download* download) {
+	int segment_count = 1;
+	if (download->accepts_ranges && download->file_size >= MAP_DOWNLOAD_SEGMENT_MIN_SIZE * 2)
+		segment_count = (int)(std::min)((long long)MAP_DOWNLOAD_MAX_SEGMENT_COUNT, download->file_size / MAP_DOWNLOAD_SEGMENT_MIN_SIZE);
+
+	long long segment_size = download->file_size != NONE ? download->file_size / segment_count : 0;
+	download->segment_count = segment_count;
+	for (int i = 0; i < segment_count; i++) {
+		s_map_download_segment& segment = download->segments[i];
+		segment.start = i * segment_size;
+		if (download->file_size == NONE)
+			segment.end = NONE;
+		else
+			segment.end = i == segment_count - 1 ? download->file_size - 1 : segment.start + segment_size - 1;
+		segment.downloaded = 0;
+	}
+}
+
+static bool map_download_load_state(s_map_download* download, const std::wstring& state_path) {
+	bool result = false;
+	FILE* file = _wfopen(state_path.c_str(), L"rb");
+	if (file == nullptr)
+		return false;
+
+	do
+	{
+		// only resume if the map on the server is still the same
+		s_map_download_state_header header;
+		if (fread(&header, sizeof(header), 1, file) != 1
+			|| header.magic != MAP_DOWNLOAD_STATE_MAGIC
+			|| header.version != MAP_DOWNLOAD_STATE_VERSION
+			|| header.file_size != download->file_size
+			|| header.file_time != download->file_time
+			|| header.segment_count < 1
+			|| header.segment_count > MAP_DOWNLOAD_MAX_SEGMENT_COUNT)
+			break;
+
+		s_map_download_state_segment segments[MAP_DOWNLOAD_MAX_SEGMENT_COUNT];
+		if (fread(segments, sizeof(segments[0]), header.segment_count, file) != header.segment_count)
+			break;
+
+		bool valid = true;
+		for (int i = 0; i < header.segment_count; i++) {
+			if (segments[i].start < 0
+				|| segments[i].end >= download->file_size
+				|| segments[i].downloaded < 0
+				|| segments[i].start + segments[i].downloaded > segments[i].end + 1)
+				valid = false;
+		}
+		if (!valid)
+			break;
+
+		download->segment_count = header.segment_count;
+		for (int i = 0; i < header.segment_count; i++) {
+			download->segments[i].start = segments[i].start;
+			download->segments[i].end = segments[i].end;
+			download->segments[i].downloaded = segments[i].downloaded;
+		}
+		result = true;
+	} while (0);
+
+	fclose(file);
+	return result;
+}
+
+// the counters only advance after the data was handed to the part file's buffer, so they are read first and the buffer
+// is flushed after, otherwise a crash could leave a state claiming more than the part file holds
+static void map_download_save_state(s_map_download* download, const std::wstring& state_path) {
+	long long downloaded[MAP_DOWNLOAD_MAX_SEGMENT_COUNT];
+	for (int i = 0; i < download->segment_count; i++)
+		downloaded[i] = download->segments[i].downloaded;
+
+	if (fflush(download->file) != 0)
+		return;
+
+	FILE* file = _wfopen(state_path.c_str(), L"wb");
+	if (file == nullptr)
+		return;
+
+	s_map_download_state_header header;
+	header.magic = MAP_DOWNLOAD_STATE_MAGIC;
+	header.version = MAP_DOWNLOAD_STATE_VERSION;
+	header.file_size = download->file_size;
+	header.file_time = download->file_time;
+	header.segment_count = download->segment_count;
+	fwrite(&header, sizeof(header), 1, file);
+
+	for (int i = 0; i < download->segment_count; i++) {
+		s_map_download_state_segment segment;
+		segment.start = download->segments[i].start;
+		segment.end = download->segments[i].end;
+		segment.downloaded = downloaded[i];
+		fwrite(&segment, sizeof(segment), 1, file);
+	}
+	fclose(file);
+}
+
+static size_t map_download_write(void* ptr, size_t size, size_t nmemb, s_map_download_segment* segment) {
+	s_map_download* download = segment->download;
+	size_t len = size * nmemb;
+
+	if (segment->first_write) {
+		segment->first_write = false;
+		if (segment->range_requested) {
+			long http_code = 0;
+			curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, &http_code);
+			if (http_code != 206) {
+				download->range_ignored = true;
+				return 0;
+			}
+		}
+	}
+
+	long long offset = segment->start + segment->downloaded;
+	// more than we asked for
+	if (segment->end != NONE && offset + (long long)len > segment->end + 1)
+		return 0;
+
+	// the segments take turns writing, only seek when switching between them
+	if (download->write_offset != offset && _fseeki64(download->file, offset, SEEK_SET) != 0)
+		return 0;
+
+	if (fwrite(ptr, 1, len, download->file) != len)
+		return 0;
+
+	download->write_offset = offset + len;
+	segment->downloaded += len;
+	return len;
+}
+
+static int map_download_xferinfo(void* p, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+	s_map_download_segment* segment = (s_map_download_segment*)p;
+	s_map_download* download = segment->download;
+
+	if (download->file_size != NONE) {
+		long long downloaded = 0;
+		for (int i = 0; i < download->segment_count; i++)
+			downloaded += download->segments[i].downloaded;
+		download->query->SetDownloadPercentage((int)(downloaded * 100 / download->file_size));
+	}
+	else if (dltotal > 0) {
+		download->query->SetDownloadPercentage((int)(dlnow * 100 / dltotal));
+	}
+
+	return download->query->ShouldStopDownload();
 }
 
-static int xferinfo(void *p, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
-	MapDownloadQuery* mapDownloadQuery = (MapDownloadQuery*)p;
-	mapDownloadQuery->SetDownloadPercentage(((double)dlnow / (double)dltotal) * 100);
-	return mapDownloadQuery->ShouldStopDownload();
+static bool map_download_start_segment(s_map_download_segment* segment) {
+	s_map_download* download = segment->download;
+
+	CURL* curl = curl_interface_init_no_verify();
+	if (!curl)
+		return false;
+
+	segment->curl = curl;
+	segment->first_write = true;
+	segment->range_requested = false;
+
+	if (download->accepts_ranges) {
+		// resume where the segment left off
+		char range[64];
+		snprintf(range, sizeof(range), "%lld-%lld", segment->start + segment->downloaded, segment->end);
+		curl_easy_setopt(curl, CURLOPT_RANGE, range);
+		segment->range_requested = true;
+	}
+	else {
+		// nothing to resume from, start over
+		segment->downloaded = 0;
+		download->write_offset = NONE;
+	}
+
+	//fail if 404 or any other type of http error
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_URL, download->url.c_str());
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, map_download_write);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, segment);
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, map_download_xferinfo);
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, segment);
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+	// drop stalled connections, the next attempt resumes them
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 15L);
+
+	{
+		std::lock_guard lg(download->mutex);
+		segment->pending = true;
+		segment->finished = false;
+	}
+
+	int request_id = curl_interface_perform_async(curl,
+		[segment](CURL* curl, CURLcode result)
+		{
+			s_map_download* download = segment->download;
+
+			long response_code = 0;
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+
+			std::lock_guard lg(download->mutex);
+			segment->result = result;
+			segment->response_code = response_code;
+			segment->pending = false;
+			segment->finished = true;
+			download->cv.notify_all();
+		});
+
+	if (request_id == -1) {
+		curl_easy_cleanup(curl);
+		std::lock_guard lg(download->mutex);
+		segment->result = CURLE_FAILED_INIT;
+		segment->pending = false;
+		return false;
+	}
+	return true;
 }
+#pragma endregion
 
 bool MapDownloadQuery::DownloadFromRepo() {
 	std::string url(cartographerMapRepoURL + "/");
 
-	FILE *fp = nullptr;
-	CURL *curl = nullptr;
-	CURLcode res;
-
 	std::wstring mapFilePathWide(getCustomMapFolderPath());
-	std::string nonUnicodeMapFilePath(mapFilePathWide.begin(), mapFilePathWide.end());
-	nonUnicodeMapFilePath += m_clientMapFilename;
-
-	curl = curl_interface_init_no_verify();
-	if (curl) {
-		fp = fopen(nonUnicodeMapFilePath.c_str(), "wb");
-		if (fp == nullptr) {
-			LOG_TRACE_GAME("{} - unable to open map file at: {}", __FUNCTION__, nonUnicodeMapFilePath.c_str());
-			curl_easy_cleanup(curl);
-			return false;
+	std::wstring mapFilePath(mapFilePathWide + m_clientMapFilenameWide);
+	// the map is downloaded into the part file and only moved in place once complete
+	std::wstring partFilePath(mapFilePath + L".part");
+	std::wstring stateFilePath(mapFilePath + L".part.state");
+
+	char *url_encoded_map_filename = curl_easy_escape(NULL, m_clientMapFilename.c_str(), m_clientMapFilename.length());
+	url += url_encoded_map_filename;
+	curl_free(url_encoded_map_filename);
+
+	s_map_download download;
+	download.query = this;
+	download.url = url;
+	download.file_size = NONE;
+	download.file_time = NONE;
+	download.accepts_ranges = false;
+	download.range_ignored = false;
+	download.file = nullptr;
+	download.write_offset = NONE;
+	for (auto& segment : download.segments) {
+		segment.download = &download;
+		segment.pending = false;
+		segment.finished = false;
+		segment.result = CURLE_OK;
+		segment.response_code = 0;
+	}
+
+	CURLcode res = map_download_probe(&download);
+	if (res == CURLE_HTTP_RETURNED_ERROR) {
+		// some servers reject HEAD requests (e.g. 405), the size is unknown then so the map is downloaded in one request
+		// whether the map exists is decided by the download itself
+		LOG_TRACE_GAME("{} - probing {} was rejected, downloading without it", __FUNCTION__, url);
+	}
+	else if (res != CURLE_OK) {
+		LOG_ERROR_GAME("{} - probing {} failed with error: {}", __FUNCTION__, url, res);
+		return false;
+	}
+
+	bool resumed = download.accepts_ranges && map_download_load_state(&download, stateFilePath);
+	if (!resumed)
+		map_download_plan_segments(&download);
+
+	download.file = _wfopen(partFilePath.c_str(), resumed ? L"r+b" : L"wb");
+	if (download.file == nullptr && resumed) {
+		// the state outlived the part file
+		resumed = false;
+		map_download_plan_segments(&download);
+		download.file = _wfopen(partFilePath.c_str(), L"wb");
+	}
+	if (download.file == nullptr) {
+		LOG_TRACE_GAME("{} - unable to open map file at: {}", __FUNCTION__, std::string(partFilePath.begin(), partFilePath.end()));
+		return false;
+	}
+
+	LOG_TRACE_GAME("{} - downloading {} bytes in {} segment(s){}", __FUNCTION__, download.file_size, download.segment_count, resumed ? ", resumed" : "");
+
+	bool downloaded = false;
+	bool missing = false;
+	for (int attempt = 0; attempt < MAP_DOWNLOAD_MAX_ATTEMPTS && !ShouldStopDownload(); attempt++) {
+		if (download.range_ignored) {
+			// fall back to a single request for the whole map
+			LOG_TRACE_GAME("{} - server ignored the range request, downloading in one piece", __FUNCTION__);
+			download.accepts_ranges = false;
+			download.range_ignored = false;
+			map_download_plan_segments(&download);
+			_wremove(stateFilePath.c_str());
 		}
 
-		char *url_encoded_map_filename = curl_easy_escape(curl, m_clientMapFilename.c_str(), m_clientMapFilename.length());
-		url += url_encoded_map_filename;
-		curl_free(url_encoded_map_filename);
-
-		//fail if 404 or any other type of http error
-		curl_easy_setopt(curl, CURLOPT_FAILONERROR, true);
-		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo);
-		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
-		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-		res = curl_easy_perform(curl);
-		long http_code = 0;
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-		fclose(fp);
+		for (int i = 0; i < download.segment_count; i++) {
+			if (!download.segments[i].is_complete())
+				map_download_start_segment(&download.segments[i]);
+		}
 
-		if (res == CURLE_OK)
 		{
-			if (http_code != 404 && getCustomMapData()->add_custom_map_entry_by_map_file_path(mapFilePathWide + m_clientMapFilenameWide)) {
-				//if we succesfully downloaded the map, return true
-				return true;
+			std::unique_lock lock(download.mutex);
+			auto segments_pending = [&download]() {
+				for (int i = 0; i < download.segment_count; i++) {
+					if (download.segments[i].pending)
+						return true;
+				}
+				return false;
+			};
+
+			while (segments_pending()) {
+				if (!download.cv.wait_for(lock, MAP_DOWNLOAD_STATE_SAVE_INTERVAL, [&]() { return !segments_pending(); })
+					&& download.accepts_ranges) {
+					lock.unlock();
+					map_download_save_state(&download, stateFilePath);
+					lock.lock();
+				}
+			}
+		}
+
+		bool complete = true;
+		for (int i = 0; i < download.segment_count; i++) {
+			const s_map_download_segment& segment = download.segments[i];
+			if (!segment.is_complete()) {
+				complete = false;
+				LOG_ERROR_GAME("{} - segment {} failed with error: {} (HTTP {}), attempt {}/{}", __FUNCTION__, i, segment.result, segment.response_code, attempt + 1, MAP_DOWNLOAD_MAX_ATTEMPTS);
+				if (segment.result == CURLE_HTTP_RETURNED_ERROR && segment.response_code == 404)
+					missing = true;
 			}
-			return false;
 		}
-		else
-		{
-			LOG_ERROR_GAME("{} - {} failed with error: {}", __FUNCTION__, STRINGIFY(curl_easy_perform()), res);
-			if (res == CURLE_ABORTED_BY_CALLBACK)
-				addDebugText("Map downloading aborted because of user input!");
-			
-			remove(nonUnicodeMapFilePath.c_str());
 
-			return false;
+		if (complete) {
+			downloaded = true;
+			break;
 		}
+
+		// no point in retrying
+		if (missing)
+			break;
+
+		if (download.accepts_ranges)
+			map_download_save_state(&download, stateFilePath);
 	}
 
-	return false;
+	fclose(download.file);
+	SetDownloadPercentage(downloaded ? 100 : 0);
+
+	if (!downloaded) {
+		if (ShouldStopDownload())
+			addDebugText("Map downloading aborted because of user input!");
+		else if (missing)
+			addDebugText(MAP_DOESNT_EXIST_IN_REPO);
+
+		// keep what we have if it can be resumed later
+		if (!download.accepts_ranges)
+			_wremove(partFilePath.c_str());
+		return false;
+	}
+
+	_wremove(stateFilePath.c_str());
+	if (!MoveFileExW(partFilePath.c_str(), mapFilePath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		LOG_ERROR_GAME("{} - failed to move the downloaded map in place, error: {}", __FUNCTION__, GetLastError());
+		_wremove(partFilePath.c_str());
+		return false;
+	}
+
+	//if we succesfully downloaded the map, return true
+	return getCustomMapData()->add_custom_map_entry_by_map_file_path(mapFilePath);
 }
 
 void MapDownloadQuery::StartMapDownload()
@@ -0,0 +1,475 @@
+#include "stdafx.h"
+
+#include "NetworkTelemetry.h"
+
+#include "H2MOD/GUI/imgui_integration/Console/ImGui_ConsoleImpl.h"
+#include "H2MOD/Modules/EventHandler/EventHandler.hpp"
+#include "H2MOD/Modules/Shell/Config.h"
+#include "H2MOD/Modules/Shell/Shell.h"
+#include "H2MOD/Modules/Shell/Startup/Startup.h"
+
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include <atomic>
+
+// peer indices past the session peers are counted here, e.g. out-of-band messages from machines without a peer
+#define NETWORK_TELEMETRY_UNKNOWN_PEER_BUCKET NETWORK_SESSION_PEERS_MAX
+#define NETWORK_TELEMETRY_PEER_BUCKET_COUNT (NETWORK_SESSION_PEERS_MAX + 1)
+
+#define NETWORK_TELEMETRY_MESSAGE_TYPE_COUNT ((int)_network_message_type_collection_end)
+
+// bucket n counts the latencies below 2^n ms, the last one everything above
+#define NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT 13
+
+// requests that never get a response are dropped, oldest first
+#define NETWORK_TELEMETRY_PENDING_REQUEST_MAX 32
+
+#define NETWORK_TELEMETRY_SNAPSHOT_FILE_NAME L"network_telemetry_instance%d.json"
+
+struct s_network_telemetry_request_pair
+{
+	e_network_message_type_collection request;
+	e_network_message_type_collection response;
+};
+
+// only pairs the mod sends the request of itself can be measured, the game sends its own messages without going through us
+static const s_network_telemetry_request_pair network_telemetry_request_pairs[] = {
+	{ _request_map_filename, _custom_map_filename },
+};
+
+#define NETWORK_TELEMETRY_REQUEST_PAIR_COUNT ((int)ARRAYSIZE(network_telemetry_request_pairs))
+
+#pragma region counters
+struct s_network_telemetry_counter
+{
+	std::atomic<unsigned long long> messages;
+	std::atomic<unsigned long long> bytes;
+};
+
+struct s_network_telemetry_latency
+{
+	std::atomic<unsigned long long> buckets[NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT];
+	std::atomic<unsigned long long> total_usec;
+};
+
+// written only by the thread that owns it, read by everyone that sums up the counters
+struct s_network_telemetry_counters
+{
+	s_network_telemetry_counter messages[k_network_telemetry_direction_count][NETWORK_TELEMETRY_PEER_BUCKET_COUNT][NETWORK_TELEMETRY_MESSAGE_TYPE_COUNT];
+	s_network_telemetry_latency latency[NETWORK_TELEMETRY_REQUEST_PAIR_COUNT];
+};
+
+// same layout as above, summed up from all the threads
+struct s_network_telemetry_totals
+{
+	struct
+	{
+		unsigned long long messages;
+		unsigned long long bytes;
+	} messages[k_network_telemetry_direction_count][NETWORK_TELEMETRY_PEER_BUCKET_COUNT][NETWORK_TELEMETRY_MESSAGE_TYPE_COUNT];
+
+	struct
+	{
+		unsigned long long buckets[NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT];
+		unsigned long long total_usec;
+	} latency[NETWORK_TELEMETRY_REQUEST_PAIR_COUNT];
+};
+
+// hands the counters back once the thread exits, the next thread that records something picks them up
+// the counts stay in, the totals are summed over all the counters ever allocated
+struct s_network_telemetry_thread_counters
+{
+	s_network_telemetry_counters* counters = nullptr;
+	~s_network_telemetry_thread_counters();
+};
+
+static std::mutex network_telemetry_counters_mutex;
+// both guarded by network_telemetry_counters_mutex
+static std::vector<s_network_telemetry_counters*> network_telemetry_counters;
+static std::vector<s_network_telemetry_counters*> network_telemetry_free_counters;
+
+static thread_local s_network_telemetry_thread_counters network_telemetry_thread_counters;
+
+s_network_telemetry_thread_counters::~s_network_telemetry_thread_counters()
+{
+	if (counters == nullptr)
+		return;
+
+	std::lock_guard lg(network_telemetry_counters_mutex);
+	network_telemetry_free_counters.push_back(counters);
+	counters = nullptr;
+}
+
+static s_network_telemetry_counters* network_telemetry_get_thread_counters()
+{
+	s_network_telemetry_thread_counters* thread_counters = &network_telemetry_thread_counters;
+	if (thread_counters->counters != nullptr)
+		return thread_counters->counters;
+
+	std::lock_guard lg(network_telemetry_counters_mutex);
+	if (!network_telemetry_free_counters.empty())
+	{
+		thread_counters->counters = network_telemetry_free_counters.back();
+		network_telemetry_free_counters.pop_back();
+	}
+	else
+	{
+		// value-initialized, starts with all the counts zeroed
+		thread_counters->counters = new s_network_telemetry_counters();
+		network_telemetry_counters.push_back(thread_counters->counters);
+	}
+
+	return thread_counters->counters;
+}
+
+static void network_telemetry_counter_add(std::atomic<unsigned long long>& counter, unsigned long long value)
+{
+	// the owning thread is the only writer, the increment doesn't need to be a locked read-modify-write
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static void network_telemetry_get_totals(s_network_telemetry_totals* totals)
+{
+	memset(totals, 0, sizeof(s_network_telemetry_totals));
+
+	std::lock_guard lg(network_telemetry_counters_mutex);
+	for (s_network_telemetry_counters* counters : network_telemetry_counters)
+	{
+		for (int direction = 0; direction < k_network_telemetry_direction_count; direction++)
+		{
+			for (int peer = 0; peer < NETWORK_TELEMETRY_PEER_BUCKET_COUNT; peer++)
+			{
+				for (int type = 0; type < NETWORK_TELEMETRY_MESSAGE_TYPE_COUNT; type++)
+				{
+					totals->messages[direction][peer][type].messages += counters->messages[direction][peer][type].messages.load(std::memory_order_relaxed);
+					totals->messages[direction][peer][type].bytes += counters->messages[direction][peer][type].bytes.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		for (int pair = 0; pair < NETWORK_TELEMETRY_REQUEST_PAIR_COUNT; pair++)
+		{
+			for (int bucket = 0; bucket < NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT; bucket++)
+				totals->latency[pair].buckets[bucket] += counters->latency[pair].buckets[bucket].load(std::memory_order_relaxed);
+			totals->latency[pair].total_usec += counters->latency[pair].total_usec.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+static int network_telemetry_get_peer_bucket(int peer_index)
+{
+	return peer_index >= 0 && peer_index < NETWORK_SESSION_PEERS_MAX ? peer_index : NETWORK_TELEMETRY_UNKNOWN_PEER_BUCKET;
+}
+
+static int network_telemetry_get_latency_bucket(unsigned long long latency_usec)
+{
+	unsigned long long latency_msec = latency_usec / 1000;
+	int bucket = 0;
+	while (latency_msec != 0 && bucket < NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT - 1)
+	{
+		latency_msec >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void NetworkTelemetry::RecordMessage(e_network_telemetry_direction direction, int peer_index, e_network_message_type_collection message_type, int size)
+{
+	// the enum is unsigned, negative types only show up through the cast
+	if ((int)message_type < 0 || message_type >= _network_message_type_collection_end)
+		return;
+
+	s_network_telemetry_counter* counter = &network_telemetry_get_thread_counters()->messages[direction][network_telemetry_get_peer_bucket(peer_index)][message_type];
+	network_telemetry_counter_add(counter->messages, 1);
+	network_telemetry_counter_add(counter->bytes, size > 0 ? size : 0);
+}
+#pragma endregion
+
+#pragma region request latency
+struct s_network_telemetry_pending_request
+{
+	int pair_index;
+	int peer_index;
+	int request_id;
+	LARGE_INTEGER sent_counter;
+};
+
+// requests are rare compared to the rest of the traffic, a lock is fine here
+static std::mutex network_telemetry_pending_requests_mutex;
+static std::deque<s_network_telemetry_pending_request> network_telemetry_pending_requests;
+
+static int network_telemetry_get_request_pair_index(e_network_message_type_collection message_type, bool response)
+{
+	for (int i = 0; i < NETWORK_TELEMETRY_REQUEST_PAIR_COUNT; i++)
+	{
+		if ((response ? network_telemetry_request_pairs[i].response : network_telemetry_request_pairs[i].request) == message_type)
+			return i;
+	}
+	return NONE;
+}
+
+void NetworkTelemetry::RecordRequestSent(e_network_message_type_collection request_type, int peer_index, int request_id)
+{
+	int pair_index = network_telemetry_get_request_pair_index(request_type, false);
+	if (pair_index == NONE)
+		return;
+
+	s_network_telemetry_pending_request pending_request;
+	pending_request.pair_index = pair_index;
+	pending_request.peer_index = peer_index;
+	pending_request.request_id = request_id;
+	QueryPerformanceCounter(&pending_request.sent_counter);
+
+	std::lock_guard lg(network_telemetry_pending_requests_mutex);
+	if (network_telemetry_pending_requests.size() >= NETWORK_TELEMETRY_PENDING_REQUEST_MAX)
+		network_telemetry_pending_requests.pop_front();
+	network_telemetry_pending_requests.push_back(pending_request);
+}
+
+void NetworkTelemetry::RecordResponseReceived(e_network_message_type_collection response_type, int peer_index, int request_id)
+{
+	int pair_index = network_telemetry_get_request_pair_index(response_type, true);
+	if (pair_index == NONE)
+		return;
+
+	LARGE_INTEGER received_counter;
+	QueryPerformanceCounter(&received_counter);
+
+	LARGE_INTEGER sent_counter;
+	{
+		std::lock_guard lg(network_telemetry_pending_requests_mutex);
+		auto it = std::find_if(network_telemetry_pending_requests.begin(), network_telemetry_pending_requests.end(),
+			[=](const s_network_telemetry_pending_request& pending_request) {
+				return pending_request.pair_index == pair_index
+					&& pending_request.peer_index == peer_index
+					&& pending_request.request_id == request_id;
+			});
+
+		// unsolicited or the request got dropped
+		if (it == network_telemetry_pending_requests.end())
+			return;
+
+		sent_counter = it->sent_counter;
+		network_telemetry_pending_requests.erase(it);
+	}
+
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+
+	LARGE_INTEGER elapsed;
+	elapsed.QuadPart = received_counter.QuadPart - sent_counter.QuadPart;
+	unsigned long long latency_usec = _Shell::QPCToTime(std::micro::den, elapsed, freq);
+
+	s_network_telemetry_latency* latency = &network_telemetry_get_thread_counters()->latency[pair_index];
+	network_telemetry_counter_add(latency->buckets[network_telemetry_get_latency_bucket(latency_usec)], 1);
+	network_telemetry_counter_add(latency->total_usec, latency_usec);
+}
+#pragma endregion
+
+#pragma region readout
+static const char* network_telemetry_direction_name[k_network_telemetry_direction_count] = {
+	"received",
+	"sent"
+};
+
+void NetworkTelemetry::LogToConsole(ConsoleLog* output)
+{
+	auto totals = std::make_unique<s_network_telemetry_totals>();
+	network_telemetry_get_totals(totals.get());
+
+	output->Output(StringFlag_None, "# network messages (sizes are decoded message sizes, sent only counts the mod's messages):");
+	for (int type = 0; type < NETWORK_TELEMETRY_MESSAGE_TYPE_COUNT; type++)
+	{
+		unsigned long long messages[k_network_telemetry_direction_count] = {};
+		unsigned long long bytes[k_network_telemetry_direction_count] = {};
+		for (int direction = 0; direction < k_network_telemetry_direction_count; direction++)
+		{
+			for (int peer = 0; peer < NETWORK_TELEMETRY_PEER_BUCKET_COUNT; peer++)
+			{
+				messages[direction] += totals->messages[direction][peer][type].messages;
+				bytes[direction] += totals->messages[direction][peer][type].bytes;
+			}
+		}
+
+		if (messages[_network_telemetry_direction_received] == 0 && messages[_network_telemetry_direction_sent] == 0)
+			continue;
+
+		output->Output(StringFlag_None, "	%s: received %llu (%llu bytes), sent %llu (%llu bytes)", GetNetworkMessageName(type),
+			messages[_network_telemetry_direction_received], bytes[_network_telemetry_direction_received],
+			messages[_network_telemetry_direction_sent], bytes[_network_telemetry_direction_sent]);
+	}
+
+	output->Output(StringFlag_None, "# network messages per peer:");
+	for (int peer = 0; peer < NETWORK_TELEMETRY_PEER_BUCKET_COUNT; peer++)
+	{
+		unsigned long long messages[k_network_telemetry_direction_count] = {};
+		unsigned long long bytes[k_network_telemetry_direction_count] = {};
+		for (int direction = 0; direction < k_network_telemetry_direction_count; direction++)
+		{
+			for (int type = 0; type < NETWORK_TELEMETRY_MESSAGE_TYPE_COUNT; type++)
+			{
+				messages[direction] += totals->messages[direction][peer][type].messages;
+				bytes[direction] += totals->messages[direction][peer][type].bytes;
+			}
+		}
+
+		if (messages[_network_telemetry_direction_received] == 0 && messages[_network_telemetry_direction_sent] == 0)
+			continue;
+
+		std::string peer_name = peer == NETWORK_TELEMETRY_UNKNOWN_PEER_BUCKET ? "unknown" : std::to_string(peer);
+		output->Output(StringFlag_None, "	peer %s: received %llu (%llu bytes), sent %llu (%llu bytes)", peer_name.c_str(),
+			messages[_network_telemetry_direction_received], bytes[_network_telemetry_direction_received],
+			messages[_network_telemetry_direction_sent], bytes[_network_telemetry_direction_sent]);
+	}
+
+	output->Output(StringFlag_None, "# request latency:");
+	for (int pair = 0; pair < NETWORK_TELEMETRY_REQUEST_PAIR_COUNT; pair++)
+	{
+		unsigned long long count = 0;
+		std::string buckets;
+		for (int bucket = 0; bucket < NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT; bucket++)
+		{
+			unsigned long long bucket_count = totals->latency[pair].buckets[bucket];
+			count += bucket_count;
+			if (bucket_count == 0)
+				continue;
+
+			if (bucket < NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT - 1)
+				buckets += " <" + std::to_string(1 << bucket) + "ms: " + std::to_string(bucket_count);
+			else
+				buckets += " >=" + std::to_string(1 << (bucket - 1)) + "ms: " + std::to_string(bucket_count);
+		}
+
+		output->Output(StringFlag_None, "	%s -> %s: %llu responses, avg %.2f ms%s",
+			GetNetworkMessageName(network_telemetry_request_pairs[pair].request), GetNetworkMessageName(network_telemetry_request_pairs[pair].response),
+			count, count != 0 ? (double)totals->latency[pair].total_usec / count / 1000.0 : 0.0, buckets.c_str());
+	}
+}
+
+bool NetworkTelemetry::WriteSnapshot()
+{
+	auto totals = std::make_unique<s_network_telemetry_totals>();
+	network_telemetry_get_totals(totals.get());
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+	writer.Key("time");
+	writer.Int64(time(nullptr));
+	writer.Key("instance");
+	writer.Int(_Shell::GetInstanceId());
+
+	// only the non-zero counters, peer -1 is the unknown peer
+	writer.Key("messages");
+	writer.StartArray();
+	for (int direction = 0; direction < k_network_telemetry_direction_count; direction++)
+	{
+		for (int peer = 0; peer < NETWORK_TELEMETRY_PEER_BUCKET_COUNT; peer++)
+		{
+			for (int type = 0; type < NETWORK_TELEMETRY_MESSAGE_TYPE_COUNT; type++)
+			{
+				if (totals->messages[direction][peer][type].messages == 0)
+					continue;
+
+				writer.StartObject();
+				writer.Key("type");
+				writer.String(GetNetworkMessageName(type));
+				writer.Key("direction");
+				writer.String(network_telemetry_direction_name[direction]);
+				writer.Key("peer");
+				writer.Int(peer == NETWORK_TELEMETRY_UNKNOWN_PEER_BUCKET ? NONE : peer);
+				writer.Key("count");
+				writer.Uint64(totals->messages[direction][peer][type].messages);
+				writer.Key("bytes");
+				writer.Uint64(totals->messages[direction][peer][type].bytes);
+				writer.EndObject();
+			}
+		}
+	}
+	writer.EndArray();
+
+	// buckets[n] counts the latencies below bucket_bounds_ms[n], the last bucket the ones above the last bound
+	writer.Key("latency");
+	writer.StartArray();
+	for (int pair = 0; pair < NETWORK_TELEMETRY_REQUEST_PAIR_COUNT; pair++)
+	{
+		writer.StartObject();
+		writer.Key("request");
+		writer.String(GetNetworkMessageName(network_telemetry_request_pairs[pair].request));
+		writer.Key("response");
+		writer.String(GetNetworkMessageName(network_telemetry_request_pairs[pair].response));
+		writer.Key("total_usec");
+		writer.Uint64(totals->latency[pair].total_usec);
+		writer.Key("bucket_bounds_ms");
+		writer.StartArray();
+		for (int bucket = 0; bucket < NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT - 1; bucket++)
+			writer.Int(1 << bucket);
+		writer.EndArray();
+		writer.Key("buckets");
+		writer.StartArray();
+		for (int bucket = 0; bucket < NETWORK_TELEMETRY_LATENCY_BUCKET_COUNT; bucket++)
+			writer.Uint64(totals->latency[pair].buckets[bucket]);
+		writer.EndArray();
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	wchar_t file_name[64];
+	swprintf(file_name, ARRAYSIZE(file_name), NETWORK_TELEMETRY_SNAPSHOT_FILE_NAME, _Shell::GetInstanceId());
+	std::wstring snapshot_path = std::wstring(H2AppDataLocal) + file_name;
+	std::wstring temp_path = snapshot_path + L".tmp";
+
+	// written next to the snapshot first, so whoever reads it never sees a partial file
+	{
+		std::ofstream of(temp_path, std::ios::binary | std::ios::trunc);
+		of.write(buffer.GetString(), buffer.GetSize());
+		if (!of.good())
+		{
+			LOG_ERROR_NETWORK("{} failed to write the network telemetry snapshot", __FUNCTION__);
+			return false;
+		}
+	}
+
+	if (!MoveFileExW(temp_path.c_str(), snapshot_path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		LOG_ERROR_NETWORK("{} failed to replace the network telemetry snapshot, error: {}", __FUNCTION__, GetLastError());
+		return false;
+	}
+
+	return true;
+}
+#pragma endregion
+
+#pragma region periodic snapshot
+static long long network_telemetry_snapshot_interval_msec = 0;
+static long long network_telemetry_next_snapshot_msec = 0;
+
+static void network_telemetry_on_game_loop()
+{
+	if (network_telemetry_snapshot_interval_msec <= 0)
+		return;
+
+	long long now_msec = _Shell::QPCToTimeNowMsec();
+	if (now_msec < network_telemetry_next_snapshot_msec)
+		return;
+
+	network_telemetry_next_snapshot_msec = now_msec + network_telemetry_snapshot_interval_msec;
+	NetworkTelemetry::WriteSnapshot();
+}
+
+void NetworkTelemetry::SetSnapshotInterval(int seconds)
+{
+	network_telemetry_snapshot_interval_msec = (long long)(std::max)(seconds, 0) * std::milli::den;
+	// the first snapshot goes out with the next frame
+	network_telemetry_next_snapshot_msec = 0;
+}
+
+void NetworkTelemetry::Initialize()
+{
+	SetSnapshotInterval(H2Config_network_telemetry_snapshot_interval);
+	EventHandler::register_callback<EventType::game_loop>(network_telemetry_on_game_loop, EventExecutionType::execute_after);
+}
+#pragma endregion
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Blam/Engine/Networking/NetworkMessageTypeCollection.h"
+
+class ConsoleLog;
+
+enum e_network_telemetry_direction
+{
+	_network_telemetry_direction_received,
+	_network_telemetry_direction_sent,
+
+	k_network_telemetry_direction_count
+};
+
+namespace NetworkTelemetry
+{
+	// counts the message on the calling thread's counters, peer_index NONE is counted as an unknown peer
+	// size is the decoded message size, the same size the game hands over to the message handlers
+	void RecordMessage(e_network_telemetry_direction direction, int peer_index, e_network_message_type_collection message_type, int size);
+
+	// request_id tells apart the requests pending for the same peer, e.g. the map download id
+	// only the request/response pairs known to the telemetry are measured, the others are ignored
+	void RecordRequestSent(e_network_message_type_collection request_type, int peer_index, int request_id);
+	void RecordResponseReceived(e_network_message_type_collection response_type, int peer_index, int request_id);
+
+	void LogToConsole(ConsoleLog* output);
+	bool WriteSnapshot();
+
+	// 0 disables the periodic snapshot file
+	void SetSnapshotInterval(int seconds);
+	void Initialize();
+}
@@ -66,6 +66,7 @@ int H2Config_additional_pcr_time = 25;
 bool H2Config_debug_log = false;
 int H2Config_debug_log_level = 2;
 bool H2Config_debug_log_console = false;
+int H2Config_network_telemetry_snapshot_interval = 0;
 char H2Config_login_identifier[255] = { "" };
 char H2Config_login_password[255] = { "" };
 int H2Config_minimum_player_start = 0;
@@ -339,6 +340,11 @@ void SaveH2Config() {
 			"# debug_log_console Options:"
 			"\n# 0 - Disables console window logging."
 			"\n# 1 - Enables console window logging, will display all output from all loggers."
+			"\n\n"
+
+			"# network_telemetry_snapshot_interval Options:"
+			"\n# <uint> - Interval in seconds at which the network message counters are written to network_telemetry_instance<id>.json, next to the logs folder."
+			"\n# 0 - Disables the snapshot file."
 			"\n\n";
 
 		if (H2IsDediServer) {
@@ -548,6 +554,8 @@ void SaveH2Config() {
 
 		ini.SetBoolValue(H2ConfigVersionSection.c_str(), "debug_log_console", H2Config_debug_log_console);
 
+		ini.SetLongValue(H2ConfigVersionSection.c_str(), "network_telemetry_snapshot_interval", H2Config_network_telemetry_snapshot_interval);
+
 		if (H2IsDediServer) {
 			ini.SetValue(H2ConfigVersionSection.c_str(), "server_name", H2Config_dedi_server_name);
 
@@ -671,6 +679,7 @@ void ReadH2Config() {
 			H2Config_debug_log = ini.GetBoolValue(H2ConfigVersionSection.c_str(), "debug_log", H2Config_debug_log);
 			H2Config_debug_log_level = ini.GetLongValue(H2ConfigVersionSection.c_str(), "debug_log_level", H2Config_debug_log_level);
 			H2Config_debug_log_console = ini.GetBoolValue(H2ConfigVersionSection.c_str(), "debug_log_console", H2Config_debug_log_console);
+			H2Config_network_telemetry_snapshot_interval = ini.GetLongValue(H2ConfigVersionSection.c_str(), "network_telemetry_snapshot_interval", H2Config_network_telemetry_snapshot_interval);
 
 			const char* ip_wan = ini.GetValue(H2ConfigVersionSection.c_str(), "wan_ip");
 			if (ip_wan
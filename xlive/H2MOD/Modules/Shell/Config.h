@@ -98,6 +98,7 @@ extern int H2Config_additional_pcr_time;
 extern bool H2Config_debug_log;
 extern int H2Config_debug_log_level;
 extern bool H2Config_debug_log_console;
+extern int H2Config_network_telemetry_snapshot_interval;
 extern char H2Config_login_identifier[255];
 extern char H2Config_login_password[255];
 extern short H2Config_team_bit_flags;
@@ -18,6 +18,7 @@
 #include "Util/filesys.h"
 #include "Util/hash.h"
 #include "Util/Hooks/Hook.h"
+#include "XLive/XOverlapped/XOverlapped.h"
 
 namespace filesystem = std::filesystem;
 
@@ -402,5 +403,7 @@ void DeinitH2Startup() {
 	H2Tweaks::DisposePatches();
 	DeinitH2Accounts();
 	DeinitH2Config();
+	xoverlapped_shutdown();
+	curl_interface_shutdown();
 	curl_global_cleanup();
 }
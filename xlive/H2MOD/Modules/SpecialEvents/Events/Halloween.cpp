@@ -99,6 +99,11 @@ void halloween_game_life_cycle_update(e_game_life_cycle state)
 	}
 }
 
+void halloween_blue_screen()
+{
+	halloween_game_life_cycle_update(_life_cycle_in_game);
+}
+
 void halloween_event_map_load()
 {
 	// Load specific tags from shared and modify placements depending on the map being played
@@ -153,9 +158,9 @@ void halloween_event_map_load()
 		// Add items to scenario
 		if (!DATUM_IS_NONE(candle_datum) && !DATUM_IS_NONE(pump_datum) && !DATUM_IS_NONE(large_candle_datum))
 		{
-			EventHandler::register_callback(halloween_game_life_cycle_update, EventType::gamelifecycle_change, EventExecutionType::execute_after, true);
+			EventHandler::register_callback<EventType::gamelifecycle_change>(halloween_game_life_cycle_update, EventExecutionType::execute_after, true);
 			// We execute this after a bluescreen since our new objects arent recreated automatically
-			EventHandler::register_callback(halloween_game_life_cycle_update, EventType::blue_screen, EventExecutionType::execute_after, true);
+			EventHandler::register_callback<EventType::blue_screen>(halloween_blue_screen, EventExecutionType::execute_after, true);
 		}
 	}
 	else if (!strcmp(cache_header->name, "lockout"))
@@ -178,9 +183,9 @@ void halloween_event_map_load()
 
 		if (!DATUM_IS_NONE(candle_datum) && !DATUM_IS_NONE(pump_datum))
 		{
-			EventHandler::register_callback(halloween_game_life_cycle_update, EventType::gamelifecycle_change, EventExecutionType::execute_after, true);
+			EventHandler::register_callback<EventType::gamelifecycle_change>(halloween_game_life_cycle_update, EventExecutionType::execute_after, true);
 			// We execute this after a bluescreen since our new objects arent recreated automatically
-			EventHandler::register_callback(halloween_game_life_cycle_update, EventType::blue_screen, EventExecutionType::execute_after, true);
+			EventHandler::register_callback<EventType::blue_screen>(halloween_blue_screen, EventExecutionType::execute_after, true);
 		}
 	}
 }
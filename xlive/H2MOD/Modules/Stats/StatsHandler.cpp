@@ -10,6 +10,8 @@
 
 #include "Util/hash.h"
 
+#include <condition_variable>
+
 bool MatchInvalidated = false;
 StatsHandler::StatsAPIRegisteredStatus Status;
 
@@ -32,85 +34,379 @@ void StatsHandler::Initialize()
 		lastTimeRanksSynchronized = steady_clock::now();
 
 		// server events
-		EventHandler::register_callback(server_command_event, EventType::server_command, EventExecutionType::execute_before);
-		EventHandler::register_callback(network_player_event, EventType::network_player, EventExecutionType::execute_after);
+		EventHandler::register_callback<EventType::server_command>(server_command_event, EventExecutionType::execute_before);
+		EventHandler::register_callback<EventType::network_player>(network_player_event, EventExecutionType::execute_after);
 	}
 
-	EventHandler::register_callback(game_life_cycle_update_event, EventType::gamelifecycle_change, EventExecutionType::execute_after);
+	EventHandler::register_callback<EventType::gamelifecycle_change>(game_life_cycle_update_event, EventExecutionType::execute_after);
 }
 
-void StatsHandler::sendStats()
+#pragma region stats upload pipeline
+// max reports waiting in memory for the upload worker, the rest go straight to the spool
+#define STATS_UPLOAD_QUEUE_MAX_COUNT 8
+// the API doesn't say when a token expires, so it's refreshed after this long or when an upload gets rejected
+#define STATS_API_TOKEN_LIFETIME 10min
+#define STATS_UPLOAD_RETRY_MIN_DELAY 30s
+#define STATS_UPLOAD_RETRY_MAX_DELAY 30min
+#define STATS_SPOOL_DIRECTORY L"%wsstats_spool\\"
+
+struct s_stats_report
 {
-	if (!Memory::IsDedicatedServer()
-		|| !getRegisteredStatus().StatsEnabled)
-		return;
+	std::string name;
+	std::string json;
+	std::wstring spool_path; // empty if not spooled yet
+};
 
-	const char* token = getAPIToken();
-	if (token == nullptr) {
-		return;
+enum e_stats_upload_result
+{
+	_stats_upload_success,
+	_stats_upload_retry,
+	_stats_upload_drop,
+};
+
+static std::mutex statsUploadMutex;
+static std::condition_variable statsUploadCondition;
+static std::deque<s_stats_report> statsUploadQueue;
+static bool statsPlaylistCheckPending = false;
+// set when queueReport spooled a report because the queue was full
+static bool statsSpoolDirty = false;
+static bool statsUploadWorkerStarted = false;
+
+// only accessed by the upload worker
+static std::string statsAPIToken;
+static steady_clock::time_point statsAPITokenTime;
+static std::string statsVerifiedPlaylistChecksum;
+
+static const char* getCachedAPIToken()
+{
+	if (statsAPIToken.empty()
+		|| steady_clock::now() - statsAPITokenTime > STATS_API_TOKEN_LIFETIME)
+	{
+		statsAPIToken.clear();
+
+		const char* token = StatsHandler::getAPIToken();
+		if (token == nullptr)
+			return nullptr;
+
+		statsAPIToken = token;
+		statsAPITokenTime = steady_clock::now();
+		free((void*)token);
 	}
 
-	int verifyPlaylistResponse = verifyPlaylist(token);
-	if (verifyPlaylistResponse != 201) {
-		switch (verifyPlaylistResponse)
+	return statsAPIToken.c_str();
+}
+
+static std::wstring getStatsSpoolDirectory()
+{
+	wchar_t spoolDirectory[1024];
+	swprintf(spoolDirectory, ARRAYSIZE(spoolDirectory), STATS_SPOOL_DIRECTORY, H2ProcessFilePath);
+	return spoolDirectory;
+}
+
+// writes the report to the spool, so it survives a failed upload or a server restart
+static bool spoolReport(s_stats_report& report)
+{
+	if (!report.spool_path.empty())
+		return true;
+
+	std::wstring spoolDirectory = getStatsSpoolDirectory();
+	CreateDirectoryW(spoolDirectory.c_str(), NULL);
+
+	std::wstring spoolPath = spoolDirectory + std::wstring(report.name.begin(), report.name.end());
+	std::ofstream of(spoolPath, std::ios::binary | std::ios::trunc);
+	of << report.json;
+	if (!of.good())
+	{
+		LOG_ERROR_GAME("{} failed to spool stats report {}, it will be lost", __FUNCTION__, report.name);
+		return false;
+	}
+
+	report.spool_path = spoolPath;
+	LOG_TRACE_GAME("{} stats report {} spooled for retry", __FUNCTION__, report.name);
+	return true;
+}
+
+// makes sure the API knows the current playlist, only talks to the API again once the playlist changes
+static bool verifySendPlaylistIfChanged()
+{
+	std::string checksum = StatsHandler::getChecksum();
+	if (checksum.empty())
+	{
+		LOG_ERROR_GAME("{} failed to hash playlist file", __FUNCTION__);
+		return false;
+	}
+
+	if (checksum == statsVerifiedPlaylistChecksum)
+		return true;
+
+	const char* token = getCachedAPIToken();
+	if (token == nullptr)
+		return false;
+
+	int verifyPlaylistResponse = StatsHandler::verifyPlaylist(token);
+	switch (verifyPlaylistResponse)
+	{
+	case 201:
+		if (StatsHandler::uploadPlaylist(token) != 200)
 		{
-		case -1:
-		case 500:
-			LOG_ERROR_GAME("[H2MOD] playlist verification encountered a server error code: {}", verifyPlaylistResponse);
-			break;
-		default:
-			LOG_ERROR_GAME("[H2MOD] playlist verification encountered unkown error code: {}", verifyPlaylistResponse);
-			break;
+			LOG_ERROR_GAME("[H2MOD] playlist uploading encountered an error");
+			return false;
 		}
+		statsVerifiedPlaylistChecksum = checksum;
+		return true;
+	case -1:
+	case 500:
+		LOG_ERROR_GAME("[H2MOD] playlist verification encountered a server error code: {}", verifyPlaylistResponse);
+		return false;
+	default:
+		LOG_ERROR_GAME("[H2MOD] playlist verification encountered unkown error code: {}", verifyPlaylistResponse);
+		return false;
+	}
+}
 
-		return;
+static e_stats_upload_result uploadReport(const s_stats_report& report)
+{
+	// reports are only accepted for playlists the API knows
+	if (!verifySendPlaylistIfChanged())
+		return _stats_upload_retry;
+
+	const char* token = getCachedAPIToken();
+	if (token == nullptr)
+		return _stats_upload_retry;
+
+	int response_code = StatsHandler::uploadStats(report.json, report.name, token);
+	switch (response_code)
+	{
+	case 200:
+		LOG_TRACE_GAME("[H2MOD] stats report {} uploaded successfully", report.name);
+		return _stats_upload_success;
+
+	case 401:
+	case 403:
+		// token expired early, get a new one next time
+		statsAPIToken.clear();
+		return _stats_upload_retry;
+
+	default:
+		// the API rejected the report itself, retrying won't help
+		if (response_code >= 400 && response_code < 500)
+		{
+			LOG_ERROR_GAME("[H2MOD] stats report {} rejected, response code: {}", report.name, response_code);
+			return _stats_upload_drop;
+		}
+
+		LOG_ERROR_GAME("[H2MOD] stats uploading encountered an error, response code: {}", response_code);
+		return _stats_upload_retry;
 	}
+}
+
+// uploads the spooled reports oldest first, stops at the first one that has to be retried
+static e_stats_upload_result uploadSpooledReports()
+{
+	std::wstring spoolDirectory = getStatsSpoolDirectory();
+	std::vector<std::wstring> spoolFiles;
+
+	WIN32_FIND_DATAW findData;
+	HANDLE findHandle = FindFirstFileW((spoolDirectory + L"*.json").c_str(), &findData);
+	if (findHandle == INVALID_HANDLE_VALUE)
+		return _stats_upload_success;
 
-	if (uploadPlaylist(token) != 200) {
-		LOG_ERROR_GAME("[H2MOD] playlist uploading encountered an error");
+	do
+	{
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			spoolFiles.push_back(findData.cFileName);
+	} while (FindNextFileW(findHandle, &findData));
+	FindClose(findHandle);
+
+	// file names end with the match time
+	std::sort(spoolFiles.begin(), spoolFiles.end());
+
+	for (const auto& spoolFile : spoolFiles)
+	{
+		s_stats_report report;
+		report.name = std::string(spoolFile.begin(), spoolFile.end());
+		report.spool_path = spoolDirectory + spoolFile;
+
+		std::ifstream in(report.spool_path, std::ios::binary);
+		report.json.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		in.close();
+
+		if (uploadReport(report) == _stats_upload_retry)
+			return _stats_upload_retry;
+
+		DeleteFileW(report.spool_path.c_str());
 	}
 
-	const char* filepath = buildPostGameCarnageReportJson();
-	if (!strcmp(filepath, ""))
+	return _stats_upload_success;
+}
+
+// single worker that owns the API token and performs all the stats uploads in order
+static void statsUploadWorker()
+{
+	auto retryDelay = duration_cast<steady_clock::duration>(STATS_UPLOAD_RETRY_MIN_DELAY);
+	auto nextSpoolRetry = steady_clock::now();
+	// there might be reports left from a previous run
+	bool spoolPending = true;
+
+	while (true)
 	{
-		LOG_ERROR_GAME("[H2MOD] stats Json failed to build");
-		return;
+		s_stats_report report;
+		bool hasReport = false;
+		bool playlistCheck = false;
+		{
+			std::unique_lock<std::mutex> lock(statsUploadMutex);
+			auto hasWork = [] { return !statsUploadQueue.empty() || statsPlaylistCheckPending; };
+			if (spoolPending)
+				statsUploadCondition.wait_until(lock, nextSpoolRetry, hasWork);
+			else
+				statsUploadCondition.wait(lock, hasWork);
+
+			playlistCheck = statsPlaylistCheckPending;
+			statsPlaylistCheckPending = false;
+			if (statsSpoolDirty)
+			{
+				statsSpoolDirty = false;
+				if (!spoolPending)
+				{
+					spoolPending = true;
+					nextSpoolRetry = steady_clock::now();
+				}
+			}
+			if (!statsUploadQueue.empty())
+			{
+				report = std::move(statsUploadQueue.front());
+				statsUploadQueue.pop_front();
+				hasReport = true;
+			}
+		}
+
+		if (playlistCheck)
+			verifySendPlaylistIfChanged();
+
+		if (hasReport)
+		{
+			switch (uploadReport(report))
+			{
+			case _stats_upload_success:
+				// the API is reachable again, don't wait for the backoff to flush the spool
+				if (report.spool_path.empty())
+					nextSpoolRetry = steady_clock::now();
+				else
+					DeleteFileW(report.spool_path.c_str());
+				break;
+			case _stats_upload_retry:
+				if (spoolReport(report) && !spoolPending)
+				{
+					spoolPending = true;
+					nextSpoolRetry = steady_clock::now() + retryDelay;
+				}
+				break;
+			case _stats_upload_drop:
+				if (!report.spool_path.empty())
+					DeleteFileW(report.spool_path.c_str());
+				break;
+			}
+			continue;
+		}
+
+		if (spoolPending && steady_clock::now() >= nextSpoolRetry)
+		{
+			if (uploadSpooledReports() == _stats_upload_retry)
+			{
+				nextSpoolRetry = steady_clock::now() + retryDelay;
+				retryDelay = (std::min)(retryDelay * 2, duration_cast<steady_clock::duration>(STATS_UPLOAD_RETRY_MAX_DELAY));
+			}
+			else
+			{
+				spoolPending = false;
+				retryDelay = duration_cast<steady_clock::duration>(STATS_UPLOAD_RETRY_MIN_DELAY);
+			}
+		}
 	}
+}
 
-	if (uploadStats(filepath, token) == 200)
+// must be called with statsUploadMutex held
+static void startStatsUploadWorker()
+{
+	if (!statsUploadWorkerStarted)
 	{
-		LOG_TRACE_GAME("[H2MOD] stats uploaded successfully");
+		statsUploadWorkerStarted = true;
+		std::thread(statsUploadWorker).detach();
 	}
-	else
+}
+
+static void queueReport(s_stats_report&& report)
+{
 	{
-		LOG_ERROR_GAME("[H2MOD] stats uploading encountered an error");
+		std::lock_guard lg(statsUploadMutex);
+		startStatsUploadWorker();
+
+		if (statsUploadQueue.size() < STATS_UPLOAD_QUEUE_MAX_COUNT)
+		{
+			statsUploadQueue.push_back(std::move(report));
+			statsUploadCondition.notify_one();
+			return;
+		}
 	}
 
-	// delete the file
-	remove(filepath);
+	// the queue is full, the worker picks it up from the spool once the queue drains
+	// the report is ours, so it's written without holding up the worker and the other producers
+	if (!spoolReport(report))
+		return;
+
+	std::lock_guard lg(statsUploadMutex);
+	statsSpoolDirty = true;
 }
+#pragma endregion
 
-void StatsHandler::verifySendPlaylist()
+void StatsHandler::sendStats()
 {
 	if (!Memory::IsDedicatedServer()
 		|| !getRegisteredStatus().StatsEnabled)
 		return;
 
-	const char* token = getAPIToken();
-	int verifyPlaylistResponse = verifyPlaylist(token);
-	switch (verifyPlaylistResponse)
+	if (MatchInvalidated) {
+		LOG_INFO_GAME("StatsHandler - Match was invalidated and will not be sent to the API");
+		return;
+	}
+
+	s_stats_report report;
+	report.json = buildPostGameCarnageReportJson();
+	if (report.json.empty())
 	{
-	case 201:
-		if (uploadPlaylist(token) != 200) {
-			LOG_ERROR_GAME("[H2MOD] Playlist Uploading encountered an error");
-		}
-		break;
-	case 500:
-	case -1:
-	default:
-		LOG_ERROR_GAME("[H2MOD] Playlist Verification encountered a server error");
-		break;
+		LOG_ERROR_GAME("[H2MOD] stats Json failed to build");
+		return;
 	}
+
+	time_t timer;
+	struct tm y2k = { 0 };
+	double seconds;
+
+	y2k.tm_hour = 0;   y2k.tm_min = 0; y2k.tm_sec = 0;
+	y2k.tm_year = 100; y2k.tm_mon = 0; y2k.tm_mday = 1;
+
+	time(&timer);
+	seconds = difftime(timer, mktime(&y2k));
+	unsigned long long dedcated_server_id = NetworkSession::GetActiveNetworkSession()->membership[0].dedicated_server_xuid;
+
+	char reportName[128];
+	snprintf(reportName, ARRAYSIZE(reportName), "z%llu-%.f.json", dedcated_server_id, seconds);
+	report.name = reportName;
+
+	// uploaded by the stats worker, the game thread never waits on the API
+	queueReport(std::move(report));
+}
+
+void StatsHandler::verifySendPlaylist()
+{
+	if (!Memory::IsDedicatedServer()
+		|| !getRegisteredStatus().StatsEnabled)
+		return;
+
+	std::lock_guard lg(statsUploadMutex);
+	startStatsUploadWorker();
+	statsPlaylistCheckPending = true;
+	statsUploadCondition.notify_one();
 }
 
 void StatsHandler::game_life_cycle_update_event(e_game_life_cycle state)
@@ -198,8 +494,31 @@ const wchar_t* StatsHandler::getPlaylistFile()
 }
 std::string StatsHandler::getChecksum()
 {
-	std::string output;
-	return hashes::calc_file_md5(getPlaylistFile(), output) ? output : "";
+	// the playlist only changes between server runs, hash it again only if its write time changed
+	static std::mutex checksumMutex;
+	static std::wstring checksumPlaylistFile;
+	static FILETIME checksumPlaylistWriteTime;
+	static std::string checksum;
+
+	std::wstring playlistFile(getPlaylistFile());
+	WIN32_FILE_ATTRIBUTE_DATA playlistAttributes;
+	if (!GetFileAttributesExW(playlistFile.c_str(), GetFileExInfoStandard, &playlistAttributes))
+		return "";
+
+	std::lock_guard lg(checksumMutex);
+	if (checksum.empty()
+		|| playlistFile != checksumPlaylistFile
+		|| CompareFileTime(&playlistAttributes.ftLastWriteTime, &checksumPlaylistWriteTime) != 0)
+	{
+		std::string output;
+		if (!hashes::calc_file_md5(playlistFile, output))
+			return "";
+
+		checksum = output;
+		checksumPlaylistFile = playlistFile;
+		checksumPlaylistWriteTime = playlistAttributes.ftLastWriteTime;
+	}
+	return checksum;
 }
 
 struct curl_response_text {
@@ -278,7 +597,7 @@ char* StatsHandler::checkServerRegistration()
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
 
-	curlErr = curl_easy_perform(curl);
+	curlErr = curl_interface_perform(curl);
 	if (curlErr == CURLE_OK)
 	{
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &curl_err);
@@ -353,7 +672,7 @@ bool StatsHandler::serverRegistration(const char* authKey)
 
 	curl_easy_setopt(curl, CURLOPT_URL, "https://www.halo2pc.com/test-pages/CartoStat/API/post.php");
 	curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
-	curl_err = curl_easy_perform(curl);
+	curl_err = curl_interface_perform(curl);
 	if (curl_err == CURLE_OK)
 	{
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
@@ -380,11 +699,6 @@ bool StatsHandler::serverRegistration(const char* authKey)
 
 const char* StatsHandler::getAPIToken()
 {
-	if (MatchInvalidated) {
-		LOG_INFO_GAME("StatsHandler - Match was invalidated and will not be sent to the API");
-		return NULL;
-	}
-
 	CURL* curl;
 	int response_code;
 	CURLcode curl_err;
@@ -414,7 +728,7 @@ const char* StatsHandler::getAPIToken()
 	curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
-	curl_err = curl_easy_perform(curl);
+	curl_err = curl_interface_perform(curl);
 	if (curl_err == CURLE_OK)
 	{
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
@@ -490,7 +804,7 @@ int StatsHandler::uploadPlaylist(const char* token)
 	curl_easy_setopt(curl, CURLOPT_URL, "https://www.halo2pc.com/test-pages/CartoStat/API/post.php");
 	curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
 
-	curl_err = curl_easy_perform(curl);
+	curl_err = curl_interface_perform(curl);
 	if (curl_err == CURLE_OK)
 	{
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
@@ -541,7 +855,7 @@ int StatsHandler::verifyPlaylist(const char* token)
 	//Set the URL for the GET
 	curl_easy_setopt(curl, CURLOPT_URL, http_request_body.c_str());
 
-	curl_err = curl_easy_perform(curl);
+	curl_err = curl_interface_perform(curl);
 	if (curl_err == CURLE_OK)
 	{
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
@@ -557,7 +871,7 @@ int StatsHandler::verifyPlaylist(const char* token)
 	return response_code;
 }
 
-int StatsHandler::uploadStats(const char* filepath, const char* token)
+int StatsHandler::uploadStats(const std::string& json, const std::string& filename, const char* token)
 {
 	CURL* curl;
 	int response_code;
@@ -576,7 +890,9 @@ int StatsHandler::uploadStats(const char* filepath, const char* token)
 	form = curl_mime_init(curl);
 	field = curl_mime_addpart(form);
 	curl_mime_name(field, "file");
-	curl_mime_filedata(field, filepath);
+	// sent as a file upload straight from memory
+	curl_mime_data(field, json.c_str(), json.size());
+	curl_mime_filename(field, filename.c_str());
 	field = curl_mime_addpart(form);
 	curl_mime_name(field, "Type");
 	curl_mime_data(field, "GameStats", CURL_ZERO_TERMINATED);
@@ -587,7 +903,7 @@ int StatsHandler::uploadStats(const char* filepath, const char* token)
 
 	curl_easy_setopt(curl, CURLOPT_URL, "https://www.halo2pc.com/test-pages/CartoStat/API/post.php");
 	curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
-	curl_err = curl_easy_perform(curl);
+	curl_err = curl_interface_perform(curl);
 	if (curl_err == CURLE_OK)
 	{
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
@@ -602,7 +918,7 @@ int StatsHandler::uploadStats(const char* filepath, const char* token)
 	return response_code;
 }
 
-const char* StatsHandler::buildPostGameCarnageReportJson()
+std::string StatsHandler::buildPostGameCarnageReportJson()
 {
 	WDocument document;
 	WValue value;
@@ -873,38 +1189,11 @@ const char* StatsHandler::buildPostGameCarnageReportJson()
 
 	document.AddMember(L"Players", Players, allocator);
 
-	//Export the file
+	//Export the report
 	rapidjson::StringBuffer strbuf;
 	rapidjson::Writer<rapidjson::StringBuffer, rapidjson::UTF16<>> writer(strbuf);
 	document.Accept(writer);
-	std::string json(strbuf.GetString(), strbuf.GetSize());
-
-	wchar_t fileOutPath[1024];
-	time_t timer;
-	struct tm y2k = { 0 };
-	double seconds;
-
-	y2k.tm_hour = 0;   y2k.tm_min = 0; y2k.tm_sec = 0;
-	y2k.tm_year = 100; y2k.tm_mon = 0; y2k.tm_mday = 1;
-
-	time(&timer);
-	seconds = difftime(timer, mktime(&y2k));
-	wchar_t unix[100];
-	unsigned long long dedcated_server_id = NetworkSession::GetActiveNetworkSession()->membership[0].dedicated_server_xuid;
-
-	swprintf(unix, 100, L"%.f", seconds);
-	swprintf(fileOutPath, 1024, L"%wsz%s-%s.json", H2ProcessFilePath, std::to_wstring(dedcated_server_id).c_str(), unix);
-	std::ofstream of(fileOutPath);
-	of << json;
-	if (!of.good())
-	{
-		LOG_ERROR_GAME("{} Failed to write to file", __FUNCTION__);
-	}
-
-	size_t oFileBufSize = (wcslen(fileOutPath) + 1) * sizeof(char);
-	char* oFile = (char*)malloc(oFileBufSize);
-	wcstombs2(fileOutPath, oFile, oFileBufSize);
-	return oFile;
+	return std::string(strbuf.GetString(), strbuf.GetSize());
 }
 
 void StatsHandler::invalidateMatch(bool state)
@@ -1062,7 +1351,7 @@ void StatsHandler::getPlayerRanksByStringList(std::shared_ptr<std::vector<unsign
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
 
-	curl_err = curl_easy_perform(curl);
+	curl_err = curl_interface_perform(curl);
 	if (curl_err == CURLE_OK)
 	{
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
@@ -37,10 +37,10 @@ namespace StatsHandler
 	const char* getAPIToken();
 	int verifyPlaylist(const char* token);
 	int uploadPlaylist(const char* token);
-	const char* buildPostGameCarnageReportJson();
+	std::string buildPostGameCarnageReportJson();
 	std::string getChecksum();
 	const wchar_t* getPlaylistFile();
-	int uploadStats(const char* filepath, const char* token);
+	int uploadStats(const std::string& json, const std::string& filename, const char* token);
 	void playerLeftEvent(int peerIndex);
 	void playerJoinEvent(int peerIndex);
 	void game_life_cycle_update_event(e_game_life_cycle state);
@@ -8,6 +8,12 @@
 #include "H2MOD/Modules/Shell/Startup/Startup.h"
 #include "H2MOD/Utils/Utils.h"
 
+#include "Util/hash.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
 bool fork_cmd_elevate(const wchar_t* cmd, wchar_t* flags = 0) {
 	SHELLEXECUTEINFO shExInfo = { 0 };
 	shExInfo.cbSize = sizeof(shExInfo);
@@ -61,52 +67,10 @@ bool fork_cmd(LPSTR cmd) {
 	return bSuccess;
 }
 
+// updated from the curl executor thread only, read by the progress bar
 long long sizeOfDownload = 0;
 long long sizeOfDownloaded = 0;
 
-static size_t write_data(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-	size_t written = fwrite(ptr, size, nmemb, stream);
-	sizeOfDownloaded += nmemb;
-	return written;
-}
-
-
-static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata) {
-	/* received header is nitems * size long in 'buffer' NOT ZERO TERMINATED */
-	/* 'userdata' is set with CURLOPT_HEADERDATA */
-
-	sscanf(buffer, "Content-Length:%lld", &sizeOfDownload);
-	return nitems * size;
-}
-
-int DownloadFile(const char* url, wchar_t* local_full_path) {
-	sizeOfDownload = sizeOfDownloaded = 0;
-	CURL *curl;
-	FILE *fp;
-	CURLcode res;
-	curl = curl_interface_init_no_verify();
-	if (curl) {
-		CreateDirTree(local_full_path);
-		fp = _wfopen(local_full_path, L"wb");
-		if (!fp) {
-			addDebugText("Failed to obtain FILE* for DL from: %s to: %s", url, local_full_path);
-			return 2;
-		}
-		//FIXME: <Insert Pinned Public Key Here>
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
-		res = curl_easy_perform(curl);
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-		fclose(fp);
-		sizeOfDownload = sizeOfDownloaded = 0;
-		return 0;
-	}
-	return 1;
-}
-
 typedef struct {
 	char need_to_update;
 	bool core_file;
@@ -129,6 +93,14 @@ static const char* H2UpdateLocationsStr[] = { "[Temp]", "[Game]", "[AppData]" };
 static char H2UpdateVersion[30] = "0";
 static char current_location_id = 0;
 
+#define UPDATER_MAX_CHECK_WORKER_COUNT 4u
+#define UPDATER_MAX_DOWNLOAD_ATTEMPTS 3
+
+static HANDLE hThreadDownloader = 0;
+// set by GSDownloadCancel, the downloader thread unwinds on its own instead of getting terminated
+// so it never leaves the crc workers or the curl executor with dangling state
+static std::atomic<bool> updater_cancelled = false;
+
 bool updater_has_files_to_download = false;
 bool updater_has_files_to_install = false;
 
@@ -249,6 +221,8 @@ static int interpretUpdateEntry(char* fileLine, char* version, int lineNumber) {
 }
 
 
+static void UpdateDetailsText();
+
 static void FetchUpdateDetails() {
 	wchar_t* dir_temp = _wgetenv(L"TEMP");
 
@@ -288,6 +262,14 @@ static void FetchUpdateDetails() {
 
 		addDebugText("Interpreted the details.");
 
+		struct s_update_file_check
+		{
+			UpdateFileEntry* entry;
+			wchar_t existing_path[1024 + 260];
+			wchar_t staged_path[1024 + 260];
+		};
+		std::vector<s_update_file_check> files_to_check;
+
 		int entry_count = UpdateFileEntries.size();
 		for (int i = entry_count - 1; i >= 0; i--) {
 			if (!UpdateFileEntries[i]->need_to_update)
@@ -298,8 +280,8 @@ static void FetchUpdateDetails() {
 				}
 			}
 			if (UpdateFileEntries[i]->need_to_update) {
-
-				wchar_t existingfilepath[1024 + 260] = L"";
+				s_update_file_check file_check;
+				file_check.entry = UpdateFileEntries[i];
 
 				wchar_t* existingfpdir = dir_temp_h2;
 				if (UpdateFileEntries[i]->location_id == 1) {
@@ -309,39 +291,65 @@ static void FetchUpdateDetails() {
 					existingfpdir = H2AppDataLocal;
 				}
 
-				swprintf(existingfilepath, ARRAYSIZE(existingfilepath), L"%ws%hs", existingfpdir, UpdateFileEntries[i]->local_name);
-
-				DWORD crc32_file = 0;
-				if (ComputeFileCrc32Hash(existingfilepath, crc32_file)) {
-					if (UpdateFileEntries[i]->crc32 == crc32_file) {
-						UpdateFileEntries[i]->need_to_update = 0;
-						continue;
-					}
-				}
+				swprintf(file_check.existing_path, ARRAYSIZE(file_check.existing_path), L"%ws%hs", existingfpdir, UpdateFileEntries[i]->local_name);
 
 				if (UpdateFileEntries[i]->location_id) {
-					swprintf(existingfilepath, ARRAYSIZE(existingfilepath), L"%ws%hs\\%hs", dir_update, H2UpdateLocationsStr[UpdateFileEntries[i]->location_id], UpdateFileEntries[i]->local_name);
+					swprintf(file_check.staged_path, ARRAYSIZE(file_check.staged_path), L"%ws%hs\\%hs", dir_update, H2UpdateLocationsStr[UpdateFileEntries[i]->location_id], UpdateFileEntries[i]->local_name);
 				}
 				else {
-					swprintf(existingfilepath, ARRAYSIZE(existingfilepath), L"%ws%hs", dir_update, UpdateFileEntries[i]->local_name);
-				}
-
-				if (ComputeFileCrc32Hash(existingfilepath, crc32_file)) {
-					if (UpdateFileEntries[i]->crc32 == crc32_file) {
-						UpdateFileEntries[i]->need_to_update = 1;
-						continue;
-					}
+					swprintf(file_check.staged_path, ARRAYSIZE(file_check.staged_path), L"%ws%hs", dir_update, UpdateFileEntries[i]->local_name);
 				}
 
+				files_to_check.push_back(file_check);
 			}
 		}
+
+		// compare the installed and the already downloaded copy of every file against the listed crc, spread over a few workers
+		std::atomic<size_t> next_check_idx = 0;
+		auto check_worker = [&]()
+		{
+			for (size_t i = next_check_idx++; i < files_to_check.size() && !updater_cancelled; i = next_check_idx++)
+			{
+				s_update_file_check& file_check = files_to_check[i];
+				DWORD crc32_file = 0;
+				if (hashes::calc_file_crc32(file_check.existing_path, crc32_file) && file_check.entry->crc32 == crc32_file) {
+					file_check.entry->need_to_update = 0;
+				}
+				else if (hashes::calc_file_crc32(file_check.staged_path, crc32_file) && file_check.entry->crc32 == crc32_file) {
+					file_check.entry->need_to_update = 1;
+				}
+			}
+		};
+
+		unsigned int worker_count = (std::min)((std::max)(std::thread::hardware_concurrency(), 1u), UPDATER_MAX_CHECK_WORKER_COUNT);
+		worker_count = (std::min)(worker_count, (unsigned int)files_to_check.size());
+
+		std::vector<std::thread> workers;
+		// the current thread is a worker as well
+		for (unsigned int i = 1; i < worker_count; i++)
+			workers.emplace_back(check_worker);
+		check_worker();
+		for (auto& worker : workers)
+			worker.join();
+
 		addDebugText("Filtered & locally checked the Download List.");
 	}
 
+	UpdateDetailsText();
+}
+
+// builds the download/install summary shown in the update menu from the current entries
+static void UpdateDetailsText() {
+	// GSDownloadCancel already cleared the update text
+	if (updater_cancelled)
+		return;
+
+	updater_has_files_to_download = false;
+	updater_has_files_to_install = false;
 
 	//prompt user with changes
 
-	entry_count = UpdateFileEntries.size();
+	int entry_count = UpdateFileEntries.size();
 	for (int i = 0; i < entry_count; i++) {
 		if (UpdateFileEntries[i]->need_to_update == 2) {
 			updater_has_files_to_download = true;
@@ -395,6 +403,175 @@ static void FetchUpdateDetails() {
 	autoUpdateText = autoUpdateTextAlt;
 }
 
+struct s_update_download
+{
+	UpdateFileEntry* entry;
+	std::string url;
+	// data is streamed into part_path and only moved to staged_path once its crc matches
+	std::wstring part_path;
+	std::wstring staged_path;
+
+	CURL* curl;
+	FILE* file;
+	long long resume_from;
+	// running crc of everything in the part file
+	DWORD crc32;
+	bool first_write;
+
+	bool pending;
+	bool done;
+	int request_id;
+	CURLcode result;
+	long response_code;
+};
+
+// guards the pending flags and results of the downloads
+static std::mutex update_download_mutex;
+static std::condition_variable update_download_cv;
+static std::vector<int> update_download_request_ids;
+
+static size_t update_download_write(void* ptr, size_t size, size_t nmemb, s_update_download* download) {
+	size_t len = size * nmemb;
+
+	if (download->first_write) {
+		download->first_write = false;
+
+		curl_off_t content_length = -1;
+		if (curl_easy_getinfo(download->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length) == CURLE_OK && content_length > 0)
+			sizeOfDownload += content_length;
+	}
+
+	if (fwrite(ptr, 1, len, download->file) != len)
+		return 0;
+
+	download->crc32 = hashes::crc32_update(download->crc32, ptr, len);
+	sizeOfDownloaded += len;
+	return len;
+}
+
+// starts or resumes the download on the shared curl executor
+static bool update_download_start(s_update_download* download) {
+	download->request_id = -1;
+	download->resume_from = 0;
+	download->crc32 = 0;
+	download->first_write = true;
+
+	// resume from whatever made it to disk last time, the crc has to be seeded from it
+	WIN32_FILE_ATTRIBUTE_DATA part_attributes;
+	if (GetFileAttributesExW(download->part_path.c_str(), GetFileExInfoStandard, &part_attributes)) {
+		long long part_size = ((long long)part_attributes.nFileSizeHigh << 32) | part_attributes.nFileSizeLow;
+		DWORD part_crc32 = 0;
+		if (part_size > 0 && hashes::calc_file_crc32(download->part_path, part_crc32)) {
+			download->resume_from = part_size;
+			download->crc32 = part_crc32;
+		}
+	}
+
+	download->curl = curl_interface_init_no_verify();
+	if (!download->curl)
+		return false;
+
+	CreateDirTree(download->part_path.c_str());
+	download->file = _wfopen(download->part_path.c_str(), download->resume_from > 0 ? L"ab" : L"wb");
+	if (!download->file) {
+		addDebugText("Failed to obtain FILE* for DL from: %s to: %ws", download->url.c_str(), download->part_path.c_str());
+		curl_easy_cleanup(download->curl);
+		return false;
+	}
+
+	sizeOfDownload += download->resume_from;
+	sizeOfDownloaded += download->resume_from;
+
+	//FIXME: <Insert Pinned Public Key Here>
+	curl_easy_setopt(download->curl, CURLOPT_URL, download->url.c_str());
+	curl_easy_setopt(download->curl, CURLOPT_WRITEFUNCTION, update_download_write);
+	curl_easy_setopt(download->curl, CURLOPT_WRITEDATA, download);
+	// don't write error pages into the file
+	curl_easy_setopt(download->curl, CURLOPT_FAILONERROR, 1L);
+	// drop stalled connections, the next attempt resumes them
+	curl_easy_setopt(download->curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(download->curl, CURLOPT_LOW_SPEED_TIME, 30L);
+	if (download->resume_from > 0)
+		curl_easy_setopt(download->curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)download->resume_from);
+
+	{
+		std::lock_guard lg(update_download_mutex);
+		download->pending = true;
+	}
+
+	download->request_id = curl_interface_perform_async(download->curl,
+		[download](CURL* curl, CURLcode result)
+		{
+			fclose(download->file);
+			download->file = nullptr;
+
+			long response_code = 0;
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+
+			std::lock_guard lg(update_download_mutex);
+			download->result = result;
+			download->response_code = response_code;
+			download->pending = false;
+			update_download_cv.notify_all();
+		});
+
+	if (download->request_id == -1) {
+		fclose(download->file);
+		download->file = nullptr;
+		curl_easy_cleanup(download->curl);
+		std::lock_guard lg(update_download_mutex);
+		download->pending = false;
+		return false;
+	}
+
+	std::lock_guard lg(update_download_mutex);
+	update_download_request_ids.push_back(download->request_id);
+	return true;
+}
+
+// verifies a finished download and moves it in place
+// returns false if it has to be downloaded again
+static bool update_download_finish(s_update_download* download) {
+	if (download->result == CURLE_RANGE_ERROR) {
+		// the server ignored the range request, start the next attempt from scratch
+		LOG_TRACE_FUNC("range request ignored for {}, restarting the download", download->url);
+		_wremove(download->part_path.c_str());
+		return false;
+	}
+
+	// 416 means the part file already holds everything, the crc check below still verifies it
+	if (download->result != CURLE_OK && download->response_code != 416) {
+		// interrupted, the next attempt resumes from the part file
+		LOG_ERROR_FUNC("downloading {} failed: {} (HTTP {})", download->url, curl_easy_strerror(download->result), download->response_code);
+		return false;
+	}
+
+	if (download->crc32 != download->entry->crc32) {
+		// corrupt or stale part file, start the next attempt from scratch
+		LOG_ERROR_FUNC("crc mismatch for {}, expected {:08X} got {:08X}", download->url, download->entry->crc32, download->crc32);
+		_wremove(download->part_path.c_str());
+		return false;
+	}
+
+	if (!MoveFileExW(download->part_path.c_str(), download->staged_path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		LOG_ERROR_FUNC("failed to move {} in place, error: {}", download->url, GetLastError());
+		return false;
+	}
+	return true;
+}
+
+static void update_downloads_cancel() {
+	// the completion callbacks take the lock on the executor thread, don't hold it while talking to the executor
+	std::vector<int> request_ids;
+	{
+		std::lock_guard lg(update_download_mutex);
+		request_ids = update_download_request_ids;
+	}
+
+	for (int request_id : request_ids)
+		curl_interface_cancel(request_id);
+}
+
 bool DownloadUpdatedFiles() {
 	
 	//download list
@@ -405,6 +582,8 @@ bool DownloadUpdatedFiles() {
 	wchar_t dir_update[1024];
 	swprintf(dir_update, ARRAYSIZE(dir_update), L"%ws\\Halo2\\Update\\", dir_temp);
 
+	std::vector<std::unique_ptr<s_update_download>> downloads;
+
 	int entry_count = UpdateFileEntries.size();
 	for (int i = 0; i < entry_count; i++) {
 		if (UpdateFileEntries[i]->need_to_update == 2) {
@@ -416,18 +595,62 @@ bool DownloadUpdatedFiles() {
 			else {
 				swprintf(existingfilepath, ARRAYSIZE(existingfilepath), L"%s%hs", dir_update, UpdateFileEntries[i]->local_name);
 			}
-			_wremove(existingfilepath);
-			std::string im_lazy_2_dl = "https://cartographer.online/";
-			im_lazy_2_dl += UpdateFileEntries[i]->server_uri;
-			DownloadFile(im_lazy_2_dl.c_str(), existingfilepath);
+
+			auto download = std::make_unique<s_update_download>();
+			download->entry = UpdateFileEntries[i];
+			download->url = "https://cartographer.online/";
+			download->url += UpdateFileEntries[i]->server_uri;
+			download->staged_path = existingfilepath;
+			download->part_path = download->staged_path + L".part";
+			download->pending = false;
+			download->done = false;
+			downloads.push_back(std::move(download));
+		}
+	}
+
+	// all files download in parallel, the curl executor limits the connections per host
+	// files that got interrupted are resumed with a range request on the next attempt
+	for (int attempt = 0; attempt < UPDATER_MAX_DOWNLOAD_ATTEMPTS && !updater_cancelled; attempt++) {
+		sizeOfDownload = sizeOfDownloaded = 0;
+
+		bool all_done = true;
+		for (auto& download : downloads) {
+			if (!download->done) {
+				all_done = false;
+				if (!updater_cancelled)
+					update_download_start(download.get());
+			}
+		}
+		if (all_done)
+			break;
+
+		{
+			std::unique_lock lock(update_download_mutex);
+			update_download_cv.wait(lock, [&downloads]()
+				{
+					return std::none_of(downloads.begin(), downloads.end(), [](const std::unique_ptr<s_update_download>& download) { return download->pending; });
+				});
+			update_download_request_ids.clear();
+		}
+
+		for (auto& download : downloads) {
+			if (!download->done && download->request_id != -1 && !updater_cancelled)
+				download->done = update_download_finish(download.get());
 		}
 	}
 
+	for (auto& download : downloads) {
+		// verified while streaming, no need to hash the staged file again
+		if (download->done)
+			download->entry->need_to_update = 1;
+		else
+			addDebugText("Failed to download: %s", download->url.c_str());
+	}
+
+	sizeOfDownload = sizeOfDownloaded = 0;
 	return files_downloaded;
 }
 
-static HANDLE hThreadDownloader = 0;
-
 static DWORD WINAPI DownloadThread(LPVOID lParam)
 {
 	int operation_id = (int)lParam;
@@ -443,7 +666,12 @@ static DWORD WINAPI DownloadThread(LPVOID lParam)
 	else if (operation_id == 1) {
 		setButtonState(2, 2);
 		if (DownloadUpdatedFiles())
-			FetchUpdateDetails();
+			UpdateDetailsText();
+	}
+
+	if (updater_cancelled) {
+		hThreadDownloader = 0;
+		return 0;
 	}
 
 	setButtonState(1, 1);
@@ -465,13 +693,17 @@ void GSDownloadInit() {
 }
 
 void GSDownloadCheck() {
-	if (!hThreadDownloader)
+	if (!hThreadDownloader) {
+		updater_cancelled = false;
 		hThreadDownloader = CreateThread(NULL, 0, DownloadThread, (LPVOID)0, 0, NULL);
+	}
 }
 
 void GSDownloadDL() {
-	if (!hThreadDownloader)
+	if (!hThreadDownloader) {
+		updater_cancelled = false;
 		hThreadDownloader = CreateThread(NULL, 0, DownloadThread, (LPVOID)1, 0, NULL);
+	}
 }
 
 void GSDownloadInstall() {
@@ -550,9 +782,9 @@ void GSDownloadCancel() {
 		// the thread handle is not signaled - the thread is still alive
 	//}
 	if (hThreadDownloader) {
-		TerminateThread(hThreadDownloader, 1);
-		hThreadDownloader = 0;
-		sizeOfDownload = sizeOfDownloaded = 0;
+		// let the downloader thread unwind, aborted downloads keep their part files and resume next time
+		updater_cancelled = true;
+		update_downloads_cancel();
 	}
 
 	extern char* autoUpdateText;
@@ -2,6 +2,7 @@
 
 #include "meta_struct.h"
 #include "Blam/Cache/DataTypes/BlamTag.h"
+#include "Util/hash.h"
 
 namespace meta_struct
 {
@@ -27,66 +28,50 @@ namespace meta_struct
 	{
 		return this->name;
 	}
-	void plugins_field::Add_tag_ref(int off, std::string name)
+	//inserts off into a sorted offset list unless its already there
+	static void add_sorted_offset(std::vector<int>& list, int off)
 	{
-		Tag_refs.try_emplace(off, name);
+		auto it = std::lower_bound(list.begin(), list.end(), off);
+		if (it == list.end() || *it != off)
+			list.insert(it, off);
 	}
-	void plugins_field::Add_data_ref(int off, std::string name)
+	void plugins_field::Add_tag_ref(int off)
 	{
-		Data_refs.try_emplace(off, name);
+		add_sorted_offset(Tag_refs, off);
+	}
+	void plugins_field::Add_data_ref(int off)
+	{
+		add_sorted_offset(Data_refs, off);
 	}
 	void plugins_field::Add_BLOCK(std::shared_ptr<plugins_field> field)
 	{
 		reflexive.push_back(field);
 	}
-	void plugins_field::Add_stringid_ref(int off, std::string name)
+	void plugins_field::Add_stringid_ref(int off)
 	{
-		stringID.try_emplace(off, name);
+		add_sorted_offset(stringID, off);
 	}
-	void plugins_field::Add_WCtag_ref(int off, std::string name)
+	void plugins_field::Add_WCtag_ref(int off)
 	{
-		WCTag_refs.try_emplace(off, name);
+		add_sorted_offset(WCTag_refs, off);
 	}
-	std::list<int> plugins_field::Get_tag_ref_list()
+	const std::vector<int>& plugins_field::Get_tag_ref_list() const
 	{
-		std::list<int> ret;
-		for (auto& i : Tag_refs)
-		{
-			ret.push_back(i.first);
-		}
-		return ret;
+		return Tag_refs;
 	}
-	std::list<int> plugins_field::Get_data_ref_list()
+	const std::vector<int>& plugins_field::Get_data_ref_list() const
 	{
-		std::list<int> ret;
-
-		for (auto& i : Data_refs)
-		{
-			ret.push_back(i.first);
-		}
-		return ret;
+		return Data_refs;
 	}
-	std::list<int> plugins_field::Get_stringID_ref_list()
+	const std::vector<int>& plugins_field::Get_stringID_ref_list() const
 	{
-		std::list<int> ret;
-
-		for (auto& i : stringID)
-		{
-			ret.push_back(i.first);
-		}
-		return ret;
+		return stringID;
 	}
-	std::list<int> plugins_field::Get_WCtag_ref_list()
+	const std::vector<int>& plugins_field::Get_WCtag_ref_list() const
 	{
-		std::list<int> ret;
-
-		for (auto& i : WCTag_refs)
-		{
-			ret.push_back(i.first);
-		}
-		return ret;
+		return WCTag_refs;
 	}
-	std::list<std::shared_ptr<plugins_field>> plugins_field::Get_reflexive_list()
+	const std::vector<std::shared_ptr<plugins_field>>& plugins_field::Get_reflexive_list() const
 	{
 		return reflexive;
 	}
@@ -129,19 +114,19 @@ namespace meta_struct
 				int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
 
 				if (!child_element->BoolAttribute("withClass"))
-					ret->Add_tag_ref(off, child_element->Attribute("name"));
+					ret->Add_tag_ref(off);
 				else
-					ret->Add_WCtag_ref(off, child_element->Attribute("name"));
+					ret->Add_WCtag_ref(off);
 			}
 			else if ((element_name == "stringId") || (element_name == "stringid"))
 			{
 				int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-				ret->Add_stringid_ref(off, child_element->Attribute("name"));
+				ret->Add_stringid_ref(off);
 			}
 			else if (element_name == "dataref")
 			{
 				int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-				ret->Add_data_ref(off, child_element->Attribute("name"));
+				ret->Add_data_ref(off);
 			}
 			child_element=child_element->NextSiblingElement();
 		}
@@ -167,28 +152,22 @@ namespace meta_struct
 				}
 				else if ((element_name == "tagRef") || (element_name == "tagref"))
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
 
 					if (!child_element->BoolAttribute("withClass") && !child_element->Attribute("withClass"))
-						ret->Add_tag_ref(off, name);
+						ret->Add_tag_ref(off);
 					else
-						ret->Add_WCtag_ref(off, name);
+						ret->Add_WCtag_ref(off);
 				}
 				else if ((element_name == "stringId") || (element_name == "stringid"))
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-					ret->Add_stringid_ref(off, name);
+					ret->Add_stringid_ref(off);
 				}
 				else if (element_name == "dataref")
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-					ret->Add_data_ref(off, name);
+					ret->Add_data_ref(off);
 				}
 				child_element = child_element->NextSiblingElement();
 			}
@@ -209,28 +188,22 @@ namespace meta_struct
 				}
 				else if ((element_name == "tagRef") || (element_name == "tagref"))
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
 
 					if (!child_element->BoolAttribute("withClass") && !child_element->Attribute("withClass"))
-						ret->Add_tag_ref(off, name);
+						ret->Add_tag_ref(off);
 					else
-						ret->Add_WCtag_ref(off, name);
+						ret->Add_WCtag_ref(off);
 				}
 				else if ((element_name == "stringId") || (element_name == "stringid"))
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-					ret->Add_stringid_ref(off, name);
+					ret->Add_stringid_ref(off);
 				}
 				else if (element_name == "dataref")
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-					ret->Add_data_ref(off, name);
+					ret->Add_data_ref(off);
 				}
 				child_element = child_element->NextSiblingElement();
 			}
@@ -257,28 +230,22 @@ namespace meta_struct
 				}
 				else if ((element_name == "tagRef") || (element_name == "tagref"))
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
 
 					if (!child_element->BoolAttribute("withClass") && !child_element->Attribute("withClass"))
-						ret->Add_tag_ref(off, name);
+						ret->Add_tag_ref(off);
 					else
-						ret->Add_WCtag_ref(off, name);
+						ret->Add_WCtag_ref(off);
 				}
 				else if ((element_name == "stringId") || (element_name == "stringid"))
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-					ret->Add_stringid_ref(off, name);
+					ret->Add_stringid_ref(off);
 				}
 				else if (element_name == "dataref")
 				{
-					std::string name = child_element->Attribute("name");
-
 					int off = std::stoul(child_element->Attribute("offset"), nullptr, 16);
-					ret->Add_data_ref(off, name);
+					ret->Add_data_ref(off);
 				}
 				child_element = child_element->NextSiblingElement();
 			}
@@ -286,6 +253,275 @@ namespace meta_struct
 		}
 	}
 	///
+	//<-------------------------compiled plugin cache------------------------------------------------------------------->
+	///
+	//the plugin tree flattened into a single file: header, blocks, offset pool, name pool
+	//blocks are stored breadth first so the children of a block are a contiguous range after it
+	#define PLUGIN_CACHE_MAGIC 0x63676C70 //'plgc'
+	#define PLUGIN_CACHE_VERSION 1
+	#define PLUGIN_CACHE_HASH_SIZE 16
+
+	enum e_plugin_cache_offset_list : int
+	{
+		_plugin_cache_tag_refs,
+		_plugin_cache_data_refs,
+		_plugin_cache_stringid_refs,
+		_plugin_cache_wc_tag_refs,
+
+		k_plugin_cache_offset_list_count
+	};
+
+	struct s_plugin_cache_header
+	{
+		DWORD magic;
+		DWORD version;
+		BYTE plugin_hash[PLUGIN_CACHE_HASH_SIZE];//md5 of the xml plugin the cache was compiled from
+		int block_count;
+		int offset_count;
+		int name_pool_size;
+	};
+
+	struct s_plugin_cache_block
+	{
+		int name_offset;
+		int name_length;
+		int offset;
+		int entry_size;
+		int first_child;
+		int child_count;
+		int first_offset[k_plugin_cache_offset_list_count];
+		int offset_count[k_plugin_cache_offset_list_count];
+	};
+
+	static const std::vector<int>& get_plugin_offset_list(const plugins_field* field, int list)
+	{
+		switch (list)
+		{
+		case _plugin_cache_data_refs:
+			return field->Get_data_ref_list();
+		case _plugin_cache_stringid_refs:
+			return field->Get_stringID_ref_list();
+		case _plugin_cache_wc_tag_refs:
+			return field->Get_WCtag_ref_list();
+		case _plugin_cache_tag_refs:
+		default:
+			return field->Get_tag_ref_list();
+		}
+	}
+
+	static void add_plugin_offset(plugins_field* field, int list, int off)
+	{
+		switch (list)
+		{
+		case _plugin_cache_tag_refs:
+			field->Add_tag_ref(off);
+			break;
+		case _plugin_cache_data_refs:
+			field->Add_data_ref(off);
+			break;
+		case _plugin_cache_stringid_refs:
+			field->Add_stringid_ref(off);
+			break;
+		case _plugin_cache_wc_tag_refs:
+			field->Add_WCtag_ref(off);
+			break;
+		}
+	}
+
+	//maps the cache file and rebuilds the plugin tree from it, returns nullptr if the cache is missing, stale or malformed
+	static std::shared_ptr<plugins_field> load_plugin_cache(const std::string& cache_loc, const BYTE* plugin_hash)
+	{
+		std::shared_ptr<plugins_field> ret;
+
+		HANDLE file = CreateFileA(cache_loc.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return ret;
+
+		HANDLE mapping = NULL;
+		const char* view = nullptr;
+		do
+		{
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file, &file_size)
+				|| file_size.HighPart != 0
+				|| file_size.LowPart < sizeof(s_plugin_cache_header))
+				break;
+
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL)
+				break;
+
+			view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (view == nullptr)
+				break;
+
+			const s_plugin_cache_header* header = (const s_plugin_cache_header*)view;
+			if (header->magic != PLUGIN_CACHE_MAGIC
+				|| header->version != PLUGIN_CACHE_VERSION
+				|| memcmp(header->plugin_hash, plugin_hash, PLUGIN_CACHE_HASH_SIZE) != 0
+				|| header->block_count <= 0
+				|| header->offset_count < 0
+				|| header->name_pool_size < 0)
+				break;
+
+			unsigned long long expected_size = sizeof(s_plugin_cache_header)
+				+ (unsigned long long)header->block_count * sizeof(s_plugin_cache_block)
+				+ (unsigned long long)header->offset_count * sizeof(int)
+				+ (unsigned long long)header->name_pool_size;
+			if (expected_size != file_size.LowPart)
+				break;
+
+			const s_plugin_cache_block* blocks = (const s_plugin_cache_block*)(header + 1);
+			const int* offsets = (const int*)(blocks + header->block_count);
+			const char* names = (const char*)(offsets + header->offset_count);
+
+			std::vector<std::shared_ptr<plugins_field>> fields(header->block_count);
+			bool valid = true;
+			for (int i = 0; i < header->block_count && valid; i++)
+			{
+				const s_plugin_cache_block& block = blocks[i];
+				if (block.name_offset < 0 || block.name_length < 0
+					|| block.name_offset > header->name_pool_size - block.name_length)
+				{
+					valid = false;
+					break;
+				}
+
+				fields[i] = std::make_shared<plugins_field>(std::string(names + block.name_offset, block.name_length), block.offset, block.entry_size);
+				for (int list = 0; list < k_plugin_cache_offset_list_count; list++)
+				{
+					int first = block.first_offset[list];
+					int count = block.offset_count[list];
+					if (first < 0 || count < 0 || first > header->offset_count - count)
+					{
+						valid = false;
+						break;
+					}
+					// the offsets were written sorted, so every add is an append
+					for (int j = 0; j < count; j++)
+						add_plugin_offset(fields[i].get(), list, offsets[first + j]);
+				}
+			}
+
+			//children always come after their parent, which also rules out cycles in a corrupted file
+			for (int i = 0; i < header->block_count && valid; i++)
+			{
+				const s_plugin_cache_block& block = blocks[i];
+				if (block.child_count == 0)
+					continue;
+
+				if (block.child_count < 0 || block.first_child <= i
+					|| block.first_child > header->block_count - block.child_count)
+				{
+					valid = false;
+					break;
+				}
+
+				for (int j = 0; j < block.child_count; j++)
+					fields[i]->Add_BLOCK(fields[block.first_child + j]);
+			}
+
+			if (valid)
+				ret = fields[0];
+		} while (0);
+
+		if (view != nullptr)
+			UnmapViewOfFile(view);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		CloseHandle(file);
+
+		return ret;
+	}
+
+	//flattens the plugin tree and writes it next to the xml plugin
+	static void write_plugin_cache(const std::string& cache_loc, const BYTE* plugin_hash, const std::shared_ptr<plugins_field>& plugin)
+	{
+		std::vector<s_plugin_cache_block> blocks;
+		std::vector<int> offsets;
+		std::string names;
+
+		std::vector<plugins_field*> queue = { plugin.get() };
+		for (size_t i = 0; i < queue.size(); i++)
+		{
+			plugins_field* field = queue[i];
+			std::string name = field->Get_name();
+			const auto& children = field->Get_reflexive_list();
+
+			s_plugin_cache_block block;
+			block.name_offset = names.size();
+			block.name_length = name.size();
+			block.offset = field->Get_offset();
+			block.entry_size = field->Get_entry_size();
+			block.first_child = children.empty() ? 0 : queue.size();
+			block.child_count = children.size();
+			names += name;
+
+			for (const auto& child : children)
+				queue.push_back(child.get());
+
+			for (int list = 0; list < k_plugin_cache_offset_list_count; list++)
+			{
+				const std::vector<int>& list_offsets = get_plugin_offset_list(field, list);
+				block.first_offset[list] = offsets.size();
+				block.offset_count[list] = list_offsets.size();
+				offsets.insert(offsets.end(), list_offsets.begin(), list_offsets.end());
+			}
+
+			blocks.push_back(block);
+		}
+
+		s_plugin_cache_header header;
+		header.magic = PLUGIN_CACHE_MAGIC;
+		header.version = PLUGIN_CACHE_VERSION;
+		memcpy(header.plugin_hash, plugin_hash, PLUGIN_CACHE_HASH_SIZE);
+		header.block_count = blocks.size();
+		header.offset_count = offsets.size();
+		header.name_pool_size = names.size();
+
+		//write to a temporary file first, a partially written cache is never picked up
+		std::string temp_loc = cache_loc + ".tmp";
+		std::ofstream fout(temp_loc, std::ios::binary | std::ios::trunc);
+		if (!fout.is_open())
+		{
+			LOG_TRACE_GAME("[{}] failed to create plugin cache: {}", __FUNCTION__, temp_loc);
+			return;
+		}
+
+		fout.write((const char*)&header, sizeof(header));
+		fout.write((const char*)blocks.data(), blocks.size() * sizeof(s_plugin_cache_block));
+		fout.write((const char*)offsets.data(), offsets.size() * sizeof(int));
+		fout.write(names.data(), names.size());
+		bool written = fout.good();
+		fout.close();
+
+		if (!written || !MoveFileExA(temp_loc.c_str(), cache_loc.c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			LOG_TRACE_GAME("[{}] failed to write plugin cache: {}", __FUNCTION__, cache_loc);
+			DeleteFileA(temp_loc.c_str());
+		}
+	}
+
+	std::shared_ptr<plugins_field> Get_Tag_stucture_from_plugin_cache(const std::string& file_loc, const std::string& cache_loc)
+	{
+		BYTE plugin_hash[PLUGIN_CACHE_HASH_SIZE];
+		size_t plugin_hash_len = sizeof(plugin_hash);
+
+		//without a hash we cannot tell whether the cache is current, parse the xml directly
+		if (!hashes::calc_file_md5(file_loc, plugin_hash, plugin_hash_len) || plugin_hash_len != PLUGIN_CACHE_HASH_SIZE)
+			return Get_Tag_stucture_from_plugin(file_loc);
+
+		std::shared_ptr<plugins_field> ret = load_plugin_cache(cache_loc, plugin_hash);
+		if (ret != nullptr)
+			return ret;
+
+		ret = Get_Tag_stucture_from_plugin(file_loc);
+		if (ret != nullptr)
+			write_plugin_cache(cache_loc, plugin_hash, ret);
+
+		return ret;
+	}
+	///
 	//<------------------------------meta structure---------------------------------------------------->
 	///
 	//constructor for in memory loading and rebasing
@@ -361,10 +597,8 @@ namespace meta_struct
 	//function that lists various dependencies of the meta
 	void meta::List_deps(int off, std::shared_ptr<plugins_field> fields)
 	{
-		std::list<int> temp = fields->Get_tag_ref_list();
-
 		//first we look for tag_refs and add them
-		for (int& i : temp)
+		for (int i : fields->Get_tag_ref_list())
 		{
 			int Toff = off + i;//it contains type
 							   //we add this off to the list if it doesnt contain the off already
@@ -376,8 +610,7 @@ namespace meta_struct
 		//then we look for data_refs and add them
 		//but they have some issue,some dataref refers data outside of the tag
 		//so we have to be a bit carefull
-		temp = fields->Get_data_ref_list();
-		for (int& i : temp)
+		for (int i : fields->Get_data_ref_list())
 		{
 			int Toff = off + i;
 
@@ -436,8 +669,7 @@ namespace meta_struct
 
 		}
 		//then we look for stringId refs and add them
-		temp = fields->Get_stringID_ref_list();
-		for (int& i : temp)
+		for (int i : fields->Get_stringID_ref_list())
 		{
 			int Toff = off + i;
 			//we add this off to the list if it doesnt contain the off already
@@ -447,8 +679,7 @@ namespace meta_struct
 			}
 		}
 		//now we look into reflexive fields and extended meta and add them accordingly
-		std::list<std::shared_ptr<plugins_field>> Ptemp = fields->Get_reflexive_list();
-		for (auto& i_Pfield : Ptemp)
+		for (const auto& i_Pfield : fields->Get_reflexive_list())
 		{
 			int Toff = off + i_Pfield->Get_offset();//field table off contains count
 
@@ -516,8 +747,7 @@ namespace meta_struct
 			}
 		}
 		//now we go for withClass attribute tagRefs,they are a bit different as they only contain the datum index of the refered tag
-		temp = fields->Get_WCtag_ref_list();
-		for (int& i : temp)
+		for (int i : fields->Get_WCtag_ref_list())
 		{
 			int Toff = off + i;
 			//we add this off to the list if it doesnt contain the off already
@@ -44,12 +44,13 @@ namespace meta_struct
 		int offset;
 		int entry_size;
 
-		std::map<int, std::string> Tag_refs;//<offset,name>
-		std::map<int, std::string> Data_refs;//<offset,name>
-		std::map<int, std::string> stringID;//<offset,name>
-		std::map<int, std::string> WCTag_refs;//<offset,name>(withClass tagRefs,somewhat different from the normal tags)
+		//offsets are kept sorted and unique so List_deps can walk them without copying
+		std::vector<int> Tag_refs;
+		std::vector<int> Data_refs;
+		std::vector<int> stringID;
+		std::vector<int> WCTag_refs;//(withClass tagRefs,somewhat different from the normal tags)
 
-		std::list<std::shared_ptr<plugins_field>> reflexive;
+		std::vector<std::shared_ptr<plugins_field>> reflexive;
 
 	public:
 		//constructor
@@ -59,16 +60,16 @@ namespace meta_struct
 		int Get_entry_size();
 		std::string Get_name();
 
-		void Add_tag_ref(int off, std::string name);
-		void Add_data_ref(int off, std::string name);
+		void Add_tag_ref(int off);
+		void Add_data_ref(int off);
 		void Add_BLOCK(std::shared_ptr<plugins_field> field);
-		void Add_stringid_ref(int off, std::string name);
-		void Add_WCtag_ref(int off, std::string name);
-		std::list<int> Get_tag_ref_list();
-		std::list<int> Get_data_ref_list();
-		std::list<int> Get_stringID_ref_list();
-		std::list<int> Get_WCtag_ref_list();
-		std::list<std::shared_ptr<plugins_field>> Get_reflexive_list();
+		void Add_stringid_ref(int off);
+		void Add_WCtag_ref(int off);
+		const std::vector<int>& Get_tag_ref_list() const;
+		const std::vector<int>& Get_data_ref_list() const;
+		const std::vector<int>& Get_stringID_ref_list() const;
+		const std::vector<int>& Get_WCtag_ref_list() const;
+		const std::vector<std::shared_ptr<plugins_field>>& Get_reflexive_list() const;
 	};
 	/// <summary>
 	/// a class containing the data of the concerned meta
@@ -131,6 +132,8 @@ namespace meta_struct
 	//generates a structure from plugin
 	std::shared_ptr<plugins_field> Get_Tag_stucture_from_plugin(std::string file_loc);
 	std::shared_ptr<plugins_field> Get_meta_BLOCK(tinyxml2::XMLElement* element);
+	//generates a structure from the compiled plugin cache,(re)compiling it from the xml plugin when its hash changed
+	std::shared_ptr<plugins_field> Get_Tag_stucture_from_plugin_cache(const std::string& file_loc, const std::string& cache_loc);
 
 	//some usefull functions	
 	std::string Get_file(std::string file_loc);
@@ -65,7 +65,7 @@ namespace tag_loader
 	std::string plugins_dir;
 	std::string mods_dir;
 
-	static std::map<std::string, std::shared_ptr<plugins_field>> plugins_list;//contains list of various plugin structures
+	static std::unordered_map<std::string, std::shared_ptr<plugins_field>> plugins_list;//contains list of various plugin structures, keyed by the type with spaces removed
 	std::map<int, std::shared_ptr<meta>> que_meta_list;//<datum_index,meta_junk>contains the list of tags that are currently in que to loaded in memory
 	std::vector<int> key_list;//another var just to keep the keys along with the correct order
 	std::vector<int> injected_list;
@@ -84,24 +84,18 @@ namespace tag_loader
 
 	std::shared_ptr<plugins_field> Get_plugin(std::string type)
 	{
-		//we first look into the already loaded plugin list
-		for (auto& i : plugins_list)
-		{
-			if (i.first == type)
-				return i.second;
-		}
-		//it doesnt contain it therfore we need to load the plugin
-		//auto t = std::string(type.begin(), type.end());
-		//t.erase(std::remove_if(t.begin(),
-		//	t.end(),
-		//	[capture0 = std::locale::classic()](auto&& PH1)
-		//	{
-		//		return std::isspace<char>(std::forward<decltype(PH1)>(PH1), capture0);
-		//	}),
-		//	t.end());
+		//plugins are keyed by the file name, which has no spaces
 		type.erase(remove(type.begin(), type.end(), ' '), type.end());
+
+		//we first look into the already loaded plugin list
+		auto loaded_plugin = plugins_list.find(type);
+		if (loaded_plugin != plugins_list.end())
+			return loaded_plugin->second;
+
+		//it doesnt contain it therfore we need to load the plugin, from its compiled cache if its still current
 		std::string plugin_loc = plugins_dir + '\\' + type + ".xml";
-		std::shared_ptr<plugins_field> temp_plugin = meta_struct::Get_Tag_stucture_from_plugin(plugin_loc);
+		std::string plugin_cache_loc = plugins_dir + '\\' + type + ".bin";
+		std::shared_ptr<plugins_field> temp_plugin = meta_struct::Get_Tag_stucture_from_plugin_cache(plugin_loc, plugin_cache_loc);
 
 		if (temp_plugin)
 			plugins_list.emplace(type, temp_plugin);
@@ -161,35 +155,28 @@ namespace tag_loader
 
 	}
 
-	datum Get_tag_datum(std::string tag_name, blam_tag type, std::string map)
+	//returns the location of the map, checks inside mods\\maps folder first then maps folder and finally inside custom maps folder
+	std::string Get_map_location(std::string map)
 	{
-		std::ifstream* fin;
-		std::string map_loc;
+		std::string map_file = map;
+		if (meta_struct::Get_file_type(map) != "map")
+			map_file += ".map";
 
-		//logic to check the existence of the map at subsequent directories
-		///mods->default->custom
-		if (meta_struct::Get_file_type(map) == "map")
-			map_loc = mods_dir + "\\maps\\" + map;
-		else
-			map_loc = mods_dir + "\\maps\\" + map + ".map";
+		std::string map_loc = mods_dir + "\\maps\\" + map_file;
+		if (PathFileExistsA(map_loc.c_str()))
+			return map_loc;
 
-		if (PathFileExistsA(map_loc.c_str()));
-		else
-		{
-			if (meta_struct::Get_file_type(map) == "map")
-				map_loc = def_maps_dir + '\\' + map;
-			else
-				map_loc = def_maps_dir + '\\' + map + ".map";
+		map_loc = def_maps_dir + '\\' + map_file;
+		if (PathFileExistsA(map_loc.c_str()))
+			return map_loc;
 
-			if (PathFileExistsA(map_loc.c_str()));
-			else
-			{
-				if (meta_struct::Get_file_type(map) == "map")
-					map_loc = cus_maps_dir + '\\' + map;
-				else
-					map_loc = cus_maps_dir + '\\' + map + ".map";
-			}
-		}
+		return cus_maps_dir + '\\' + map_file;
+	}
+
+	datum Get_tag_datum(std::string tag_name, blam_tag type, std::string map)
+	{
+		std::ifstream* fin;
+		std::string map_loc = Get_map_location(map);
 
 		fin = new std::ifstream(map_loc.c_str(), std::ios::binary | std::ios::in);
 
@@ -269,37 +256,11 @@ namespace tag_loader
 	///custom flag is no more needed
 	void Load_tag(int datum_index, bool recursive, std::string map, bool custom)
 	{
-		std::ifstream* fin;
-
 		que_list_target_map = map;
-		std::string map_loc;
-
-		//logic to check the existence of the map at subsequent directories
-		///mods->default->custom
-		if (meta_struct::Get_file_type(map) == "map")
-			map_loc = mods_dir + "\\maps\\" + map;
-		else
-			map_loc = mods_dir + "\\maps\\" + map + ".map";
-
-		if (PathFileExistsA(map_loc.c_str()));
-		else
-		{
-			if (meta_struct::Get_file_type(map) == "map")
-				map_loc = def_maps_dir + '\\' + map;
-			else
-				map_loc = def_maps_dir + '\\' + map + ".map";
+		std::string map_loc = Get_map_location(map);
 
-			if (PathFileExistsA(map_loc.c_str()));
-			else
-			{
-				if (meta_struct::Get_file_type(map) == "map")
-					map_loc = cus_maps_dir + '\\' + map;
-				else
-					map_loc = cus_maps_dir + '\\' + map + ".map";
-			}
-		}
-
-		fin = new std::ifstream(map_loc.c_str(), std::ios::binary | std::ios::in);
+		//the map is opened once, all the dependencies are read from the same stream
+		std::ifstream* fin = new std::ifstream(map_loc.c_str(), std::ios::binary | std::ios::in);
 
 		if (fin->is_open())
 		{
@@ -313,93 +274,124 @@ namespace tag_loader
 			fin->read((char*)&table_off, 4);
 			fin->read((char*)&table_size, 4);
 
+			tags::tag_offset_header tags_header;
+			fin->seekg(table_off);
+			fin->read((char*)&tags_header, sizeof(tags::tag_offset_header));
 
-			fin->seekg(table_off + 4);
-			int temp;
-			fin->read((char*)&temp, 4);
-
-			int table_start = table_off + 0xC * temp + 0x20;
+			int table_start = table_off + 0xC * tags_header.tag_parent_info_count + 0x20;
 			int scnr_off = table_off + table_size;
 
-			int scnr_memaddr;
-			fin->seekg(table_start + 0x8);
-			fin->read((char*)&scnr_memaddr, 4);
+			//read the whole tag table at once, instead of seeking to each tag instance
+			std::vector<tags::tag_instance> tag_table(tags_header.tag_count > 0 ? tags_header.tag_count : 0);
+			fin->seekg(table_start);
+			fin->read((char*)tag_table.data(), tag_table.size() * sizeof(tags::tag_instance));
+			if (fin->fail())
+				tag_table.clear();
 
-			tags::tag_instance tag_info;
+			int scnr_memaddr = !tag_table.empty() ? tag_table[0].data_offset : 0;
 
-			//create a tag_list to load
-			std::list<int> load_tag_list;
+			//the result doesn't change while loading the dependencies
+			bool shared = Check_shared(fin);
+
+			//resolve the dependencies breadth first, each level is read in map offset order
+			std::vector<int> load_tag_list;
+			std::unordered_set<int> queued_tags;
 			load_tag_list.push_back(datum_index);
+			queued_tags.insert(datum_index);
+
+			bool plugin_error = false;
 
 			//----------------LOOPING STUFF
-			while (load_tag_list.size())
+			while (!load_tag_list.empty() && !plugin_error)
 			{
-				if (*load_tag_list.cbegin() != -1 && *load_tag_list.cbegin() != 0)
+				struct s_tag_to_load
 				{
-					//method to read tag type
-					fin->seekg(table_start + (0xFFFF & *(load_tag_list.cbegin())) * sizeof(tags::tag_instance));
+					int datum_index;
+					tags::tag_instance tag_info;
+					int map_off;
+				};
 
-					fin->read((char*)&tag_info, sizeof(tags::tag_instance));
+				std::vector<s_tag_to_load> tags_to_load;
+				tags_to_load.reserve(load_tag_list.size());
+
+				for (int tag_datum : load_tag_list)
+				{
+					if (tag_datum == -1 || tag_datum == 0)
+						continue;
 
-					if (*(load_tag_list.cbegin()) == tag_info.datum_index && tag_info.type != blam_tag::tag_group_type::sound)
+					size_t tag_table_index = 0xFFFF & tag_datum;
+					if (tag_table_index >= tag_table.size())
 					{
-						std::shared_ptr<plugins_field> temp_plugin = Get_plugin(tag_info.type.as_string());
+						std::string temp_error = "Invalid Datum index :0x" + meta_struct::to_hex_string(tag_datum);
+						error_list.push_back(temp_error);
+						continue;
+					}
 
-						//precaution for plugin load errors
-						if (!temp_plugin)
-							break;
+					const tags::tag_instance& tag_info = tag_table[tag_table_index];
+					if (tag_datum != tag_info.datum_index || tag_info.type == blam_tag::tag_group_type::sound)
+						continue;
 
-						//we first check the integrity of the datum_index
-						if (tag_info.datum_index == *(load_tag_list.cbegin()) && tag_info.data_offset && tag_info.size > 0 && (que_meta_list.find(tag_info.datum_index) == que_meta_list.cend()))
-						{
-							//read the meta data from the map            
-							char* data = new char[tag_info.size];
-
-							int map_off;
-							if (!Check_shared(fin))
-								map_off = scnr_off + (tag_info.data_offset - scnr_memaddr);
-							else
-								map_off = scnr_off + (tag_info.data_offset - 0x3C000);
-							fin->seekg(map_off);
-							//0x3c000 is a hardcoded value in blam engine
-
-							fin->read(data, tag_info.size);
-
-							//create a meta object
-							std::shared_ptr<meta> temp_meta = std::make_shared<meta>(data, tag_info.size, tag_info.data_offset, temp_plugin, fin, map_off, 1, *(load_tag_list.cbegin()), map_loc, tag_info.type);
-							//temp_meta->Rebase_meta(0x0);
-							//found unnecessary
-
-							que_meta_list.emplace(*(load_tag_list.cbegin()), temp_meta);
-							key_list.push_back(*(load_tag_list.cbegin()));
-
-							if (recursive)
-							{
-								std::list<int> temp_tag_ref = temp_meta->Get_all_tag_refs();
-
-								//to remove redundancies
-								std::list<int>::iterator ref_iter = temp_tag_ref.begin();
-								while (ref_iter != temp_tag_ref.end())
-								{
-									if (que_meta_list.find(*ref_iter) != que_meta_list.end())
-										ref_iter = temp_tag_ref.erase(ref_iter);
-									else
-										ref_iter++;
-								}
-
-								load_tag_list.insert(load_tag_list.end(), temp_tag_ref.begin(), temp_tag_ref.end());
-							}
-						}
+					//we first check the integrity of the datum_index
+					if (tag_info.data_offset && tag_info.size > 0 && (que_meta_list.find(tag_info.datum_index) == que_meta_list.cend()))
+					{
+						int map_off;
+						//0x3c000 is a hardcoded value in blam engine
+						if (!shared)
+							map_off = scnr_off + (tag_info.data_offset - scnr_memaddr);
 						else
+							map_off = scnr_off + (tag_info.data_offset - 0x3C000);
+
+						tags_to_load.push_back({ tag_datum, tag_info, map_off });
+					}
+					else
+					{
+						//most of time this is caused due to shared stuff
+						std::string temp_error = "Invalid Datum index :0x" + meta_struct::to_hex_string(tag_datum);
+						error_list.push_back(temp_error);
+					}
+				}
+
+				load_tag_list.clear();
+
+				//sequential reads
+				std::sort(tags_to_load.begin(), tags_to_load.end(),
+					[](const s_tag_to_load& a, const s_tag_to_load& b) { return a.map_off < b.map_off; });
+
+				for (auto& tag_to_load : tags_to_load)
+				{
+					std::shared_ptr<plugins_field> temp_plugin = Get_plugin(tag_to_load.tag_info.type.as_string());
+
+					//precaution for plugin load errors
+					if (!temp_plugin)
+					{
+						plugin_error = true;
+						break;
+					}
+
+					//read the meta data from the map
+					char* data = new char[tag_to_load.tag_info.size];
+					fin->seekg(tag_to_load.map_off);
+					fin->read(data, tag_to_load.tag_info.size);
+
+					//create a meta object
+					std::shared_ptr<meta> temp_meta = std::make_shared<meta>(data, tag_to_load.tag_info.size, tag_to_load.tag_info.data_offset, temp_plugin, fin, tag_to_load.map_off, 1, tag_to_load.datum_index, map_loc, tag_to_load.tag_info.type);
+					//temp_meta->Rebase_meta(0x0);
+					//found unnecessary
+
+					que_meta_list.emplace(tag_to_load.datum_index, temp_meta);
+					key_list.push_back(tag_to_load.datum_index);
+
+					if (recursive)
+					{
+						//queue the references not seen yet for the next level
+						for (int tag_ref : temp_meta->Get_all_tag_refs())
 						{
-							//most of time this is caused due to shared stuff
-							std::string temp_error = "Invalid Datum index :0x" + meta_struct::to_hex_string(*(load_tag_list.cbegin()));
-							error_list.push_back(temp_error);
+							if (que_meta_list.find(tag_ref) == que_meta_list.end()
+								&& queued_tags.insert(tag_ref).second)
+								load_tag_list.push_back(tag_ref);
 						}
 					}
 				}
-				//list cleaning stuff
-				load_tag_list.pop_front();
 			}
 			fin->close();
 
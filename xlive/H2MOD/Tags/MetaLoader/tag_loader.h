@@ -22,6 +22,8 @@ namespace tag_loader
 	bool Check_shared(std::ifstream* fin);
 	//Checks if the map file exists
 	bool Map_exists(std::string map);
+	//Returns the location of the map file (mods\\maps -> maps -> custom maps)
+	std::string Get_map_location(std::string map);
 	//Find tag datum based off of tag name
 	datum Get_tag_datum(std::string tag_name, blam_tag type, std::string map);
 	//Loads a tag from specified map in accordance with the datum index supplied
@@ -37,10 +37,59 @@ bool tags::cache_file_loaded()
 static char* tag_debug_names = nullptr;
 static std::map<uint32_t, const char*> tag_datum_name_map;
 
+// lower-cased tag name -> tag indices, multiple tag groups can use the same name
+static std::unordered_map<std::string, std::vector<uint32_t>> tag_name_index;
+// tag group -> indices of the tags of that group, or that have it as parent/grandparent
+static std::unordered_map<int, std::vector<uint32_t>> tag_group_index;
+
+// find_tag compares the names using _strnicmp(.., 256)
+#define TAG_NAME_INDEX_MAX_LENGTH 256
+
+static std::string tag_name_index_key(const char* name)
+{
+	std::string key(name, strnlen(name, TAG_NAME_INDEX_MAX_LENGTH));
+	for (auto& c : key)
+		c = tolower((unsigned char)c);
+	return key;
+}
+
 void clear_tag_debug_names()
 {
 	tag_datum_name_map.clear();
+	tag_name_index.clear();
+	tag_group_index.clear();
 	delete[] tag_debug_names;
+	tag_debug_names = nullptr;
+}
+
+static void build_tag_indexes()
+{
+	// parent info lookup is a bsearch, only do it once per tag group
+	std::unordered_map<int, const tags::tag_parent_info*> parent_info_cache;
+
+	tag_name_index.reserve(tag_datum_name_map.size());
+
+	for (auto& tag_name : tag_datum_name_map)
+	{
+		tag_name_index[tag_name_index_key(tag_name.second)].push_back(tag_name.first);
+
+		const blam_tag& type = tags::get_tag_instances()[tag_name.first].type;
+
+		auto parent_info_it = parent_info_cache.find(type.as_int());
+		if (parent_info_it == parent_info_cache.end())
+			parent_info_it = parent_info_cache.emplace(type.as_int(), tags::get_tag_parent_info(type)).first;
+
+		const tags::tag_parent_info* parent_info = parent_info_it->second;
+
+		tag_group_index[type.as_int()].push_back(tag_name.first);
+		if (parent_info != nullptr)
+		{
+			if (parent_info->parent != type && !parent_info->parent.is_none())
+				tag_group_index[parent_info->parent.as_int()].push_back(tag_name.first);
+			if (parent_info->grandparent != type && parent_info->grandparent != parent_info->parent && !parent_info->grandparent.is_none())
+				tag_group_index[parent_info->grandparent.as_int()].push_back(tag_name.first);
+		}
+	}
 }
 
 bool tags::load_tag_debug_name()
@@ -105,6 +154,8 @@ bool tags::load_tag_debug_name()
 		tag_datum_name_map[i] = &tag_debug_names[name_offset];
 	}
 
+	build_tag_indexes();
+
 	delete[] tag_name_offsets;
 	CloseHandle(cache_handle);
 	return true;
@@ -121,14 +172,15 @@ std::string tags::get_tag_name(datum tag_index)
 
 datum tags::find_tag(blam_tag type, const std::string& name)
 {
-	for (auto it = tag_datum_name_map.begin(); it != tag_datum_name_map.end(); it++)
+	auto it = tag_name_index.find(tag_name_index_key(name.c_str()));
+	if (it == tag_name_index.end())
+		return DATUM_INDEX_NONE;
+
+	for (uint32_t tag_index : it->second)
 	{
-		if (_strnicmp(name.c_str(), it->second, 256) == 0)
-		{
-			auto instance = tags::get_tag_instances()[it->first];
-			if (is_tag_or_parent_tag(instance.type, type))
-				return index_to_datum(it->first);
-		}
+		auto instance = tags::get_tag_instances()[tag_index];
+		if (is_tag_or_parent_tag(instance.type, type))
+			return index_to_datum(tag_index);
 	}
 	return DATUM_INDEX_NONE;
 }
@@ -136,13 +188,14 @@ datum tags::find_tag(blam_tag type, const std::string& name)
 std::map<datum, std::string> tags::find_tags(blam_tag type)
 {
 	std::map<datum, std::string> result;
-	for (auto it = tag_datum_name_map.begin(); it != tag_datum_name_map.end(); it++)
-	{
-		auto instance = tags::get_tag_instances()[it->first];
-		if (is_tag_or_parent_tag(instance.type, type)) {
-			result.emplace(index_to_datum(it->first), std::string(it->second));
-		}
-	}
+
+	auto it = tag_group_index.find(type.as_int());
+	if (it == tag_group_index.end())
+		return result;
+
+	for (uint32_t tag_index : it->second)
+		result.emplace(index_to_datum(tag_index), std::string(tag_datum_name_map[tag_index]));
+
 	return result;
 }
 
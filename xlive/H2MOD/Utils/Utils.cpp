@@ -1,6 +1,7 @@
 #include "stdafx.h"
 
 #include "Utils.h"
+#include "Util/hash.h"
 #include "H2MOD/Modules/Shell/Config.h"
 #include "H2MOD/Modules/OnScreenDebug/OnscreenDebug.h"
 #include <sys/timeb.h>
@@ -336,63 +337,11 @@ int HostnameToIp(char* hostname, char* ip) {
 
 DWORD crc32buf(const char* buf, size_t len)
 {
-	DWORD oldcrc32;
-
-	oldcrc32 = 0xFFFFFFFF;
-
-	for (; len; --len, ++buf)
-	{
-		oldcrc32 = UPDC32(*buf, oldcrc32);
-	}
-
-	return ~oldcrc32;
+	return hashes::crc32_update(0, buf, len);
 }
 
 bool ComputeFileCrc32Hash(wchar_t* filepath, DWORD &rtncrc32) {
-
-	DWORD oldcrc32;
-
-	oldcrc32 = 0xFFFFFFFF;
-
-	const int BUFSIZE = 1024;
-	BOOL bResult = FALSE;
-	HANDLE hFile = NULL;
-	BYTE rgbFile[BUFSIZE];
-	DWORD cbRead = 0;
-
-	hFile = CreateFile(filepath,
-		GENERIC_READ,
-		FILE_SHARE_READ,
-		NULL,
-		OPEN_EXISTING,
-		FILE_FLAG_SEQUENTIAL_SCAN,
-		NULL);
-
-	if (INVALID_HANDLE_VALUE == hFile)
-	{
-		return false;
-	}
-
-	while (bResult = ReadFile(hFile, rgbFile, BUFSIZE, &cbRead, NULL))
-	{
-		if (cbRead == 0) {
-			break;
-		}
-
-		for (unsigned int i = 0; i < cbRead; i++) {
-			oldcrc32 = UPDC32(rgbFile[i], oldcrc32);
-		}
-	}
-
-	if (!bResult) {
-		return false;
-	}
-
-	CloseHandle(hFile);
-
-	rtncrc32 = ~oldcrc32;
-
-	return true;
+	return hashes::calc_file_crc32(filepath, rtncrc32);
 }
 
 static bool rfc3986_allow(char i) {
@@ -516,7 +465,7 @@ int MasterHttpResponse(std::string& url, const char* http_request, char** rtn_re
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, http_request);
 
 		/* Perform the request, res will get the return code */
-		res = curl_easy_perform(curl);
+		res = curl_interface_perform(curl);
 		/* Check for errors */
 		if (res != CURLE_OK) {
 			result = ERROR_CODE_CURL_EASY_PERF;//curl_easy_perform() issue
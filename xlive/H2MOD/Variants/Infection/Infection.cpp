@@ -285,7 +285,7 @@ void Infection::Initialize()
 
 		last_time_at_game_should_not_end = 0;
 		zombiePlayerIndex = Infection::calculateZombiePlayerIndex();
-		EventHandler::register_callback(onGameTick, EventType::game_loop, EventExecutionType::execute_after);
+		EventHandler::register_callback<EventType::game_loop>(onGameTick, EventExecutionType::execute_after);
 
 		LOG_TRACE_GAME("[h2mod-infection] Peer host calculated zombie index {}", zombiePlayerIndex);
 		if (zombiePlayerIndex == NONE) {
@@ -306,7 +306,7 @@ void Infection::Dispose()
 
 	if(NetworkSession::LocalPeerIsSessionHost())
 	{
-		EventHandler::remove_callback(onGameTick, EventType::game_loop, EventExecutionType::execute_after);
+		EventHandler::remove_callback<EventType::game_loop>(onGameTick, EventExecutionType::execute_after);
 	}
 
 	Infection::resetWeaponInteractionAndEmblems();
@@ -2,6 +2,9 @@
 
 #include "curl-interface.h"
 
+#include <future>
+#include <thread>
+
 #ifdef _DEBUG
 #pragma comment(lib, "libcurl_a_debug.lib")
 #else
@@ -25,4 +28,223 @@ CURL* curl_interface_init_no_verify()
 	}
 
 	return nullptr;
-}
\ No newline at end of file
+}
+#pragma region shared executor
+// one multi handle for the whole DLL, so connections and TLS sessions are kept between requests
+#define CURL_INTERFACE_MAX_HOST_CONNECTIONS 4L
+#define CURL_INTERFACE_MAX_TOTAL_CONNECTIONS 16L
+#define CURL_INTERFACE_POLL_TIMEOUT_MS 1000
+
+struct s_curl_interface_request
+{
+	int id;
+	CURL* curl;
+	curl_interface_completion_t on_complete;
+	bool cleanup_handle;
+};
+
+static std::mutex curl_executor_mutex;
+static std::thread curl_executor_thread;
+static CURLM* curl_executor_multi = nullptr;
+static bool curl_executor_stop = false;
+static int curl_executor_next_request_id = 1;
+// both guarded by curl_executor_mutex, the executor thread moves them to curl_executor_running
+static std::vector<s_curl_interface_request> curl_executor_submitted;
+static std::vector<int> curl_executor_cancelled;
+// only accessed by the executor thread
+static std::unordered_map<CURL*, s_curl_interface_request> curl_executor_running;
+static std::unordered_set<int> curl_executor_running_ids;
+
+static void curl_executor_complete(s_curl_interface_request& request, CURLcode result)
+{
+	if (request.on_complete)
+		request.on_complete(request.curl, result);
+
+	if (request.cleanup_handle)
+		curl_easy_cleanup(request.curl);
+}
+
+static void curl_executor_run()
+{
+	std::vector<s_curl_interface_request> submitted;
+	std::vector<int> cancelled;
+
+	while (true)
+	{
+		{
+			std::lock_guard lg(curl_executor_mutex);
+			if (curl_executor_stop)
+			{
+				submitted.swap(curl_executor_submitted);
+				break;
+			}
+			submitted.swap(curl_executor_submitted);
+			cancelled.swap(curl_executor_cancelled);
+		}
+
+		for (auto& request : submitted)
+		{
+			// cancelled before it got picked up
+			auto cancelled_it = std::find(cancelled.begin(), cancelled.end(), request.id);
+			if (cancelled_it != cancelled.end())
+			{
+				cancelled.erase(cancelled_it);
+				curl_executor_complete(request, CURLE_ABORTED_BY_CALLBACK);
+				continue;
+			}
+
+			CURLMcode add_result = curl_multi_add_handle(curl_executor_multi, request.curl);
+			if (add_result != CURLM_OK)
+			{
+				LOG_ERROR_FUNC("curl_multi_add_handle failed: {}", curl_multi_strerror(add_result));
+				curl_executor_complete(request, CURLE_FAILED_INIT);
+				continue;
+			}
+
+			curl_executor_running_ids.insert(request.id);
+			curl_executor_running.emplace(request.curl, std::move(request));
+		}
+		submitted.clear();
+
+		for (int request_id : cancelled)
+		{
+			if (curl_executor_running_ids.erase(request_id) == 0)
+				continue;
+
+			auto it = std::find_if(curl_executor_running.begin(), curl_executor_running.end(),
+				[request_id](const auto& running) { return running.second.id == request_id; });
+
+			s_curl_interface_request request = std::move(it->second);
+			curl_executor_running.erase(it);
+			curl_multi_remove_handle(curl_executor_multi, request.curl);
+			curl_executor_complete(request, CURLE_ABORTED_BY_CALLBACK);
+		}
+		cancelled.clear();
+
+		int running_handles = 0;
+		curl_multi_perform(curl_executor_multi, &running_handles);
+
+		CURLMsg* msg;
+		int msgs_left = 0;
+		while ((msg = curl_multi_info_read(curl_executor_multi, &msgs_left)) != nullptr)
+		{
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			// msg is freed when the handle is removed
+			CURL* curl = msg->easy_handle;
+			CURLcode result = msg->data.result;
+			curl_multi_remove_handle(curl_executor_multi, curl);
+
+			auto it = curl_executor_running.find(curl);
+			if (it == curl_executor_running.end())
+				continue;
+
+			s_curl_interface_request request = std::move(it->second);
+			curl_executor_running.erase(it);
+			curl_executor_running_ids.erase(request.id);
+			curl_executor_complete(request, result);
+		}
+
+		// woken up early by curl_multi_wakeup when new requests are submitted
+		curl_multi_poll(curl_executor_multi, NULL, 0, CURL_INTERFACE_POLL_TIMEOUT_MS, NULL);
+	}
+
+	// shutting down, abort whatever is left
+	for (auto& request : submitted)
+		curl_executor_complete(request, CURLE_ABORTED_BY_CALLBACK);
+
+	for (auto& running : curl_executor_running)
+	{
+		curl_multi_remove_handle(curl_executor_multi, running.first);
+		curl_executor_complete(running.second, CURLE_ABORTED_BY_CALLBACK);
+	}
+	curl_executor_running.clear();
+	curl_executor_running_ids.clear();
+}
+
+// must be called with curl_executor_mutex held
+static bool curl_executor_start()
+{
+	if (curl_executor_multi != nullptr)
+		return true;
+
+	curl_executor_multi = curl_multi_init();
+	if (curl_executor_multi == nullptr)
+		return false;
+
+	curl_multi_setopt(curl_executor_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+	curl_multi_setopt(curl_executor_multi, CURLMOPT_MAX_HOST_CONNECTIONS, CURL_INTERFACE_MAX_HOST_CONNECTIONS);
+	curl_multi_setopt(curl_executor_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, CURL_INTERFACE_MAX_TOTAL_CONNECTIONS);
+
+	curl_executor_thread = std::thread(curl_executor_run);
+	return true;
+}
+
+int curl_interface_perform_async(CURL* curl, curl_interface_completion_t on_complete, bool cleanup_handle)
+{
+	// prefer HTTP/2 and wait for a connection that can multiplex instead of opening a new one
+	// both are ignored if libcurl or the server don't support HTTP/2
+	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+	curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
+	std::lock_guard lg(curl_executor_mutex);
+	if (curl_executor_stop)
+		return -1;
+
+	if (!curl_executor_start())
+	{
+		LOG_ERROR_FUNC("failed to start the curl executor");
+		return -1;
+	}
+
+	s_curl_interface_request request;
+	request.id = curl_executor_next_request_id++;
+	request.curl = curl;
+	request.on_complete = std::move(on_complete);
+	request.cleanup_handle = cleanup_handle;
+	curl_executor_submitted.push_back(std::move(request));
+
+	curl_multi_wakeup(curl_executor_multi);
+	return curl_executor_submitted.back().id;
+}
+
+bool curl_interface_cancel(int request_id)
+{
+	// queued or running, the executor completes it either way so on_complete always runs on its thread
+	std::lock_guard lg(curl_executor_mutex);
+	if (curl_executor_multi == nullptr || curl_executor_stop)
+		return false;
+
+	curl_executor_cancelled.push_back(request_id);
+	curl_multi_wakeup(curl_executor_multi);
+	return true;
+}
+
+CURLcode curl_interface_perform(CURL* curl)
+{
+	auto result = std::make_shared<std::promise<CURLcode>>();
+	std::future<CURLcode> result_future = result->get_future();
+
+	if (curl_interface_perform_async(curl, [result](CURL*, CURLcode code) { result->set_value(code); }, false) == -1)
+		return CURLE_FAILED_INIT;
+
+	return result_future.get();
+}
+
+void curl_interface_shutdown()
+{
+	{
+		std::lock_guard lg(curl_executor_mutex);
+		if (curl_executor_multi == nullptr || curl_executor_stop)
+			return;
+
+		curl_executor_stop = true;
+		curl_multi_wakeup(curl_executor_multi);
+	}
+
+	curl_executor_thread.join();
+	curl_multi_cleanup(curl_executor_multi);
+	curl_executor_multi = nullptr;
+}
+#pragma endregion
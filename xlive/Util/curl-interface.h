@@ -2,10 +2,32 @@
 
 #include "curl/curl.h"
 
+#include <functional>
+
 // curl errors
 #define ERROR_CODE_CURL_SOCKET_FAILED -40
 #define ERROR_CODE_CURL_HANDLE -41
 #define ERROR_CODE_CURL_EASY_PERF -42
 
 CURL* curl_interface_init();
-CURL* curl_interface_init_no_verify();
\ No newline at end of file
+CURL* curl_interface_init_no_verify();
+
+// called on the executor thread once the request finished, keep it short
+// the result is CURLE_ABORTED_BY_CALLBACK if the request got cancelled
+typedef std::function<void(CURL* curl, CURLcode result)> curl_interface_completion_t;
+
+// queues the request on the shared executor, which reuses connections between requests,
+// multiplexes them over HTTP/2 when the server supports it and limits the connections per host
+// the buffers the request points to must stay valid until on_complete runs
+// if cleanup_handle is set, the handle is cleaned up after on_complete
+// returns the request id, or -1 if the executor couldn't be started
+int curl_interface_perform_async(CURL* curl, curl_interface_completion_t on_complete, bool cleanup_handle = true);
+// cancels a queued or running request, cancelling a request that already completed does nothing
+// doesn't wait for the request, on_complete runs later on the executor thread like for any other request
+// returns false if the executor isn't running
+bool curl_interface_cancel(int request_id);
+// blocking version of curl_easy_perform going through the shared executor
+// must not be called from a completion callback
+CURLcode curl_interface_perform(CURL* curl);
+// aborts the pending requests and stops the executor, call before curl_global_cleanup
+void curl_interface_shutdown();
@@ -2,6 +2,9 @@
 
 #include "hash.h"
 
+#include <intrin.h>
+#include <wmmintrin.h>
+
 bool hash_open_file(const wchar_t *file_name, HANDLE &file)
 {
 	file = CreateFileW(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
@@ -17,17 +20,18 @@ bool hash_get_crypto_provider(DWORD type, HCRYPTPROV *provider)
 		CRYPT_VERIFYCONTEXT));
 }
 
-#define file_chunk_size 1024 * 32
+// large reads keep whole map hashing sequential and cut the syscall count
+#define file_chunk_size (1024 * 1024)
 
 bool hash_do_file_hashing(HANDLE file, HCRYPTHASH hash, DWORD flags, long long len)
 {
 	if (len == 0) {
 		len = LONG_MAX;
 	}
-	BYTE file_chunk[file_chunk_size];
 	DWORD len_to_read = min(file_chunk_size, len);
+	std::unique_ptr<BYTE[]> file_chunk(new BYTE[len_to_read]);
 	DWORD bytes_read = 0;
-	while (LOG_CHECK(ReadFile(file, file_chunk, len_to_read,
+	while (LOG_CHECK(ReadFile(file, file_chunk.get(), len_to_read,
 		&bytes_read, NULL)))
 	{
 		if (bytes_read == 0)
@@ -35,7 +39,7 @@ bool hash_do_file_hashing(HANDLE file, HCRYPTHASH hash, DWORD flags, long long l
 			return true;
 		}
 
-		if (!LOG_CHECK(CryptHashData(hash, file_chunk, bytes_read, flags)))
+		if (!LOG_CHECK(CryptHashData(hash, file_chunk.get(), bytes_read, flags)))
 		{
 			return false;
 		}
@@ -116,3 +120,225 @@ bool hashes::calc_file_md5(const std::string &filename, std::string &checksum_ou
 {
 	return hashes::calc_file_md5(wstring_to_string.from_bytes(filename), checksum_out, len_read);
 }
+
+#pragma region crc32
+// reflected CRC-32 (polynomial 0xEDB88320), same as zlib
+#define CRC32_POLYNOMIAL 0xEDB88320
+
+// slicing-by-8 tables, table[0] is the classic byte-wise table
+struct s_crc32_tables
+{
+	DWORD table[8][256];
+
+	constexpr s_crc32_tables() : table()
+	{
+		for (DWORD i = 0; i < 256; i++)
+		{
+			DWORD crc = i;
+			for (int bit = 0; bit < 8; bit++)
+				crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & (0 - (crc & 1)));
+			table[0][i] = crc;
+		}
+		for (DWORD i = 0; i < 256; i++)
+		{
+			for (int slice = 1; slice < 8; slice++)
+				table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+		}
+	}
+};
+
+static constexpr s_crc32_tables crc32_tables;
+
+// crc is the running (inverted) value
+static DWORD crc32_slicing_by_8(DWORD crc, const BYTE* data, size_t len)
+{
+	const auto& t = crc32_tables.table;
+
+	// align to 4 bytes so the 8 byte loads below are at least dword aligned
+	while (len > 0 && ((uintptr_t)data & 3) != 0)
+	{
+		crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+		len--;
+	}
+
+	while (len >= 8)
+	{
+		DWORD lo = *(const DWORD*)data ^ crc;
+		DWORD hi = *(const DWORD*)(data + 4);
+		crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+			^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+		data += 8;
+		len -= 8;
+	}
+
+	while (len-- > 0)
+		crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+	return crc;
+}
+
+// folding with carry-less multiplication, from Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"
+// consumes len bytes, len has to be a multiple of 16 and at least 64
+static DWORD crc32_pclmul(DWORD crc, const BYTE* data, size_t len)
+{
+	alignas(16) static const unsigned long long k1k2[2] = { 0x0154442bd4, 0x01c6e41596 };
+	alignas(16) static const unsigned long long k3k4[2] = { 0x01751997d0, 0x00ccaa009e };
+	alignas(16) static const unsigned long long k5k0[2] = { 0x0163cd6124, 0x0000000000 };
+	alignas(16) static const unsigned long long poly[2] = { 0x01db710641, 0x01f7011641 };
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	x0 = _mm_load_si128((const __m128i*)k1k2);
+	data += 64;
+	len -= 64;
+
+	// fold 4 lanes of 128 bits in parallel
+	while (len >= 64)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 0x30)));
+		data += 64;
+		len -= 64;
+	}
+
+	// fold the lanes into one
+	x0 = _mm_load_si128((const __m128i*)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// remaining 16 byte blocks
+	while (len >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data)), x5);
+		data += 16;
+		len -= 16;
+	}
+
+	// 128 to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// barrett reduction to 32 bits
+	x0 = _mm_load_si128((const __m128i*)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (DWORD)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+static bool cpu_has_pclmul()
+{
+	int cpu_info[4];
+	__cpuid(cpu_info, 1);
+	// ecx: PCLMULQDQ is bit 1, SSE2 in edx bit 26
+	return (cpu_info[2] & (1 << 1)) != 0 && (cpu_info[3] & (1 << 26)) != 0;
+}
+
+static const bool crc32_use_pclmul = cpu_has_pclmul();
+
+DWORD hashes::crc32_update(DWORD crc, const void* data, size_t len)
+{
+	const BYTE* bytes = (const BYTE*)data;
+	crc = ~crc;
+
+	// the folding kernel only pays off on larger buffers
+	if (crc32_use_pclmul && len >= 256)
+	{
+		size_t folded_len = len & ~(size_t)15;
+		crc = crc32_pclmul(crc, bytes, folded_len);
+		bytes += folded_len;
+		len -= folded_len;
+	}
+
+	return ~crc32_slicing_by_8(crc, bytes, len);
+}
+
+// whole maps don't fit the 32 bit address space, so the file is mapped a window at a time
+// has to be a multiple of the allocation granularity (64 KB)
+#define file_map_view_size (16 * 1024 * 1024)
+
+bool hashes::calc_file_crc32(const std::wstring &filename, DWORD &crc32_out)
+{
+	HANDLE file;
+	if (!hash_open_file(filename.c_str(), file))
+		return false;
+
+	bool result = false;
+	do
+	{
+		LARGE_INTEGER file_size;
+		if (!LOG_CHECK(GetFileSizeEx(file, &file_size)))
+			break;
+
+		// empty files can't be mapped
+		if (file_size.QuadPart == 0)
+		{
+			crc32_out = 0;
+			result = true;
+			break;
+		}
+
+		HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!LOG_CHECK(mapping != NULL))
+			break;
+
+		DWORD crc = 0;
+		long long offset = 0;
+		while (offset < file_size.QuadPart)
+		{
+			SIZE_T view_size = (SIZE_T)(std::min)((long long)file_map_view_size, file_size.QuadPart - offset);
+			const BYTE* view = (const BYTE*)MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, view_size);
+			if (!LOG_CHECK(view != nullptr))
+				break;
+
+			crc = crc32_update(crc, view, view_size);
+			UnmapViewOfFile(view);
+			offset += view_size;
+		}
+		CloseHandle(mapping);
+
+		if (offset == file_size.QuadPart)
+		{
+			crc32_out = crc;
+			result = true;
+		}
+	} while (0);
+
+	CloseHandle(file);
+	return result;
+}
+#pragma endregion
@@ -10,4 +10,10 @@ namespace hashes
 
 	bool calc_file_md5(const std::wstring &filename, BYTE *checksum, size_t &checksum_len, long long count = 0);
 	bool calc_file_md5(const std::wstring &filename, std::string &checksum_out, long long count = 0);
+
+	// streaming CRC-32 (zlib polynomial), start with crc = 0 and feed the data in any number of chunks
+	// uses carry-less multiplication when the cpu supports it, slicing-by-8 otherwise
+	DWORD crc32_update(DWORD crc, const void* data, size_t len);
+	// CRC-32 of a whole file, read through a file mapping
+	bool calc_file_crc32(const std::wstring &filename, DWORD &crc32_out);
 };
\ No newline at end of file
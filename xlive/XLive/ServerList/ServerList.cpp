@@ -13,9 +13,7 @@
 
 using namespace rapidjson;
 
-std::mutex CServerList::addServerMutex;
-std::mutex CServerList::removeServerMutex;
-std::mutex CServerList::getServerCountsMutex;
+std::atomic<bool> CServerList::getServerCountsPending = false;
 
 std::mutex serverListRequestMutex;
 std::unordered_map<HANDLE, CServerList*> serverListRequests;
@@ -142,10 +140,102 @@ int CServerList::GetValidItemsFoundCount()
 	return m_pageItemsFoundCount;
 }
 
-bool CServerList::SearchResultParseAndWrite(const std::string& serverResultData, XUID xuid, XLOCATOR_SEARCHRESULT* pOutSearchResult, XUSER_PROPERTY** propertiesBuffer, WCHAR** stringBuffer)
+// collects the server XUID strings out of the server list, without building a DOM of the whole list
+// expected format: { "servers": [ "xuid", "xuid", ... ] }
+struct ServerListXuidHandler : public BaseReaderHandler<UTF8<>, ServerListXuidHandler>
 {
-	XLOCATOR_SEARCHRESULT searchResult;
+	ServerListXuidHandler(std::vector<std::string>* _serverXuids) :
+		serverXuids(_serverXuids)
+	{
+	}
+
+	bool StartObject() { depth++; return true; }
+	bool EndObject(SizeType memberCount) { depth--; return true; }
+
+	bool StartArray()
+	{
+		depth++;
+		if (depth == 2 && serversKey)
+			inServersArray = true;
+		return true;
+	}
+
+	bool EndArray(SizeType elementCount)
+	{
+		if (depth == 2)
+			inServersArray = false;
+		depth--;
+		return true;
+	}
+
+	bool Key(const char* str, SizeType length, bool copy)
+	{
+		if (depth == 1)
+			serversKey = length == 7 && strncmp(str, "servers", 7) == 0;
+		return true;
+	}
+
+	bool String(const char* str, SizeType length, bool copy)
+	{
+		if (inServersArray)
+			serverXuids->emplace_back(str, length);
+		return true;
+	}
+
+	bool Default() { return true; }
+
+	std::vector<std::string>* serverXuids;
+	int depth = 0;
+	bool serversKey = false;
+	bool inServersArray = false;
+};
+
+// server details cache, kept between server list refreshes
+// entries are validated using the ETag/Last-Modified headers sent by the server
+std::mutex CServerList::serverDetailsCacheMutex;
+std::unordered_map<XUID, CServerDetailsCacheEntry> CServerList::serverDetailsCache;
+
+struct ServerDetailsQuery
+{
+	CURL* curl = nullptr;
+	curl_slist* headers = nullptr;
+	std::string data;
+	std::string etag;
+	std::string lastModified;
+};
+
+static size_t ServerDetailsHeaderCb(char* buffer, size_t size, size_t nitems, void* userp)
+{
+	auto* itemQuery = reinterpret_cast<ServerDetailsQuery*>(userp);
+	size_t headerSize = size * nitems;
+
+	auto readHeaderValue = [&](const char* name, std::string& outValue) -> bool
+	{
+		size_t nameLen = strlen(name);
+		if (headerSize <= nameLen || _strnicmp(buffer, name, nameLen) != 0)
+			return false;
+
+		size_t valueStart = nameLen, valueEnd = headerSize;
+		while (valueStart < valueEnd && (buffer[valueStart] == ' ' || buffer[valueStart] == '\t'))
+			valueStart++;
+		while (valueEnd > valueStart && (buffer[valueEnd - 1] == '\r' || buffer[valueEnd - 1] == '\n' || buffer[valueEnd - 1] == ' '))
+			valueEnd--;
+
+		outValue.assign(buffer + valueStart, valueEnd - valueStart);
+		return true;
+	};
+
+	if (!readHeaderValue("ETag:", itemQuery->etag))
+		readHeaderValue("Last-Modified:", itemQuery->lastModified);
+
+	return headerSize;
+}
+
+bool CServerList::SearchResultParse(const std::string& serverResultData, XUID xuid, CServerDetailsCacheEntry* pOutEntry)
+{
+	XLOCATOR_SEARCHRESULT& searchResult = pOutEntry->searchResult;
 	ZeroMemory(&searchResult, sizeof(XLOCATOR_SEARCHRESULT));
+	pOutEntry->properties.clear();
 
 	rapidjson::Document doc;
 	doc.Parse(serverResultData.c_str());
@@ -153,6 +243,12 @@ bool CServerList::SearchResultParseAndWrite(const std::string& serverResultData,
 	// operation successful or not
 	bool result = false;
 
+	if (doc.HasParseError() || !doc.IsObject())
+	{
+		BadServer(xuid, "Invalid JSON");
+		return result;
+	}
+
 	if (!doc.HasMember("dwMaxPublicSlots")) {
 		BadServer(xuid, "Missing Member: dwMaxPublicSlots");
 		return result;
@@ -277,44 +373,16 @@ bool CServerList::SearchResultParseAndWrite(const std::string& serverResultData,
 		return result;
 	}
 
-	searchResult.cProperties = 0;
-	searchResult.pProperties = *propertiesBuffer;
-
-	std::vector<DWORD> propertiesWritten;
-
+	// all the properties are cached, the ones requested by the query are filtered when written to the page buffer
 	for (auto& property : doc["pProperties"].GetArray())
 	{
-		bool propertyNeeded = false;
-		DWORD propertyId = property["dwPropertyId"].GetInt();
-
-		for (int i = 0; i < m_searchPropertiesIdCount; i++)
-		{
-			if (propertyId == m_pSearchPropertyIds[i])
-			{
-				propertyNeeded = true;
-				break;
-			}
-		}
-
-		if (!propertyNeeded)
-		{
-			//LOG_INFO_XLIVE("{} - unrequested property ID: 0x{:X}, skipping", __FUNCTION__, propertyId);
-			continue;
-		}
-
-		// temporary memory
-		XUSER_PROPERTY tProperty;
+		CServerDetailsCacheEntry::Property cachedProperty;
+		XUSER_PROPERTY& tProperty = cachedProperty.property;
 		ZeroMemory(&tProperty, sizeof(XUSER_PROPERTY));
 
-		tProperty.dwPropertyId = propertyId;
+		tProperty.dwPropertyId = property["dwPropertyId"].GetInt();
 		tProperty.value.type = property["type"].GetInt();
 
-		propertiesWritten.push_back(propertyId);
-
-		const char* data = 0;
-		int str_len = 0;
-
-		std::wstring str;
 		GenericStringBuffer<UTF16<> > buffer;
 		Writer<GenericStringBuffer<UTF16<> >, UTF8<>, UTF16<> > writer(buffer);
 
@@ -331,22 +399,9 @@ bool CServerList::SearchResultParseAndWrite(const std::string& serverResultData,
 		case XUSER_DATA_TYPE_UNICODE:
 			writer.String(property["value"].GetString());
 
-			str.append(buffer.GetString());
-			str.erase(std::remove(str.begin(), str.end(), '"'), str.end());
-			str.erase(std::remove(str.begin(), str.end(), '\\'), str.end());
-
-			if (!m_cancelOperation)
-			{
-				SecureZeroMemory(*stringBuffer, X_PROPERTY_UNICODE_BUFFER_SIZE);
-
-				wcscpy(*stringBuffer, str.c_str());
-
-				tProperty.value.string.cbData = wcsnlen(*stringBuffer, 64) * sizeof(WCHAR) + 2;
-				tProperty.value.string.pwszData = *stringBuffer;
-
-				*stringBuffer = (WCHAR*)((BYTE*)(*stringBuffer) + X_PROPERTY_UNICODE_BUFFER_SIZE);
-			}
-
+			cachedProperty.string.append(buffer.GetString());
+			cachedProperty.string.erase(std::remove(cachedProperty.string.begin(), cachedProperty.string.end(), '"'), cachedProperty.string.end());
+			cachedProperty.string.erase(std::remove(cachedProperty.string.begin(), cachedProperty.string.end(), '\\'), cachedProperty.string.end());
 			break;
 
 		case XUSER_DATA_TYPE_BINARY:
@@ -357,41 +412,59 @@ bool CServerList::SearchResultParseAndWrite(const std::string& serverResultData,
 			break;
 		}
 
-		if (!m_cancelOperation)
-		{
-			searchResult.pProperties[searchResult.cProperties] = tProperty;
-			searchResult.cProperties++;
-			(*propertiesBuffer)++;
-		}
+		pOutEntry->properties.push_back(std::move(cachedProperty));
+	}
+
+	result = true;
+	return result;
+}
 
-		for (auto property : propertiesWritten)
+bool CServerList::SearchResultWrite(const CServerDetailsCacheEntry& entry, XLOCATOR_SEARCHRESULT* pOutSearchResult, XUSER_PROPERTY** propertiesBuffer, WCHAR** stringBuffer)
+{
+	if (m_cancelOperation)
+		return false;
+
+	XLOCATOR_SEARCHRESULT searchResult = entry.searchResult;
+	searchResult.cProperties = 0;
+	searchResult.pProperties = *propertiesBuffer;
+
+	for (auto& cachedProperty : entry.properties)
+	{
+		bool propertyNeeded = false;
+		for (int i = 0; i < m_searchPropertiesIdCount; i++)
 		{
-			int i = 0;
-			bool foundMatch = false;
-			for (; i < m_searchPropertiesIdCount; i++)
+			if (cachedProperty.property.dwPropertyId == m_pSearchPropertyIds[i])
 			{
-				if (m_pSearchPropertyIds[i] == property)
-				{
-					foundMatch = true;
-					break;
-				}
+				propertyNeeded = true;
+				break;
 			}
+		}
 
-			if (!foundMatch)
-			{
-				LOG_ERROR_XLIVE("{} - couldn't find property: 0x{:X}", __FUNCTION__, m_pSearchPropertyIds[i]);
-			}
+		if (!propertyNeeded)
+			continue;
+
+		XUSER_PROPERTY tProperty = cachedProperty.property;
+
+		if (tProperty.value.type == XUSER_DATA_TYPE_UNICODE)
+		{
+			SecureZeroMemory(*stringBuffer, X_PROPERTY_UNICODE_BUFFER_SIZE);
+
+			// string buffers hold at most 64 characters, plus the NULL character
+			wcsncpy(*stringBuffer, cachedProperty.string.c_str(), 64);
+
+			tProperty.value.string.cbData = wcsnlen(*stringBuffer, 64) * sizeof(WCHAR) + 2;
+			tProperty.value.string.pwszData = *stringBuffer;
+
+			*stringBuffer = (WCHAR*)((BYTE*)(*stringBuffer) + X_PROPERTY_UNICODE_BUFFER_SIZE);
 		}
-	}
 
-	if (!m_cancelOperation)
-	{
-		memcpy(pOutSearchResult, &searchResult, sizeof(XLOCATOR_SEARCHRESULT));
-		result = true;
+		searchResult.pProperties[searchResult.cProperties] = tProperty;
+		searchResult.cProperties++;
+		(*propertiesBuffer)++;
 	}
 
-	//LOG_ERROR_XLIVE("{} : string count: {}, properties: {}", __FUNCTION__, strings, nResult->cProperties);
-	return result;
+	memcpy(pOutSearchResult, &searchResult, sizeof(XLOCATOR_SEARCHRESULT));
+	return true;
 }
 
 void CServerList::EnumerateFromHttp()
@@ -436,15 +509,35 @@ void CServerList::EnumerateFromHttp()
 	curl_easy_setopt(curl, CURLOPT_URL, serverlist_url.c_str());
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BasicStrDownloadCb);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &m_serverListToDownload);
-	res = curl_easy_perform(curl);
+	res = curl_interface_perform(curl);
 	// clear curl resource after
 	curl_easy_cleanup(curl);
 
-	// parse json to document
-	rapidjson::Document document;
-	document.Parse(m_serverListToDownload.c_str());
+	// the list only holds the server XUIDs, read them without building a document
+	std::vector<std::string> serverXuids;
+	ServerListXuidHandler serverListHandler(&serverXuids);
+	Reader serverListReader;
+	StringStream serverListStream(m_serverListToDownload.c_str());
 
-	itemsLeftToDownload = document["servers"].Size();
+	if (res != CURLE_OK
+		|| serverListReader.Parse(serverListStream, serverListHandler).IsError())
+	{
+		LOG_ERROR_XLIVE("{} - failed to download/parse the server list, curl code: {}", __FUNCTION__, (int)res);
+
+		m_pOverlapped->InternalLow = ERROR_NO_MORE_FILES;
+		m_pOverlapped->InternalHigh = 0;
+		m_pOverlapped->dwExtendedError = HRESULT_FROM_WIN32(ERROR_NO_MORE_FILES);
+
+		cleanup();
+
+		return;
+	}
+
+	// not needed anymore
+	m_serverListToDownload.clear();
+	m_serverListToDownload.shrink_to_fit();
+
+	itemsLeftToDownload = serverXuids.size();
 	// in case we have just 1 serverlist 'page' to download
 	int itemListMaxQueryCount = (std::min)(itemsLeftToDownload, XLOCATOR_SERVER_PAGE_REPORT_ITEM_COUNT_MIN);
 
@@ -460,19 +553,35 @@ void CServerList::EnumerateFromHttp()
 		return;
 	}
 
+	// drop the cached servers that are not listed anymore
+	{
+		std::unordered_set<XUID> listedServers;
+		listedServers.reserve(serverXuids.size());
+		for (auto& xuidStr : serverXuids)
+			listedServers.insert(_strtoui64(xuidStr.c_str(), nullptr, 10));
+
+		std::lock_guard lg(serverDetailsCacheMutex);
+		for (auto it = serverDetailsCache.begin(); it != serverDetailsCache.end(); )
+		{
+			if (listedServers.find(it->first) == listedServers.end())
+				it = serverDetailsCache.erase(it);
+			else
+				++it;
+		}
+	}
+
 	m_itemsLeftInDoc = itemsLeftToDownload;
 
 	curl_mhandle = curl_multi_init();
 	curl_multi_setopt(curl_mhandle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
 
-	std::vector<std::pair<CURL*, std::string>> itemsToDownloadQuery(itemListMaxQueryCount);
+	std::vector<ServerDetailsQuery> itemsToDownloadQuery(itemListMaxQueryCount);
 
 	bool itemQueryError = false;
 
 	// build the list to download
-	auto& serverXuidArray = document["servers"].GetArray();
-	auto xuidStrItr = serverXuidArray.Begin();
-	auto xuidStrWriteItemItr = serverXuidArray.Begin();
+	auto xuidStrItr = serverXuids.begin();
+	auto xuidStrWriteItemItr = serverXuids.begin();
 
 	while (!itemQueryError
 		&& itemsLeftToDownload > 0
@@ -502,36 +611,56 @@ void CServerList::EnumerateFromHttp()
 		int serverQueryIdx = 0;
 
 		// this starts from where it left off
-		for (; xuidStrItr != serverXuidArray.End(); ++xuidStrItr)
+		for (; xuidStrItr != serverXuids.end(); ++xuidStrItr)
 		{
 			// we reached max ITEM download size, break out and download the servers
 			if (serverQueryIdx < itemListMaxQueryCount)
 			{
 				// simply reuse the curl handle/allocated std::string buffer if already present
-				if (itemsToDownloadQuery[serverQueryIdx].first == nullptr)
+				if (itemsToDownloadQuery[serverQueryIdx].curl == nullptr)
 				{
-					itemsToDownloadQuery[serverQueryIdx] = std::make_pair(curl_interface_init_no_verify(), std::string());
+					itemsToDownloadQuery[serverQueryIdx].curl = curl_interface_init_no_verify();
 				}
 				else
 				{
 					// remove the handle first, easy handle still valid, to update the easyopts
-					curl_multi_remove_handle(curl_mhandle, itemsToDownloadQuery[serverQueryIdx].first);
-					itemsToDownloadQuery[serverQueryIdx].second.clear();
+					curl_multi_remove_handle(curl_mhandle, itemsToDownloadQuery[serverQueryIdx].curl);
 				}
 
 				auto& itemQuery = itemsToDownloadQuery[serverQueryIdx++];
+				itemQuery.data.clear();
+				itemQuery.etag.clear();
+				itemQuery.lastModified.clear();
+				curl_slist_free_all(itemQuery.headers);
+				itemQuery.headers = NULL;
 
-				std::string server_url = std::string(cartographerURL + "/live/servers/" + xuidStrItr->GetString());
+				// if we already know the server, ask only for changes
+				{
+					std::lock_guard lg(serverDetailsCacheMutex);
+					auto cachedServer = serverDetailsCache.find(_strtoui64(xuidStrItr->c_str(), nullptr, 10));
+					if (cachedServer != serverDetailsCache.end())
+					{
+						if (!cachedServer->second.etag.empty())
+							itemQuery.headers = curl_slist_append(itemQuery.headers, ("If-None-Match: " + cachedServer->second.etag).c_str());
+						if (!cachedServer->second.lastModified.empty())
+							itemQuery.headers = curl_slist_append(itemQuery.headers, ("If-Modified-Since: " + cachedServer->second.lastModified).c_str());
+					}
+				}
+
+				std::string server_url = std::string(cartographerURL + "/live/servers/" + *xuidStrItr);
 
 				// server_url is copied to another buffer when setting CURLOPT_URL
-				curl_easy_setopt(itemQuery.first, CURLOPT_URL, server_url.c_str());
-				curl_easy_setopt(itemQuery.first, CURLOPT_WRITEFUNCTION, ServerlistDownloadWriteCb);
-				curl_easy_setopt(itemQuery.first, CURLOPT_WRITEDATA, &itemQuery.second);
-				curl_easy_setopt(itemQuery.first, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
-				curl_easy_setopt(itemQuery.first, CURLOPT_PIPEWAIT, 1L);
+				curl_easy_setopt(itemQuery.curl, CURLOPT_URL, server_url.c_str());
+				curl_easy_setopt(itemQuery.curl, CURLOPT_WRITEFUNCTION, ServerlistDownloadWriteCb);
+				curl_easy_setopt(itemQuery.curl, CURLOPT_WRITEDATA, &itemQuery.data);
+				curl_easy_setopt(itemQuery.curl, CURLOPT_HEADERFUNCTION, ServerDetailsHeaderCb);
+				curl_easy_setopt(itemQuery.curl, CURLOPT_HEADERDATA, &itemQuery);
+				curl_easy_setopt(itemQuery.curl, CURLOPT_HTTPHEADER, itemQuery.headers);
+				curl_easy_setopt(itemQuery.curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+				curl_easy_setopt(itemQuery.curl, CURLOPT_PIPEWAIT, 1L);
 
 				// (re-)add the handle to the list
-				curl_multi_add_handle(curl_mhandle, itemQuery.first);
+				curl_multi_add_handle(curl_mhandle, itemQuery.curl);
 			}
 			else
 			{
@@ -546,8 +675,9 @@ void CServerList::EnumerateFromHttp()
 			// after this we shouldn't have any other server to download
 			for (auto it = itemsToDownloadQuery.begin() + itemsLeftToDownload; it != itemsToDownloadQuery.end(); )
 			{
-				curl_multi_remove_handle(curl_mhandle, it->first);
-				curl_easy_cleanup(it->first);
+				curl_multi_remove_handle(curl_mhandle, it->curl);
+				curl_easy_cleanup(it->curl);
+				curl_slist_free_all(it->headers);
 				it = itemsToDownloadQuery.erase(it);
 			}
 		}
@@ -579,8 +709,42 @@ void CServerList::EnumerateFromHttp()
 			// vector should be XLOCATOR_SERVER_PAGE_REPORT_ITEM_COUNT_MIN in size
 			for (auto& itemQuery : itemsToDownloadQuery)
 			{
+				XUID xuid = _strtoui64(xuidStrWriteItemItr->c_str(), nullptr, 10);
+				long responseCode = 0;
+				curl_easy_getinfo(itemQuery.curl, CURLINFO_RESPONSE_CODE, &responseCode);
+
+				bool serverFound = false;
 				ZeroMemory(&searchResults[searchResultIdx], sizeof(XLOCATOR_SEARCHRESULT));
-				if (SearchResultParseAndWrite(itemQuery.second, std::stoll(xuidStrWriteItemItr->GetString()), &searchResults[searchResultIdx], &propertiesBuffer, &stringBuffer))
+
+				{
+					std::lock_guard lg(serverDetailsCacheMutex);
+					auto cachedServer = serverDetailsCache.find(xuid);
+
+					if (responseCode == 304 && cachedServer != serverDetailsCache.end())
+					{
+						// not modified since last refresh, use the cached details
+						serverFound = SearchResultWrite(cachedServer->second, &searchResults[searchResultIdx], &propertiesBuffer, &stringBuffer);
+					}
+					else
+					{
+						CServerDetailsCacheEntry entry;
+						if (responseCode == 200
+							&& SearchResultParse(itemQuery.data, xuid, &entry))
+						{
+							entry.etag = std::move(itemQuery.etag);
+							entry.lastModified = std::move(itemQuery.lastModified);
+							serverFound = SearchResultWrite(entry, &searchResults[searchResultIdx], &propertiesBuffer, &stringBuffer);
+							serverDetailsCache[xuid] = std::move(entry);
+						}
+						else if (cachedServer != serverDetailsCache.end())
+						{
+							// server gone or bad data, don't keep it around
+							serverDetailsCache.erase(cachedServer);
+						}
+					}
+				}
+
+				if (serverFound)
 				{
 					m_pageItemsFoundCount++;
 
@@ -614,10 +778,11 @@ void CServerList::EnumerateFromHttp()
 
 	for (auto& itemQuery : itemsToDownloadQuery)
 	{
-		curl_multi_remove_handle(curl_mhandle, itemQuery.first);
-		curl_easy_cleanup(itemQuery.first);
-		itemQuery.first = nullptr;
-		itemQuery.second.clear();
+		curl_multi_remove_handle(curl_mhandle, itemQuery.curl);
+		curl_easy_cleanup(itemQuery.curl);
+		curl_slist_free_all(itemQuery.headers);
+		itemQuery.curl = nullptr;
+		itemQuery.headers = NULL;
 	}
 	curl_multi_cleanup(curl_mhandle);
 
@@ -630,37 +795,47 @@ void CServerList::EnumerateFromHttp()
 
 void CServerList::GetServerCounts(PXOVERLAPPED pOverlapped)
 {
-	std::lock_guard<std::mutex> lg(getServerCountsMutex);
+	if (getServerCountsPending.exchange(true))
+		return;
 
 	CURL* curl;
-	CURLcode res;
-	std::string readBuffer;
 
 	curl = curl_interface_init_no_verify();
 	if (curl) {
 		std::string url(cartographerURL + "/live/dedicount.php");
+		auto readBuffer = std::make_shared<std::string>();
 
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BasicStrDownloadCb);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-		res = curl_easy_perform(curl);
-		curl_easy_cleanup(curl);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, readBuffer.get());
 
-		rapidjson::Document document;
-		document.Parse(readBuffer.c_str());
-
-		if (document.HasMember("public_count"))
+		auto onComplete = [readBuffer](CURL* curl, CURLcode res)
 		{
-			h2v_service_properties.total_count = document["total"].GetInt();
-			h2v_service_properties.total_peer = document["peer_count"].GetInt();
-			h2v_service_properties.total_peer_gold = document["peer_gold"].GetInt();
-			h2v_service_properties.total_public = document["public_count"].GetInt();
-			h2v_service_properties.total_public_gold = document["public_gold"].GetInt();
-
-			// we updated the results, they can be used just fine
-			CountResultsUpdated = true;
-		}
+			rapidjson::Document document;
+			document.Parse(readBuffer->c_str());
+
+			if (res == CURLE_OK && document.HasMember("public_count"))
+			{
+				h2v_service_properties.total_count = document["total"].GetInt();
+				h2v_service_properties.total_peer = document["peer_count"].GetInt();
+				h2v_service_properties.total_peer_gold = document["peer_gold"].GetInt();
+				h2v_service_properties.total_public = document["public_count"].GetInt();
+				h2v_service_properties.total_public_gold = document["public_gold"].GetInt();
+
+				// we updated the results, they can be used just fine
+				CountResultsUpdated = true;
+			}
+
+			getServerCountsPending = false;
+		};
+
+		if (curl_interface_perform_async(curl, onComplete) != -1)
+			return;
+
+		curl_easy_cleanup(curl);
 	}
+
+	getServerCountsPending = false;
 }
 
 DWORD CServerList::Enumerate(HANDLE hHandle, DWORD cbBuffer, CHAR* pvBuffer, PXOVERLAPPED pOverlapped)
@@ -731,11 +906,7 @@ DWORD CServerList::Enumerate(HANDLE hHandle, DWORD cbBuffer, CHAR* pvBuffer, PXO
 
 void CServerList::RemoveServer(PXOVERLAPPED pOverlapped)
 {
-	std::lock_guard<std::mutex> lk(removeServerMutex);
-
 	CURL *curl;
-	CURLcode res;
-	std::string readBuffer;
 
 	pOverlapped->InternalLow = ERROR_IO_INCOMPLETE;
 	pOverlapped->InternalHigh = 0;
@@ -754,13 +925,25 @@ void CServerList::RemoveServer(PXOVERLAPPED pOverlapped)
 		document.Accept(writer);
 
 		std::string url(cartographerURL + "/live/del_server.php");
+		auto readBuffer = std::make_shared<std::string>();
 
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BasicStrDownloadCb);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, readBuffer.get());
 		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, buffer.GetString());
-		res = curl_easy_perform(curl);
+		curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, buffer.GetString());
+
+		// the overlapped is completed once the request is done
+		auto onComplete = [readBuffer, pOverlapped](CURL* curl, CURLcode res)
+		{
+			pOverlapped->InternalLow = ERROR_SUCCESS;
+			pOverlapped->InternalHigh = 0;
+			pOverlapped->dwExtendedError = 0;
+		};
+
+		if (curl_interface_perform_async(curl, onComplete) != -1)
+			return;
+
 		curl_easy_cleanup(curl);
 	}
 
@@ -771,11 +954,7 @@ void CServerList::RemoveServer(PXOVERLAPPED pOverlapped)
 
 void CServerList::AddServer(DWORD dwUserIndex, DWORD dwServerType, XNKID xnkid, XNKEY xnkey, DWORD dwMaxPublicSlots, DWORD dwMaxPrivateSlots, DWORD dwFilledPublicSlots, DWORD dwFilledPrivateSlots, DWORD cProperties, PXUSER_PROPERTY pProperties, PXOVERLAPPED pOverlapped)
 {
-	std::lock_guard<std::mutex> lk(addServerMutex);
-
 	CURL *curl;
-	CURLcode res;
-	std::string readBuffer;
 
 	pOverlapped->InternalLow = ERROR_IO_INCOMPLETE;
 	pOverlapped->InternalHigh = 0; // this shouldn't even be checked by game's code, but for some reason it gets in Halo 2, InternalHIgh is used for enumerating data, where it holds how many elemets were retreived
@@ -868,13 +1047,25 @@ void CServerList::AddServer(DWORD dwUserIndex, DWORD dwServerType, XNKID xnkid,
 		document.Accept(writer);
 
 		std::string url(cartographerURL + "/live/add_server.php");
+		auto readBuffer = std::make_shared<std::string>();
 
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BasicStrDownloadCb);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, readBuffer.get());
 		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, buffer.GetString());
-		res = curl_easy_perform(curl);
+		curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, buffer.GetString());
+
+		// the overlapped is completed once the request is done
+		auto onComplete = [readBuffer, pOverlapped](CURL* curl, CURLcode res)
+		{
+			pOverlapped->InternalLow = ERROR_SUCCESS;
+			pOverlapped->InternalHigh = 0;
+			pOverlapped->dwExtendedError = 0;
+		};
+
+		if (curl_interface_perform_async(curl, onComplete) != -1)
+			return;
+
 		curl_easy_cleanup(curl);
 	}
 
@@ -887,7 +1078,8 @@ DWORD WINAPI XLocatorServerAdvertise(DWORD dwUserIndex, DWORD dwServerType, XNKI
 {
 	if (UserSignedOnline(dwUserIndex))
 	{
-		std::thread(&CServerList::AddServer, dwUserIndex, dwServerType, xnkid, xnkey, dwMaxPublicSlots, dwMaxPrivateSlots, dwFilledPublicSlots, dwFilledPrivateSlots, cProperties, pProperties, pOverlapped).detach();
+		// the request is built right away, while pProperties is still valid, and sent by the http executor
+		CServerList::AddServer(dwUserIndex, dwServerType, xnkid, xnkey, dwMaxPublicSlots, dwMaxPrivateSlots, dwFilledPublicSlots, dwFilledPrivateSlots, cProperties, pProperties, pOverlapped);
 		return HRESULT_FROM_WIN32(ERROR_IO_PENDING);
 	}
 	else
@@ -899,7 +1091,7 @@ DWORD WINAPI XLocatorServerUnAdvertise(DWORD dwUserIndex, PXOVERLAPPED pOverlapp
 	LOG_TRACE_XLIVE("XLocatorServerUnAdvertise()");
 	if (UserSignedOnline(dwUserIndex))
 	{
-		std::thread(&CServerList::RemoveServer, pOverlapped).detach();
+		CServerList::RemoveServer(pOverlapped);
 		return HRESULT_FROM_WIN32(ERROR_IO_PENDING);
 	}
 	else
@@ -919,7 +1111,7 @@ DWORD WINAPI XLocatorGetServiceProperty(DWORD dwUserIndex, DWORD cNumProperties,
 	// and get the properties asynchronously
 
 	if (UserSignedOnline(dwUserIndex))
-		std::thread(&CServerList::GetServerCounts, pOverlapped).detach();
+		CServerList::GetServerCounts(pOverlapped);
 
 	// we simply just give the game the results synchronously, if we have any
 	// it'll query the data each 5 seconds
@@ -88,6 +88,23 @@ typedef struct _HALO2VISTA_TITLE_SERVICE_PROPERTIES
 	int total_public_gold = 0;
 } HALO2VISTA_TITLE_SERVICE_PROPERTIES;
 
+// parsed server details, cached between server list refreshes
+struct CServerDetailsCacheEntry
+{
+	struct Property
+	{
+		XUSER_PROPERTY property;	// pwszData is set when written to the page buffer
+		std::wstring string;
+	};
+
+	XLOCATOR_SEARCHRESULT searchResult;	// cProperties/pProperties unused
+	std::vector<Property> properties;
+
+	// cache validators, sent back to the server when refreshing
+	std::string etag;
+	std::string lastModified;
+};
+
 class CServerList
 {
 public:
@@ -128,7 +145,8 @@ public:
 	void CancelOperation() { m_cancelOperation = true; }
 
 	void EnumerateFromHttp();
-	bool SearchResultParseAndWrite(const std::string& serverResultData, XUID xuid, XLOCATOR_SEARCHRESULT* pOutSearchResult, XUSER_PROPERTY** propertiesBuffer, WCHAR** stringBuffer);
+	static bool SearchResultParse(const std::string& serverResultData, XUID xuid, CServerDetailsCacheEntry* pOutEntry);
+	bool SearchResultWrite(const CServerDetailsCacheEntry& entry, XLOCATOR_SEARCHRESULT* pOutSearchResult, XUSER_PROPERTY** propertiesBuffer, WCHAR** stringBuffer);
 
 	void SetNewPageBuffer(DWORD cbBuffer, CHAR* pvBuffer)
 	{
@@ -170,9 +188,11 @@ public:
 // #pragma region ServerListQuery
 #pragma endregion 
 
-	static std::mutex addServerMutex;
-	static std::mutex removeServerMutex;
-	static std::mutex getServerCountsMutex;
+	// set while a server count request is in flight, the game asks every few seconds
+	static std::atomic<bool> getServerCountsPending;
+
+	static std::mutex serverDetailsCacheMutex;
+	static std::unordered_map<XUID, CServerDetailsCacheEntry> serverDetailsCache;
 };
 
 extern std::unordered_map<HANDLE, CServerList*> serverListRequests;
@@ -0,0 +1,245 @@
+#include "stdafx.h"
+
+#include "XOverlapped.h"
+
+#include <condition_variable>
+#include <thread>
+
+extern void Check_Overlapped(PXOVERLAPPED pOverlapped);
+
+#pragma region overlapped scheduler
+// the scheduled operations are local file I/O, a couple of workers keeps them off the game thread
+#define XOVERLAPPED_MAX_WORKER_COUNT 2
+
+enum e_xoverlapped_operation_state
+{
+	_xoverlapped_operation_queued,
+	_xoverlapped_operation_running
+};
+
+struct s_xoverlapped_operation
+{
+	PXOVERLAPPED overlapped;
+	xoverlapped_task_t task;
+	// pCompletionRoutine is queued as an APC to this thread
+	HANDLE issuing_thread;
+	e_xoverlapped_operation_state state;
+	bool cancelled;
+};
+
+struct s_xoverlapped_completion_apc
+{
+	PXOVERLAPPED_COMPLETION_ROUTINE routine;
+	DWORD result;
+	DWORD size;
+	PXOVERLAPPED overlapped;
+};
+
+static std::mutex xoverlapped_mutex;
+// signaled when an operation is queued or when the scheduler stops
+static std::condition_variable xoverlapped_queue_cv;
+// signaled when an operation completes
+static std::condition_variable xoverlapped_complete_cv;
+static std::vector<std::thread> xoverlapped_workers;
+static bool xoverlapped_stop = false;
+// all guarded by xoverlapped_mutex
+static std::deque<s_xoverlapped_operation*> xoverlapped_queue;
+static std::unordered_map<PXOVERLAPPED, s_xoverlapped_operation*> xoverlapped_operations;
+
+static void CALLBACK xoverlapped_completion_apc(ULONG_PTR param)
+{
+	s_xoverlapped_completion_apc* apc = (s_xoverlapped_completion_apc*)param;
+	apc->routine(apc->result, apc->size, (DWORD)apc->overlapped);
+	delete apc;
+}
+
+// must be called with xoverlapped_mutex held, the operation has to be removed from xoverlapped_operations already
+// the results are written under the lock, so the game can't see the overlapped completed while the scheduler still tracks it
+static void xoverlapped_complete(s_xoverlapped_operation* operation, DWORD result, DWORD size, DWORD extended_error)
+{
+	PXOVERLAPPED pOverlapped = operation->overlapped;
+
+	pOverlapped->InternalHigh = size;
+	pOverlapped->dwExtendedError = extended_error;
+	// publishes the results above, InternalLow is what the game polls
+	InterlockedExchange((volatile LONG*)&pOverlapped->InternalLow, (LONG)result);
+
+	if (pOverlapped->hEvent)
+		SetEvent(pOverlapped->hEvent);
+
+	if (pOverlapped->pCompletionRoutine && operation->issuing_thread)
+	{
+		s_xoverlapped_completion_apc* apc = new s_xoverlapped_completion_apc;
+		apc->routine = pOverlapped->pCompletionRoutine;
+		apc->result = result;
+		apc->size = size;
+		apc->overlapped = pOverlapped;
+
+		if (!QueueUserAPC(xoverlapped_completion_apc, operation->issuing_thread, (ULONG_PTR)apc))
+		{
+			LOG_ERROR_XLIVE("{} - failed to queue the completion routine, error: {}", __FUNCTION__, GetLastError());
+			delete apc;
+		}
+	}
+
+	if (operation->issuing_thread)
+		CloseHandle(operation->issuing_thread);
+	delete operation;
+
+	xoverlapped_complete_cv.notify_all();
+}
+
+static void xoverlapped_worker_run()
+{
+	std::unique_lock<std::mutex> lock(xoverlapped_mutex);
+
+	while (true)
+	{
+		xoverlapped_queue_cv.wait(lock, []() { return xoverlapped_stop || !xoverlapped_queue.empty(); });
+
+		if (xoverlapped_queue.empty())
+			break;
+
+		s_xoverlapped_operation* operation = xoverlapped_queue.front();
+		xoverlapped_queue.pop_front();
+		operation->state = _xoverlapped_operation_running;
+
+		DWORD size = 0;
+		DWORD extended_error = 0;
+
+		lock.unlock();
+		DWORD result = operation->task(&size, &extended_error);
+		lock.lock();
+
+		xoverlapped_operations.erase(operation->overlapped);
+
+		if (operation->cancelled)
+			xoverlapped_complete(operation, ERROR_CANCELLED, 0, HRESULT_FROM_WIN32(ERROR_CANCELLED));
+		else
+			xoverlapped_complete(operation, result, size, extended_error);
+	}
+}
+
+// must be called with xoverlapped_mutex held
+static void xoverlapped_start()
+{
+	if (!xoverlapped_workers.empty())
+		return;
+
+	unsigned int worker_count = (std::max)(1u, (std::min)(std::thread::hardware_concurrency(), (unsigned int)XOVERLAPPED_MAX_WORKER_COUNT));
+	for (unsigned int i = 0; i < worker_count; i++)
+		xoverlapped_workers.emplace_back(xoverlapped_worker_run);
+}
+
+DWORD xoverlapped_schedule(PXOVERLAPPED pOverlapped, xoverlapped_task_t task)
+{
+	pOverlapped->InternalLow = ERROR_IO_INCOMPLETE;
+	pOverlapped->InternalHigh = 0;
+	pOverlapped->dwExtendedError = HRESULT_FROM_WIN32(ERROR_IO_INCOMPLETE);
+
+	if (pOverlapped->hEvent)
+		ResetEvent(pOverlapped->hEvent);
+
+	std::unique_lock<std::mutex> lock(xoverlapped_mutex);
+
+	if (xoverlapped_stop)
+	{
+		lock.unlock();
+
+		DWORD size = 0;
+		DWORD extended_error = 0;
+		DWORD result = task(&size, &extended_error);
+
+		pOverlapped->InternalHigh = size;
+		pOverlapped->dwExtendedError = extended_error;
+		pOverlapped->InternalLow = result;
+
+		Check_Overlapped(pOverlapped);
+		return ERROR_IO_PENDING;
+	}
+
+	// the game shouldn't reuse an overlapped that is still in flight
+	assert(xoverlapped_operations.find(pOverlapped) == xoverlapped_operations.end());
+
+	s_xoverlapped_operation* operation = new s_xoverlapped_operation;
+	operation->overlapped = pOverlapped;
+	operation->task = std::move(task);
+	operation->issuing_thread = NULL;
+	operation->state = _xoverlapped_operation_queued;
+	operation->cancelled = false;
+
+	if (pOverlapped->pCompletionRoutine)
+	{
+		DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &operation->issuing_thread,
+			0, FALSE, DUPLICATE_SAME_ACCESS);
+	}
+
+	xoverlapped_start();
+	xoverlapped_operations[pOverlapped] = operation;
+	xoverlapped_queue.push_back(operation);
+	xoverlapped_queue_cv.notify_one();
+
+	return ERROR_IO_PENDING;
+}
+
+bool xoverlapped_cancel(PXOVERLAPPED pOverlapped)
+{
+	std::unique_lock<std::mutex> lock(xoverlapped_mutex);
+
+	auto it = xoverlapped_operations.find(pOverlapped);
+	if (it == xoverlapped_operations.end())
+		return false;
+
+	s_xoverlapped_operation* operation = it->second;
+	if (operation->state == _xoverlapped_operation_queued)
+	{
+		xoverlapped_queue.erase(std::find(xoverlapped_queue.begin(), xoverlapped_queue.end(), operation));
+		xoverlapped_operations.erase(it);
+		xoverlapped_complete(operation, ERROR_CANCELLED, 0, HRESULT_FROM_WIN32(ERROR_CANCELLED));
+		return true;
+	}
+
+	// the task can't be interrupted, wait for it so the caller can release the buffers once we return
+	operation->cancelled = true;
+	xoverlapped_complete_cv.wait(lock, [pOverlapped]() { return xoverlapped_operations.find(pOverlapped) == xoverlapped_operations.end(); });
+	return true;
+}
+
+bool xoverlapped_wait(PXOVERLAPPED pOverlapped)
+{
+	std::unique_lock<std::mutex> lock(xoverlapped_mutex);
+
+	if (xoverlapped_operations.find(pOverlapped) == xoverlapped_operations.end())
+		return false;
+
+	xoverlapped_complete_cv.wait(lock, [pOverlapped]() { return xoverlapped_operations.find(pOverlapped) == xoverlapped_operations.end(); });
+	return true;
+}
+
+void xoverlapped_shutdown()
+{
+	std::vector<std::thread> workers;
+	{
+		std::lock_guard lg(xoverlapped_mutex);
+		if (xoverlapped_stop)
+			return;
+
+		xoverlapped_stop = true;
+
+		// nobody is going to pick these up anymore
+		for (s_xoverlapped_operation* operation : xoverlapped_queue)
+		{
+			xoverlapped_operations.erase(operation->overlapped);
+			xoverlapped_complete(operation, ERROR_CANCELLED, 0, HRESULT_FROM_WIN32(ERROR_CANCELLED));
+		}
+		xoverlapped_queue.clear();
+
+		workers.swap(xoverlapped_workers);
+	}
+
+	// the running operations finish before the workers exit
+	xoverlapped_queue_cv.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+#pragma endregion
@@ -0,0 +1,20 @@
+#pragma once
+
+// runs on a scheduler worker, returns the value stored in InternalLow
+// pdwSize receives InternalHigh, pdwExtendedError receives dwExtendedError, both start zeroed
+typedef std::function<DWORD(DWORD* pdwSize, DWORD* pdwExtendedError)> xoverlapped_task_t;
+
+// marks the overlapped as pending (InternalLow = ERROR_IO_INCOMPLETE) and queues the task on the worker pool
+// once the task is done the results are written to the overlapped, hEvent is signaled and
+// pCompletionRoutine is queued as an APC to the thread that scheduled the operation
+// whatever the task writes to must stay valid until the overlapped completes, same as with the real XLive
+// returns ERROR_IO_PENDING, the task runs in place if the scheduler was already shut down
+DWORD xoverlapped_schedule(PXOVERLAPPED pOverlapped, xoverlapped_task_t task);
+// a queued operation completes right away with ERROR_CANCELLED, a running one is waited for and then marked cancelled
+// returns false if the overlapped isn't tracked by the scheduler (already completed or driven elsewhere)
+bool xoverlapped_cancel(PXOVERLAPPED pOverlapped);
+// blocks until the scheduled operation completes
+// returns false if the overlapped isn't tracked by the scheduler
+bool xoverlapped_wait(PXOVERLAPPED pOverlapped);
+// cancels the queued operations and stops the workers once the running ones finish
+void xoverlapped_shutdown();
@@ -1,11 +1,10 @@
 #include "stdafx.h"
 
 #include "XStorage.h"
+#include "XLive/XOverlapped/XOverlapped.h"
 
 namespace filesystem = std::filesystem;
 
-extern void Check_Overlapped(PXOVERLAPPED pOverlapped);
-
 // #5344: XStorageBuildServerPath
 DWORD WINAPI XStorageBuildServerPath(DWORD dwUserIndex, XSTORAGE_FACILITY StorageFacility,
 	const void *pvStorageFacilityInfo, DWORD dwStorageFacilityInfoSize,
@@ -67,29 +66,13 @@ DWORD WINAPI XStorageBuildServerPath(DWORD dwUserIndex, XSTORAGE_FACILITY Storag
 	return ERROR_SUCCESS;
 }
 
-// #5305: XStorageUploadFromMemory
-DWORD WINAPI XStorageUploadFromMemory(DWORD dwUserIndex, const WCHAR* wszServerPath, DWORD dwBufferSize, const BYTE* pbBuffer, PXOVERLAPPED pOverlapped)
+static DWORD storage_upload_from_memory(const std::wstring& serverPath, DWORD dwBufferSize, const BYTE* pbBuffer)
 {
-	LOG_TRACE_XLIVE(L"XStorageUploadFromMemory  ( wszServerPath = {}, dwBufferSize = {} )",
-		wszServerPath, dwBufferSize);
-
 	FILE* fp;
-	errno_t err = _wfopen_s(&fp, wszServerPath, L"wb");
+	errno_t err = _wfopen_s(&fp, serverPath.c_str(), L"wb");
 	if (err)
 	{
 		//LOG_TRACE_XLIVE(" - file copy failure, error: {}", err);
-
-		if (pOverlapped)
-		{
-			pOverlapped->InternalHigh = 0;
-			pOverlapped->InternalLow = ERROR_FUNCTION_FAILED;
-			pOverlapped->dwExtendedError = HRESULT_FROM_WIN32(ERROR_FUNCTION_FAILED);
-
-			Check_Overlapped(pOverlapped);
-
-			return ERROR_IO_PENDING;
-		}
-
 		return ERROR_FUNCTION_FAILED;
 	}
 
@@ -101,33 +84,40 @@ DWORD WINAPI XStorageUploadFromMemory(DWORD dwUserIndex, const WCHAR* wszServerP
 
 	fclose(fp);
 
-	if (pOverlapped)
-	{
-		pOverlapped->InternalLow = ERROR_SUCCESS;
-		pOverlapped->InternalHigh = dwBufferSize;
-		pOverlapped->dwExtendedError = 0;
+	return ERROR_SUCCESS;
+}
+
+// #5305: XStorageUploadFromMemory
+DWORD WINAPI XStorageUploadFromMemory(DWORD dwUserIndex, const WCHAR* wszServerPath, DWORD dwBufferSize, const BYTE* pbBuffer, PXOVERLAPPED pOverlapped)
+{
+	LOG_TRACE_XLIVE(L"XStorageUploadFromMemory  ( wszServerPath = {}, dwBufferSize = {} )",
+		wszServerPath, dwBufferSize);
 
-		Check_Overlapped(pOverlapped);
+	std::wstring serverPath(wszServerPath);
 
-		return ERROR_IO_PENDING;
+	if (pOverlapped)
+	{
+		// the file write runs on the overlapped scheduler, pbBuffer stays valid until the overlapped completes
+		return xoverlapped_schedule(pOverlapped, [serverPath, dwBufferSize, pbBuffer](DWORD* pdwSize, DWORD* pdwExtendedError) -> DWORD
+		{
+			DWORD result = storage_upload_from_memory(serverPath, dwBufferSize, pbBuffer);
+			if (result != ERROR_SUCCESS)
+			{
+				*pdwExtendedError = HRESULT_FROM_WIN32(result);
+				return result;
+			}
+
+			*pdwSize = dwBufferSize;
+			return ERROR_SUCCESS;
+		});
 	}
 
-	return ERROR_SUCCESS;
+	return storage_upload_from_memory(serverPath, dwBufferSize, pbBuffer);
 }
 
-// #5345: XStorageDownloadToMemory
-DWORD WINAPI XStorageDownloadToMemory(DWORD dwUserIndex,
-	const WCHAR *wszServerPath,
-	DWORD dwBufferSize,
-	const BYTE *pbBuffer,
-	DWORD cbResults,
-	XSTORAGE_DOWNLOAD_TO_MEMORY_RESULTS *pResults,
-	XOVERLAPPED *pXOverlapped
-)
+// returns ERROR_SUCCESS, ERROR_INSUFFICIENT_BUFFER or XONLINE_E_STORAGE_FILE_NOT_FOUND
+static DWORD storage_download_to_memory(DWORD dwUserIndex, const std::wstring& serverPath, DWORD dwBufferSize, const BYTE* pbBuffer, XSTORAGE_DOWNLOAD_TO_MEMORY_RESULTS* pResults)
 {
-	LOG_TRACE_XLIVE(L"XStorageDownloadToMemory  ( wszServerPath = {}, dwBufferSize = {}, cbResults = {} )",
-		wszServerPath, dwBufferSize, cbResults);
-
 	memset(pResults, 0, sizeof(XSTORAGE_DOWNLOAD_TO_MEMORY_RESULTS));
 
 	DWORD size = 0;
@@ -139,20 +129,10 @@ DWORD WINAPI XStorageDownloadToMemory(DWORD dwUserIndex,
 	GetSystemTime(&systemTime);
 	SystemTimeToFileTime(&systemTime, &fileTime);
 
-	errno_t err = _wfopen_s(&fp, wszServerPath, L"rb");
+	errno_t err = _wfopen_s(&fp, serverPath.c_str(), L"rb");
 	if (err)
 	{
 		LOG_TRACE_XLIVE("- ERROR: file does not exist");
-
-		if (pXOverlapped)
-		{
-			pXOverlapped->InternalHigh = 0;
-			pXOverlapped->InternalLow = (XONLINE_E_STORAGE_FILE_NOT_FOUND & 0xFFFF);
-			pXOverlapped->dwExtendedError = XONLINE_E_STORAGE_FILE_NOT_FOUND;
-
-			return ERROR_IO_PENDING;
-		}
-
 		return XONLINE_E_STORAGE_FILE_NOT_FOUND;
 	}
 
@@ -164,16 +144,6 @@ DWORD WINAPI XStorageDownloadToMemory(DWORD dwUserIndex,
 		LOG_TRACE_XLIVE("- ERROR_INSUFFICIENT_BUFFER = {}", ftell(fp));
 
 		fclose(fp);
-
-		if (pXOverlapped)
-		{
-			pXOverlapped->InternalHigh = 0;
-			pXOverlapped->InternalLow = ERROR_INSUFFICIENT_BUFFER;
-			pXOverlapped->dwExtendedError = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
-
-			return ERROR_IO_PENDING;
-		}
-
 		return ERROR_INSUFFICIENT_BUFFER;
 	}
 
@@ -188,18 +158,48 @@ DWORD WINAPI XStorageDownloadToMemory(DWORD dwUserIndex,
 
 	fclose(fp);
 
-	if (pXOverlapped)
-	{
-		pXOverlapped->InternalLow = ERROR_SUCCESS;
-		pXOverlapped->dwExtendedError = 0;
-		pXOverlapped->InternalHigh = size;
+	return ERROR_SUCCESS;
+}
+
+// #5345: XStorageDownloadToMemory
+DWORD WINAPI XStorageDownloadToMemory(DWORD dwUserIndex,
+	const WCHAR *wszServerPath,
+	DWORD dwBufferSize,
+	const BYTE *pbBuffer,
+	DWORD cbResults,
+	XSTORAGE_DOWNLOAD_TO_MEMORY_RESULTS *pResults,
+	XOVERLAPPED *pXOverlapped
+)
+{
+	LOG_TRACE_XLIVE(L"XStorageDownloadToMemory  ( wszServerPath = {}, dwBufferSize = {}, cbResults = {} )",
+		wszServerPath, dwBufferSize, cbResults);
 
-		Check_Overlapped(pXOverlapped);
+	std::wstring serverPath(wszServerPath);
 
-		return ERROR_IO_PENDING;
+	if (pXOverlapped)
+	{
+		// the file read runs on the overlapped scheduler, pbBuffer and pResults stay valid until the overlapped completes
+		return xoverlapped_schedule(pXOverlapped, [dwUserIndex, serverPath, dwBufferSize, pbBuffer, pResults](DWORD* pdwSize, DWORD* pdwExtendedError) -> DWORD
+		{
+			DWORD result = storage_download_to_memory(dwUserIndex, serverPath, dwBufferSize, pbBuffer, pResults);
+			switch (result)
+			{
+			case ERROR_SUCCESS:
+				*pdwSize = pResults->dwBytesTotal;
+				return ERROR_SUCCESS;
+
+			case XONLINE_E_STORAGE_FILE_NOT_FOUND:
+				*pdwExtendedError = XONLINE_E_STORAGE_FILE_NOT_FOUND;
+				return (XONLINE_E_STORAGE_FILE_NOT_FOUND & 0xFFFF);
+
+			default:
+				*pdwExtendedError = HRESULT_FROM_WIN32(result);
+				return result;
+			}
+		});
 	}
 
-	return ERROR_SUCCESS;
+	return storage_download_to_memory(dwUserIndex, serverPath, dwBufferSize, pbBuffer, pResults);
 }
 
 // 5308
@@ -208,20 +208,19 @@ DWORD WINAPI XStorageDelete(DWORD dwUserIndex, const WCHAR *wszServerPath, XOVER
 	LOG_TRACE_XLIVE(L"XStorageDelete  (*** checkme ***) (a1 = {0:x}, a2 = {1}, a3 = {2:p})",
 		dwUserIndex, wszServerPath, (void*)pXOverlapped);
 
-	DeleteFile(wszServerPath);
-
 	if (pXOverlapped) {
 		//asynchronous
 
-		pXOverlapped->InternalLow = ERROR_SUCCESS;
-		pXOverlapped->dwExtendedError = 0;
-		pXOverlapped->InternalHigh = 0;
-
-		Check_Overlapped(pXOverlapped);
-
-		return ERROR_IO_PENDING;
+		std::wstring serverPath(wszServerPath);
+		return xoverlapped_schedule(pXOverlapped, [serverPath](DWORD* pdwSize, DWORD* pdwExtendedError) -> DWORD
+		{
+			DeleteFile(serverPath.c_str());
+			return ERROR_SUCCESS;
+		});
 	}
 
+	DeleteFile(wszServerPath);
+
 	return ERROR_SUCCESS;
 }
 
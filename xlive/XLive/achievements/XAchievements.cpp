@@ -206,7 +206,7 @@ DWORD WINAPI XUserWriteAchievements(DWORD dwNumAchievements, PXUSER_ACHIEVEMENT
 
 				AchievementMap[AchievementData.c_str()] = false;
 
-				std::thread(AchievementUnlock, usersSignInInfo[0].xuid, achievementID, pOverlapped).detach();
+				AchievementUnlock(usersSignInInfo[0].xuid, achievementID, pOverlapped);
 			}
 			else {
 				LOG_TRACE_GAME("Achievement {} was already unlocked", achievementID);
@@ -220,6 +220,9 @@ DWORD WINAPI XUserWriteAchievements(DWORD dwNumAchievements, PXUSER_ACHIEVEMENT
 		pOverlapped->InternalHigh = dwNumAchievements;
 		pOverlapped->dwExtendedError = 0;
 
+		// the unlocks are sent by the http executor, nothing left to wait for
+		Check_Overlapped(pOverlapped);
+
 		return ERROR_IO_PENDING;
 	}
 
@@ -32,6 +32,8 @@ void XnIpManager::Initialize(const XNetStartupParams* netStartupParams)
 
 	m_XnIPs = new XnIp[m_startupParams.cfgSecRegMax];
 	ZeroMemory(m_XnIPs, m_startupParams.cfgSecRegMax * sizeof(*m_XnIPs));
+	m_natIndex.clear();
+	m_natIndex.reserve(m_startupParams.cfgSecRegMax * H2v_socketsToConnect.size());
 
 	if (m_startupParams.cfgKeyRegMax == 0)
 		m_startupParams.cfgKeyRegMax = 4; // default 4 key pairs
@@ -63,9 +65,10 @@ void XnIpManager::UpdatePacketReceivedCounters(IN_ADDR ipIdentifier, unsigned in
 	XnIp* xnIp = GetConnection(ipIdentifier);
 	if (xnIp != nullptr)
 	{
-		xnIp->UpdateInteractionTimeHappened();
-		xnIp->m_pckStats.PckRecvdStatsUpdate(1, bytesRecvdCount);
-		GetLocalUserXn()->m_pckStats.PckRecvdStatsUpdate(1, bytesRecvdCount);
+		ULONGLONG timeNowMsec = _Shell::QPCToTimeNowMsec();
+		xnIp->UpdateInteractionTimeHappened(timeNowMsec);
+		xnIp->m_pckStats.PckRecvdStatsUpdate(1, bytesRecvdCount, timeNowMsec);
+		GetLocalUserXn()->m_pckStats.PckRecvdStatsUpdate(1, bytesRecvdCount, timeNowMsec);
 	}
 }
 
@@ -259,36 +262,24 @@ int XnIpManager::GetEstablishedConnectionIdentifierByRecvAddr(XSocket* xsocket,
 {
 	outConnectionIdentifier->s_addr = 0;
 
-	for (int i = 0; i < GetMaxXnConnections(); i++)
+	// TODO: get rid of H2v only sockets
+	if (H2v_socketsToConnect.find(xsocket->GetHostOrderSocketVirtualPort()) == H2v_socketsToConnect.end())
 	{
-		XnIp* xnIp = &m_XnIPs[i];
+		// wtf?... unknown socket
+		LOG_CRITICAL_NETWORK("{} - unkown network socket!", __FUNCTION__);
+		return WSAEINVAL;
+	}
+
+	auto natIndexIt = m_natIndex.find(XnIpNatIndexKey(xsocket->GetHostOrderSocketVirtualPort(), fromAddr));
+	if (natIndexIt != m_natIndex.end())
+	{
+		const XnIp* xnIp = &m_XnIPs[XnIp::GetConnectionIndex(natIndexIt->second)];
 		if (xnIp->m_valid
+			&& xnIp->GetConnectionId().s_addr == natIndexIt->second.s_addr
 			&& xnIp->NatIsUpdated())
 		{
-			// TODO: get rid of H2v only sockets
-			switch (xsocket->GetHostOrderSocketVirtualPort())
-			{
-			case 1000:
-				if (xsocket->SockAddrInEqual(fromAddr, xnIp->NatGetAddr(H2v_sockets::Sock1000)))
-				{
-					*outConnectionIdentifier = xnIp->GetConnectionId();
-					return 0;
-				}
-				break;
-
-			case 1001:
-				if (xsocket->SockAddrInEqual(fromAddr, xnIp->NatGetAddr(H2v_sockets::Sock1001)))
-				{
-					*outConnectionIdentifier = xnIp->GetConnectionId();
-					return 0;
-				}
-				break;
-
-			default:
-				// wtf?... unknown socket
-				LOG_CRITICAL_NETWORK("{} - unkown network socket!", __FUNCTION__);
-				return WSAEINVAL;
-			} // switch (xsocket->GetHostOrderSocketVirtualPort())
+			*outConnectionIdentifier = xnIp->GetConnectionId();
+			return 0;
 		}
 	}
 
@@ -296,6 +287,26 @@ int XnIpManager::GetEstablishedConnectionIdentifierByRecvAddr(XSocket* xsocket,
 	return WSAEINVAL;
 }
 
+void XnIpManager::NatIndexUpdate(u_short virtualPort, const sockaddr_in* oldAddr, const sockaddr_in* newAddr, IN_ADDR connectionId)
+{
+	if (oldAddr != nullptr)
+		NatIndexRemove(virtualPort, oldAddr, connectionId);
+
+	m_natIndex[XnIpNatIndexKey(virtualPort, newAddr)] = connectionId;
+}
+
+void XnIpManager::NatIndexRemove(u_short virtualPort, const sockaddr_in* addr, IN_ADDR connectionId)
+{
+	auto natIndexIt = m_natIndex.find(XnIpNatIndexKey(virtualPort, addr));
+
+	// another connection may have saved the same NAT address since, leave its entry alone
+	if (natIndexIt != m_natIndex.end()
+		&& natIndexIt->second.s_addr == connectionId.s_addr)
+	{
+		m_natIndex.erase(natIndexIt);
+	}
+}
+
 void XnIpManager::SetupLocalConnectionInfo(unsigned long xnaddr, unsigned long lanaddr, unsigned short baseport, const char* abEnet, const char* abOnline)
 {
 	SecureZeroMemory(&m_ipLocal, sizeof(m_ipLocal));
@@ -603,6 +614,7 @@ void XnIpManager::UnregisterXnIpIdentifier(const IN_ADDR ina)
 			__FUNCTION__, 
 			XnIp::GetConnectionIndex(ina), 
 			xnIp->GetConnectionId().s_addr);
+		xnIp->NatDiscard();
 		SecureZeroMemory(xnIp, sizeof(*xnIp));
 	}
 }
@@ -686,6 +698,24 @@ int XnIp::GetConnectionIndex(IN_ADDR connectionId)
 	return (int)(connectionId.s_addr >> 24);
 }
 
+// TODO: get rid of H2v only sockets
+static u_short NatIndexToVirtualPort(int natIndex)
+{
+	return (u_short)(1000 + natIndex);
+}
+
+void XnIp::NatDiscard()
+{
+	for (int i = 0; i < ARRAYSIZE(m_natTranslation); i++)
+	{
+		if (NatIsUpdated(i))
+			gXnIpMgr.NatIndexRemove(NatIndexToVirtualPort(i), &m_natTranslation[i].natAddress, GetConnectionId());
+
+		memset(&m_natTranslation[i], 0, sizeof(*m_natTranslation));
+		m_natTranslation[i].state = NatTranslation::eNatDataState::natUnavailable;
+	}
+}
+
 void XnIp::SaveNatInfo(XSocket* xsocket, const sockaddr_in* addr)
 {
 	LOG_TRACE_NETWORK("{} - socket: {}, connection index: {}, identifier: {:X}", __FUNCTION__,
@@ -700,22 +730,28 @@ void XnIp::SaveNatInfo(XSocket* xsocket, const sockaddr_in* addr)
 	*/
 
 	// TODO: get rid of H2v only sockets
+	H2v_sockets natIndex;
 	switch (xsocket->GetHostOrderSocketVirtualPort())
 	{
 	case 1000:
 		//LOG_TRACE_NETWORK("SaveConnectionNatInfo() xnIp->NatAddrSocket1000 mapping port 1000 - port: {}, connection identifier: {:x}", htons(addr->sin_port), xnIp->GetConnectionId().s_addr);
-		NatUpdate(H2v_sockets::Sock1000, addr);
+		natIndex = H2v_sockets::Sock1000;
 		break;
 
 	case 1001:
 		//LOG_TRACE_NETWORK("SaveConnectionNatInfo() xnIp->NatAddrSocket1001 mapping port 1001 - port: {}, connection identifier: {:x}", htons(addr->sin_port), xnIp->GetConnectionId().s_addr);
-		NatUpdate(H2v_sockets::Sock1001, addr);
+		natIndex = H2v_sockets::Sock1001;
 		break;
 
 	default:
 		LOG_CRITICAL_NETWORK("{} - unkown network socket!", __FUNCTION__);
-		break;
+		return;
 	} // switch (xsocket->GetHostOrderSocketVirtualPort())
+
+	// keep the receive address lookup in sync, drop the previous NAT address of this socket if there's one
+	const sockaddr_in* oldAddr = NatIsUpdated((int)natIndex) ? NatGetAddr(natIndex) : nullptr;
+	gXnIpMgr.NatIndexUpdate(xsocket->GetHostOrderSocketVirtualPort(), oldAddr, addr, GetConnectionId());
+	NatUpdate(natIndex, addr);
 }
 
 void XnIp::SendXNetRequestAllSockets(eXnip_ConnectRequestType reqType)
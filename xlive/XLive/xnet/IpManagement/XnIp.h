@@ -127,6 +127,12 @@ struct XnIpPckTransportStats
 	ULONGLONG	 lastPacketReceivedTime;
 
 	void PckDataSampleUpdate()
+	{
+		PckDataSampleUpdate(_Shell::QPCToTimeNowMsec());
+	}
+
+	// takes the current time, so callers updating multiple stats at once query the timer only once
+	void PckDataSampleUpdate(ULONGLONG timeNowMsec)
 	{
 		if (!bInit)
 		{
@@ -144,13 +150,13 @@ struct XnIpPckTransportStats
 			memset(pckSentPerSec, 0, sizeof(pckSentPerSec));
 			memset(pckRecvdPerSec, 0, sizeof(pckRecvdPerSec));
 
-			lastTimeUpdate = _Shell::QPCToTimeNowMsec();
+			lastTimeUpdate = timeNowMsec;
 		}
 		else
 		{
 			const ULONGLONG sample_end_time = 1ull * 1000ull;
 
-			if (_Shell::QPCToTimeNowMsec() - lastTimeUpdate >= sample_end_time)
+			if (timeNowMsec - lastTimeUpdate >= sample_end_time)
 			{
 				pckSentPerSecIdx = (pckSentPerSecIdx + 1) % XNIP_MAX_NET_STATS_SAMPLES;
 				pckRecvdPerSecIdx = (pckRecvdPerSecIdx + 1) % XNIP_MAX_NET_STATS_SAMPLES;
@@ -164,14 +170,19 @@ struct XnIpPckTransportStats
 				pckCurrentSendPerSecIdx = (pckCurrentSendPerSecIdx + 1) % XNIP_MAX_NET_STATS_SAMPLES;
 				pckCurrentRecvdPerSecIdx = (pckCurrentRecvdPerSecIdx + 1) % XNIP_MAX_NET_STATS_SAMPLES;
 
-				lastTimeUpdate = _Shell::QPCToTimeNowMsec();
+				lastTimeUpdate = timeNowMsec;
 			}
 		}
 	}
 
 	void PckSendStatsUpdate(unsigned int _pckXmit, unsigned int _pckXmitBytes)
 	{
-		PckDataSampleUpdate();
+		PckSendStatsUpdate(_pckXmit, _pckXmitBytes, _Shell::QPCToTimeNowMsec());
+	}
+
+	void PckSendStatsUpdate(unsigned int _pckXmit, unsigned int _pckXmitBytes, ULONGLONG timeNowMsec)
+	{
+		PckDataSampleUpdate(timeNowMsec);
 
 		pckSent += _pckXmit;
 		pckBytesSent += _pckXmitBytes;
@@ -182,7 +193,12 @@ struct XnIpPckTransportStats
 
 	void PckRecvdStatsUpdate(unsigned int _pckRecvd, unsigned int _pckRecvdBytes)
 	{
-		PckDataSampleUpdate();
+		PckRecvdStatsUpdate(_pckRecvd, _pckRecvdBytes, _Shell::QPCToTimeNowMsec());
+	}
+
+	void PckRecvdStatsUpdate(unsigned int _pckRecvd, unsigned int _pckRecvdBytes, ULONGLONG timeNowMsec)
+	{
+		PckDataSampleUpdate(timeNowMsec);
 
 		pckRecvd += _pckRecvd;
 		pckBytesRecvd += _pckRecvdBytes;
@@ -190,7 +206,7 @@ struct XnIpPckTransportStats
 		pckRecvdPerSec[pckRecvdPerSecIdx] += _pckRecvd;
 		pckBytesRecvdPerSec[pckRecvdPerSecIdx] += _pckRecvdBytes;
 
-		lastPacketReceivedTime = _Shell::QPCToTimeNowMsec();
+		lastPacketReceivedTime = timeNowMsec;
 	}
 
 private:
@@ -259,14 +275,7 @@ struct XnIp
 		m_natTranslation[index].state = NatTranslation::eNatDataState::natAvailable;
 	}
 
-	void NatDiscard()
-	{
-		for (int i = 0; i < ARRAYSIZE(m_natTranslation); i++)
-		{
-			memset(&m_natTranslation[i], 0, sizeof(*m_natTranslation));
-			m_natTranslation[i].state = NatTranslation::eNatDataState::natUnavailable;
-		}
-	}
+	void NatDiscard();
 
 	bool NatIsUpdated(int natIndex) const
 	{
@@ -329,7 +338,12 @@ public:
 
 	void UpdateInteractionTimeHappened()
 	{
-		m_lastConnectionInteractionTime = _Shell::QPCToTimeNowMsec();
+		UpdateInteractionTimeHappened(_Shell::QPCToTimeNowMsec());
+	}
+
+	void UpdateInteractionTimeHappened(ULONGLONG timeNowMsec)
+	{
+		m_lastConnectionInteractionTime = timeNowMsec;
 	}
 
 	IN_ADDR GetConnectionId() const
@@ -375,6 +389,37 @@ public:
 	void SendXNetRequestAllSockets(eXnip_ConnectRequestType reqType);
 };
 
+// key of the NAT index, the virtual socket port the NAT data was saved on and the endpoint's address
+struct XnIpNatIndexKey
+{
+	u_short virtualPort;
+	u_short natPort;
+	ULONG natAddr;
+
+	XnIpNatIndexKey(u_short _virtualPort, const sockaddr_in* addr)
+	{
+		virtualPort = _virtualPort;
+		natPort = addr->sin_port;
+		natAddr = addr->sin_addr.s_addr;
+	}
+
+	bool operator==(const XnIpNatIndexKey& other) const
+	{
+		return virtualPort == other.virtualPort
+			&& natPort == other.natPort
+			&& natAddr == other.natAddr;
+	}
+};
+
+struct XnIpNatIndexKeyHash
+{
+	size_t operator()(const XnIpNatIndexKey& key) const
+	{
+		unsigned long long value = ((unsigned long long)key.natAddr << 32) | ((unsigned long long)key.virtualPort << 16) | key.natPort;
+		return std::hash<unsigned long long>()(value);
+	}
+};
+
 class XnIpManager
 {
 public:
@@ -420,6 +465,10 @@ public:
 	int CreateOrGetXnIpIdentifierFromPacket(const XNADDR* pxna, const XNKID* xnkid, const XNetRequestPacket* reqPacket, IN_ADDR* outIpIdentifier);
 	int RegisterNewXnIp(const XNADDR* pxna, const XNKID* pxnkid, IN_ADDR* outIpIdentifier);
 	void UnregisterXnIpIdentifier(const IN_ADDR ina);
+
+	// NAT index, maps the address packets are received from to the connection identifier
+	void NatIndexUpdate(u_short virtualPort, const sockaddr_in* oldAddr, const sockaddr_in* newAddr, IN_ADDR connectionId);
+	void NatIndexRemove(u_short virtualPort, const sockaddr_in* addr, IN_ADDR connectionId);
 	
 	// Key functions
 	int RegisterKey(XNKID*, XNKEY*);
@@ -458,6 +507,7 @@ public:
 private:
 	static XnIp m_ipLocal;
 	XNetStartupParams m_startupParams;
+	std::unordered_map<XnIpNatIndexKey, IN_ADDR, XnIpNatIndexKeyHash> m_natIndex;
 };
 
 extern XnIpManager gXnIpMgr;
@@ -291,6 +291,78 @@ int XSocket::winsock_read_socket(
 	return result;
 }
 
+// drains the OS socket into the receive ring, XNet packets are consumed on the spot
+// and only the game packets get queued
+int XSocket::recv_ring_fill()
+{
+	if (recvRing == nullptr)
+		recvRing = std::make_unique<XSocketRecvRing>();
+
+	int lastError = WSAEWOULDBLOCK;
+	for (int i = 0; i < XSOCKET_RECV_RING_SLOT_COUNT && !recvRing->Full(); i++)
+	{
+		XSocketRecvSlot* slot = recvRing->Back();
+		int fromLen = sizeof(slot->from);
+
+		int result = ::recvfrom(this->winSockHandle, slot->buf, sizeof(slot->buf), 0, (sockaddr*)&slot->from, &fromLen);
+		if (result == SOCKET_ERROR)
+		{
+			lastError = WSAGetLastError();
+			if (lastError == WSAEMSGSIZE)
+			{
+				LOG_ERROR_NETWORK("{} - discarding datagram bigger than {} bytes", __FUNCTION__, sizeof(slot->buf));
+				continue;
+			}
+
+			break;
+		}
+
+		WSABUF slotBuffer;
+		slotBuffer.buf = slot->buf;
+		slotBuffer.len = sizeof(slot->buf);
+		slot->size = result;
+
+		// keep the slot only if the packet is meant for the game
+		if (gXnIpMgr.HandleRecvdPacket(this, &slot->from, &slotBuffer, 1, &slot->size) == 0)
+			recvRing->Push();
+	}
+
+	if (lastError != WSAEWOULDBLOCK)
+		LOG_ERROR_NETWORK("{} - socket error: {}", __FUNCTION__, lastError);
+
+	if (recvRing->Empty())
+	{
+		WSASetLastError(lastError);
+		return SOCKET_ERROR;
+	}
+
+	return 0;
+}
+
+int XSocket::recv_ring_read(LPWSABUF lpBuffers, LPDWORD lpNumberOfBytesRecvd, struct sockaddr* lpFrom, LPINT lpFromlen)
+{
+	XSocketRecvSlot* slot = recvRing->Front();
+	DWORD datagramSize = slot->size;
+	DWORD copySize = (std::min)(datagramSize, (DWORD)lpBuffers->len);
+
+	memcpy(lpBuffers->buf, slot->buf, copySize);
+	memcpy(lpFrom, &slot->from, sizeof(slot->from));
+	if (lpFromlen)
+		*lpFromlen = sizeof(slot->from);
+
+	*lpNumberOfBytesRecvd = copySize;
+	recvRing->Pop();
+
+	// same as recvfrom, let the caller know the datagram got truncated
+	if (copySize < datagramSize)
+	{
+		WSASetLastError(WSAEMSGSIZE);
+		return SOCKET_ERROR;
+	}
+
+	return 0;
+}
+
 int XSocket::sock_read(LPWSABUF lpBuffers,
 	DWORD dwBufferCount,
 	LPDWORD lpNumberOfBytesRecvd, 
@@ -300,6 +372,26 @@ int XSocket::sock_read(LPWSABUF lpBuffers,
 	LPWSAOVERLAPPED lpOverlapped, 
 	LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine)
 {
+#if COMPILE_WITH_STD_SOCK_FUNC && COMPILE_WITH_BATCHED_RECV
+	if (this->IsUDP()
+		&& lpFrom != NULL
+		&& lpFlags != NULL
+		&& *lpFlags == 0)
+	{
+		if (recvRing == nullptr
+			|| recvRing->Empty())
+		{
+			if (recv_ring_fill() == SOCKET_ERROR)
+			{
+				*lpNumberOfBytesRecvd = 0;
+				return SOCKET_ERROR;
+			}
+		}
+
+		return recv_ring_read(lpBuffers, lpNumberOfBytesRecvd, lpFrom, lpFromlen);
+	}
+#endif
+
 	// loop MAX_PACKETS_TO_READ_PER_RECV_CALL times until we get a valid packet
 	// unless Winsock API returns an error
 	for (int i = 0; i < MAX_PACKETS_TO_READ_PER_RECV_CALL; i++)
@@ -364,18 +456,24 @@ int WINAPI XSocketWSASendTo(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount, L
 	if (inTo->sin_addr.s_addr == INADDR_BROADCAST
 		|| inTo->sin_addr.s_addr == INADDR_ANY)
 	{
-		XBroadcastPacket* packet = (XBroadcastPacket*)_alloca(sizeof(XBroadcastPacket) + lpBuffers->len);
-		new (packet) XBroadcastPacket();
+		XBroadcastPacket packet;
 
-		memcpy((char*)packet + sizeof(XBroadcastPacket), lpBuffers->buf, lpBuffers->len);
+		// gather the broadcast header and the game's data, instead of copying them in a single buffer
+		WSABUF* broadcastBuffers = (WSABUF*)_alloca((dwBufferCount + 1) * sizeof(WSABUF));
+		broadcastBuffers[0].buf = (CHAR*)&packet;
+		broadcastBuffers[0].len = sizeof(XBroadcastPacket);
+		memcpy(&broadcastBuffers[1], lpBuffers, dwBufferCount * sizeof(WSABUF));
 
+		sockaddr_in broadcastAddr = *inTo;
 		int portOffset = H2Config_base_port % 1000;
 
 		// TODO: properly implement this broadcast BS
+		// Winsock doesn't have a way to submit multiple destinations in one call, send to each port
 		for (int i = 2000; i <= 5000; i += 1000)
 		{
-			inTo->sin_port = ntohs(i + portOffset + 1);
-			int result = sendto(xsocket->winSockHandle, (const char*)packet, sizeof(XBroadcastPacket) + lpBuffers->len, dwFlags, (sockaddr*)inTo, iTolen);
+			DWORD dwBroadcastBytesSent = 0;
+			broadcastAddr.sin_port = ntohs(i + portOffset + 1);
+			int result = WSASendTo(xsocket->winSockHandle, broadcastBuffers, dwBufferCount + 1, &dwBroadcastBytesSent, dwFlags, (const sockaddr*)&broadcastAddr, sizeof(broadcastAddr), NULL, NULL);
 			if (result == SOCKET_ERROR) {
 				return SOCKET_ERROR;
 			}
@@ -434,19 +532,11 @@ int WINAPI XSocketWSASendTo(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount, L
 		}
 
 		int result = SOCKET_ERROR;
-		DWORD pckSent = 0;
 		DWORD dwNumberOfBytesSent = 0;
 
 #if COMPILE_WITH_STD_SOCK_FUNC
-		for (DWORD i = 0ul; i < dwBufferCount; i++)
-		{
-			result = sendto(xsocket->winSockHandle, lpBuffers[i].buf, lpBuffers[i].len, dwFlags, (const sockaddr*)&sendToAddr, sizeof(sendToAddr));
-			if (result == SOCKET_ERROR)
-				break;
-
-			pckSent++;
-			dwNumberOfBytesSent += result;
-		}
+		// gather all the buffers in a single datagram, with a single call
+		result = WSASendTo(xsocket->winSockHandle, lpBuffers, dwBufferCount, &dwNumberOfBytesSent, dwFlags, (const sockaddr*)&sendToAddr, sizeof(sendToAddr), NULL, NULL);
 #else
 		result = WSASendTo(xsocket->winSockHandle, lpBuffers, dwBufferCount, &dwNumberOfBytesSent, dwFlags, (const sockaddr*)&sendToAddr, sizeof(sendToAddr), lpOverlapped, lpCompletionRoutine);
 #endif // if COMPILE_WITH_STD_SOCK_FUNC
@@ -462,11 +552,9 @@ int WINAPI XSocketWSASendTo(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount, L
 		}
 		else
 		{
-#if !COMPILE_WITH_STD_SOCK_FUNC
-			pckSent = dwBufferCount;
-#endif
-			xnIp->m_pckStats.PckSendStatsUpdate(pckSent, dwNumberOfBytesSent);
-			gXnIpMgr.GetLocalUserXn()->m_pckStats.PckSendStatsUpdate(pckSent, dwNumberOfBytesSent);
+			ULONGLONG timeNowMsec = _Shell::QPCToTimeNowMsec();
+			xnIp->m_pckStats.PckSendStatsUpdate(1, dwNumberOfBytesSent, timeNowMsec);
+			gXnIpMgr.GetLocalUserXn()->m_pckStats.PckSendStatsUpdate(1, dwNumberOfBytesSent, timeNowMsec);
 			if (lpNumberOfBytesSent)
 				*lpNumberOfBytesSent = dwNumberOfBytesSent;
 			
@@ -14,6 +14,12 @@
 
 #define MAX_PACKETS_TO_READ_PER_RECV_CALL 20
 
+// drain the UDP socket in one pass into a ring of datagrams, then serve the game's recv calls from it
+#define COMPILE_WITH_BATCHED_RECV 1
+
+#define XSOCKET_RECV_RING_SLOT_COUNT 64
+#define XSOCKET_RECV_RING_SLOT_SIZE 4096
+
 // the only needed sockets to be connected
 const static std::unordered_set<int> H2v_socketsToConnect =
 {
@@ -21,6 +27,41 @@ const static std::unordered_set<int> H2v_socketsToConnect =
 	1001
 };
 
+struct XSocketRecvSlot
+{
+	sockaddr_in from;
+	DWORD size;
+	char buf[XSOCKET_RECV_RING_SLOT_SIZE];
+};
+
+// datagrams that already went through the XNet packet handler
+// waiting to be read by the game
+struct XSocketRecvRing
+{
+	XSocketRecvSlot slots[XSOCKET_RECV_RING_SLOT_COUNT];
+	int head;
+	int count;
+
+	XSocketRecvRing()
+	{
+		head = 0;
+		count = 0;
+	}
+
+	bool Empty() const { return count == 0; }
+	bool Full() const { return count == XSOCKET_RECV_RING_SLOT_COUNT; }
+
+	XSocketRecvSlot* Front() { return &slots[head]; }
+	XSocketRecvSlot* Back() { return &slots[(head + count) % XSOCKET_RECV_RING_SLOT_COUNT]; }
+
+	void Push() { count++; }
+	void Pop()
+	{
+		head = (head + 1) % XSOCKET_RECV_RING_SLOT_COUNT;
+		count--;
+	}
+};
+
 struct XSocket
 {
 	int identifier;
@@ -28,6 +69,7 @@ struct XSocket
 	bool isVoiceSocket;
 	SOCKET winSockHandle;
 	sockaddr_in name;
+	std::unique_ptr<XSocketRecvRing> recvRing;
 
 	XSocket(int _protocol, bool _isVoiceSocket)
 	{
@@ -77,6 +119,9 @@ struct XSocket
 	int sock_read(LPWSABUF lpBuffers, DWORD dwBufferCount, LPDWORD lpNumberOfBytesRecvd, LPDWORD lpFlags, struct sockaddr* lpFrom, LPINT lpFromlen, LPWSAOVERLAPPED lpOverlapped, LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
 
 private:
+	int recv_ring_fill();
+	int recv_ring_read(LPWSABUF lpBuffers, LPDWORD lpNumberOfBytesRecvd, struct sockaddr* lpFrom, LPINT lpFromlen);
+
 	int winsock_read_socket(LPWSABUF lpBuffers, DWORD dwBufferCount, LPDWORD lpNumberOfBytesRecvd, LPDWORD lpFlags, struct sockaddr* lpFrom, LPINT lpFromlen, LPWSAOVERLAPPED lpOverlapped, LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine, bool* winApiError);
 };
 
@@ -11,305 +11,458 @@ using namespace std::chrono_literals;
 
 CXNetQoS XNetQoS;
 
-void ClientQoSLookUp(UINT cxna, XNADDR* pxna, UINT cProbes, IN_ADDR aina[], XNQOS** apxnqos, DWORD dwBitsPerSec, XNQOS* pqos)
-{
-	LIMITED_LOG(15, LOG_TRACE_NETWORK, "ClientQoSLookup( cxna: {}, cProbes: {})", cxna, cProbes);
+#define XNET_QOS_PROBE_MAGIC 0xAABBCCDD
+
+// the whole lookup has to finish in this time, no matter how many targets are probed
+#define XNET_QOS_LOOKUP_TIMEOUT_MSEC 2000
 
-	while (pqos->cxnqosPending > 0)
+struct XNetQoSProbe
+{
+	enum class eState
 	{
-		if (cProbes > 0)
-		{
-			XNADDR* xn = &pxna[pqos->cxnqosPending - 1];
-			XNQOSINFO* xnqosinfo = &pqos->axnqosinfo[(pqos->cxnqosPending - 1)];
+		idle,
+		connecting,
+		probing,
+		done
+	};
+
+	eState state;
+	SOCKET socket;
+	sockaddr_in addr;
+	XNQOSINFO* xnqosinfo;
+
+	UINT probesSent;
+	UINT probesRecvd;
+	int recvBytes;
+	BYTE* recvBuf;
+
+	std::chrono::steady_clock::time_point probeSendTime;
+	std::vector<long long> pingStorage;
+};
+
+static bool QoSProbeSend(XNetQoSProbe* probe)
+{
+	DWORD sendData = XNET_QOS_PROBE_MAGIC;
 
-			//	LOG_TRACE_NETWORK_N("[XNetQoSLookup] Looping cxnas for probes pqos->xnqosPending: {}", pqos->cxnqosPending);
+	probe->recvBytes = 0;
+	probe->probeSendTime = std::chrono::steady_clock::now();
+	if (send(probe->socket, (const char*)&sendData, sizeof(sendData), 0) != sizeof(sendData))
+		return false;
 
-			int iResult;
-			SOCKET connectSocket = INVALID_SOCKET;
-			struct addrinfo* result = NULL, * ptr = NULL, hints;
+	probe->probesSent++;
+	return true;
+}
 
-			ZeroMemory(&hints, sizeof(hints));
-			hints.ai_family = AF_INET;
-			hints.ai_socktype = SOCK_STREAM;
-			hints.ai_protocol = IPPROTO_TCP;
+static bool QoSProbeConnect(XNetQoSProbe* probe)
+{
+	probe->socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (probe->socket == INVALID_SOCKET)
+		return false;
 
-			std::string addr = inet_ntoa(xn->inaOnline);
-			std::string port = std::to_string(ntohs(xn->wPortOnline) + 10);
+	u_long nonBlocking = 1;
+	BOOL noDelay = TRUE;
+	ioctlsocket(probe->socket, FIONBIO, &nonBlocking);
+	setsockopt(probe->socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
 
-			//	LOG_TRACE_NETWORK_N("[XNetQoSLookup] QoSLookup, addr={0}, port={1}", addr.c_str(), prt.c_str());
+	if (connect(probe->socket, (const sockaddr*)&probe->addr, sizeof(probe->addr)) == SOCKET_ERROR
+		&& WSAGetLastError() != WSAEWOULDBLOCK)
+	{
+		return false;
+	}
 
-			// Resolve the server address and port
-			iResult = getaddrinfo(addr.c_str(), port.c_str(), &hints, &result);
-			if (iResult != 0) {
-				//	LOG_TRACE_NETWORK_N("[XnetQoSLookup] getaddrinfo failed with error: {}\n", iResult);
+	probe->state = XNetQoSProbe::eState::connecting;
+	return true;
+}
 
-				xnqosinfo->cProbesRecv = 0;
-				xnqosinfo->cProbesXmit = 0;
-				xnqosinfo->bFlags |= XNET_XNQOSINFO_TARGET_DISABLED;
+static void QoSProbeComplete(XNetQoSProbe* probe, XNQOS* pqos, DWORD dwBitsPerSec)
+{
+	if (probe->socket != INVALID_SOCKET)
+	{
+		closesocket(probe->socket);
+		probe->socket = INVALID_SOCKET;
+	}
 
-				if (pqos->cxnqosPending > 0)
-					pqos->cxnqosPending--;
+	XNQOSINFO* xnqosinfo = probe->xnqosinfo;
+	if (probe->probesRecvd > 0)
+	{
+		std::vector<long long>& pingStorage = probe->pingStorage;
+		std::sort(pingStorage.begin(), pingStorage.end());
+
+		size_t middle = pingStorage.size() / 2;
+		long long median = pingStorage.size() % 2 != 0 ? pingStorage[middle] : (pingStorage[middle - 1] + pingStorage[middle]) / 2;
+
+		xnqosinfo->wRttMinInMsecs = (WORD)pingStorage.front();
+		xnqosinfo->wRttMedInMsecs = (WORD)median;
+		xnqosinfo->cProbesRecv = probe->probesRecvd;
+		xnqosinfo->cProbesXmit = probe->probesSent;
+		xnqosinfo->pbData = probe->recvBuf; // released in XNetQosRelease
+		xnqosinfo->cbData = gXnIpMgr.GetReqQoSBufferSize();
+		xnqosinfo->dwUpBitsPerSec = dwBitsPerSec;
+		xnqosinfo->dwDnBitsPerSec = dwBitsPerSec;
+		xnqosinfo->bFlags |= (XNET_XNQOSINFO_TARGET_CONTACTED | XNET_XNQOSINFO_COMPLETE | XNET_XNQOSINFO_DATA_RECEIVED);
+	}
+	else
+	{
+		delete[] probe->recvBuf;
 
-				continue;
-			}
+		xnqosinfo->cProbesRecv = 0;
+		xnqosinfo->cProbesXmit = 0;
+		xnqosinfo->bFlags |= XNET_XNQOSINFO_TARGET_DISABLED;
+	}
 
-			for (ptr = result; ptr != NULL; ptr = ptr->ai_next) {
+	probe->recvBuf = nullptr;
+	probe->state = XNetQoSProbe::eState::done;
 
-				connectSocket = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-				if (connectSocket == INVALID_SOCKET) {
-					continue;
-				}
+	// the results have to be written before the game sees the entry is not pending anymore
+	InterlockedDecrement((volatile LONG*)&pqos->cxnqosPending);
+}
 
-				/* We're only allowing 500ms for a response from server, or connection to server to be established. */
-				DWORD nTimeout = 500;
-				setsockopt(connectSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&nTimeout, sizeof(DWORD));
-				setsockopt(connectSocket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&nTimeout, sizeof(DWORD));
+// probes all targets at the same time on non-blocking sockets, the results are written as they come
+void ClientQoSLookUp(UINT cxna, XNADDR* pxna, UINT cProbes, DWORD dwBitsPerSec, XNQOS* pqos, WSAEVENT hEvent)
+{
+	CHRONO_DEFINE_TIME_AND_CLOCK();
 
-				// Connect to server.
-				iResult = connect(connectSocket, ptr->ai_addr, (int)ptr->ai_addrlen);
-				if (iResult == SOCKET_ERROR) {
-					closesocket(connectSocket);
-					continue;
-				}
+	LIMITED_LOG(15, LOG_TRACE_NETWORK, "ClientQoSLookup( cxna: {}, cProbes: {})", cxna, cProbes);
 
-				break; // if we get here, we must have connected successfully
-			}
+	// we still need a round-trip to get the listener's data
+	const UINT probesToSend = (std::max)(cProbes, 1u);
+	const int recvBufLen = gXnIpMgr.GetReqQoSBufferSize();
 
-			freeaddrinfo(result);
+	std::vector<XNetQoSProbe> probes(cxna);
+	for (UINT i = 0; i < cxna; i++)
+	{
+		XNetQoSProbe* probe = &probes[i];
+		probe->state = XNetQoSProbe::eState::idle;
+		probe->socket = INVALID_SOCKET;
+		probe->xnqosinfo = &pqos->axnqosinfo[i];
+		probe->probesSent = 0;
+		probe->probesRecvd = 0;
+		probe->recvBytes = 0;
+		probe->recvBuf = new BYTE[recvBufLen];
+		ZeroMemory(probe->recvBuf, recvBufLen);
+
+		ZeroMemory(&probe->addr, sizeof(probe->addr));
+		probe->addr.sin_family = AF_INET;
+		probe->addr.sin_addr = pxna[i].inaOnline;
+		probe->addr.sin_port = htons(ntohs(pxna[i].wPortOnline) + 10);
+	}
 
-			if (connectSocket == INVALID_SOCKET || iResult == SOCKET_ERROR)
-			{
-				//	LOG_TRACE_NETWORK_N("[XNetQoSLookup] Unable to connect to server...");
+	// XNADDR
+	delete[] pxna;
 
-				xnqosinfo->cProbesRecv = 0;
-				xnqosinfo->cProbesXmit = 0;
-				xnqosinfo->bFlags |= XNET_XNQOSINFO_TARGET_DISABLED;
+	const auto deadline = _clock::now() + _time::milliseconds(XNET_QOS_LOOKUP_TIMEOUT_MSEC);
 
-				if (pqos->cxnqosPending > 0)
-					pqos->cxnqosPending--;
+	UINT nextProbeIdx = 0;
+	UINT completedCount = 0;
+	int activeCount = 0;
 
-				continue;
-			}
+	const auto completeProbe = [&](XNetQoSProbe* probe)
+	{
+		if (probe->state != XNetQoSProbe::eState::idle)
+			activeCount--;
 
-			int recvResult = 0;
-			int recvBufLen = gXnIpMgr.GetReqQoSBufferSize();
-			BYTE* recvBuf = new BYTE[recvBufLen];
-			ZeroMemory(recvBuf, recvBufLen);
+		QoSProbeComplete(probe, pqos, dwBitsPerSec);
+		completedCount++;
+	};
 
-			std::vector<long long> ping_storage;
-			int probes = cProbes;
-			do
-			{
-				//	LOG_TRACE_NETWORK_N("[XNetQoSLookup][Client] Sending Probe {}..",probes);
+	while (completedCount < cxna)
+	{
+		// start connecting to new targets while there's room in the select() sets
+		while (nextProbeIdx < cxna
+			&& activeCount < FD_SETSIZE)
+		{
+			XNetQoSProbe* probe = &probes[nextProbeIdx++];
+			if (QoSProbeConnect(probe))
+				activeCount++;
+			else
+				completeProbe(probe);
+		}
 
-				char send_data[4];
-				ZeroMemory(send_data, sizeof(send_data));
-				*(DWORD*)&send_data = 0xAABBCCDD;
+		if (activeCount == 0)
+			continue;
 
-				auto started = std::chrono::high_resolution_clock::now();
-				send(connectSocket, send_data, sizeof(send_data), 0);
-				recvResult = recv(connectSocket, (char*)recvBuf, recvBufLen, 0);
-				auto done = std::chrono::high_resolution_clock::now();
+		auto timeLeft = _time::duration_cast<_time::microseconds>(deadline - _clock::now());
+		if (timeLeft.count() <= 0)
+		{
+			LOG_TRACE_NETWORK("{} - lookup timed out, {} targets left", __FUNCTION__, cxna - completedCount);
+			break;
+		}
 
-				//	LOG_TRACE_NETWORK_N("[XNetQosLookup][Client] Probe got {} bytes of data back", RecvLen);
+		fd_set readFds, writeFds, exceptFds;
+		FD_ZERO(&readFds);
+		FD_ZERO(&writeFds);
+		FD_ZERO(&exceptFds);
 
-				std::chrono::milliseconds d = std::chrono::duration_cast<std::chrono::milliseconds>(done - started);
+		for (UINT i = 0; i < nextProbeIdx; i++)
+		{
+			XNetQoSProbe* probe = &probes[i];
+			switch (probe->state)
+			{
+			case XNetQoSProbe::eState::connecting:
+				FD_SET(probe->socket, &writeFds);
+				FD_SET(probe->socket, &exceptFds);
+				break;
+			case XNetQoSProbe::eState::probing:
+				FD_SET(probe->socket, &readFds);
+				break;
+			default:
+				break;
+			}
+		}
 
-				long long diff = d.count();
+		timeval timeout;
+		timeout.tv_sec = (long)(timeLeft.count() / 1000000);
+		timeout.tv_usec = (long)(timeLeft.count() % 1000000);
 
-				//	LOG_TRACE_NETWORK_N("[XNetQoSLookup][Client] Probe {} finished ping: %lld", probes, diff);
+		int selectResult = select(0, &readFds, &writeFds, &exceptFds, &timeout);
+		if (selectResult == SOCKET_ERROR)
+		{
+			LOG_ERROR_NETWORK("{} - select() failed with error: {}", __FUNCTION__, WSAGetLastError());
+			break;
+		}
 
-				ping_storage.push_back(diff);
+		for (UINT i = 0; i < nextProbeIdx; i++)
+		{
+			XNetQoSProbe* probe = &probes[i];
+			switch (probe->state)
+			{
+			case XNetQoSProbe::eState::connecting:
+				if (FD_ISSET(probe->socket, &exceptFds))
+				{
+					// connection refused or unreachable
+					completeProbe(probe);
+				}
+				else if (FD_ISSET(probe->socket, &writeFds))
+				{
+					probe->state = XNetQoSProbe::eState::probing;
+					if (!QoSProbeSend(probe))
+						completeProbe(probe);
+				}
+				break;
 
-				probes--;
-			} while (probes > 0);
+			case XNetQoSProbe::eState::probing:
+				if (FD_ISSET(probe->socket, &readFds))
+				{
+					int recvResult = recv(probe->socket, (char*)probe->recvBuf + probe->recvBytes, recvBufLen - probe->recvBytes, 0);
+					if (recvResult <= 0)
+					{
+						if (recvResult == 0 || WSAGetLastError() != WSAEWOULDBLOCK)
+							completeProbe(probe);
+						break;
+					}
+
+					probe->recvBytes += recvResult;
+					if (probe->recvBytes < recvBufLen)
+						break;
+
+					// got the whole reply
+					probe->pingStorage.push_back(_time::duration_cast<_time::milliseconds>(_clock::now() - probe->probeSendTime).count());
+					probe->probesRecvd++;
+
+					if (probe->probesSent >= probesToSend
+						|| !QoSProbeSend(probe))
+					{
+						completeProbe(probe);
+					}
+				}
+				break;
 
-			/*int WSAError = WSAGetLastError();
-			if (RecvLen == SOCKET_ERROR 
-				|| WSAError == WSAETIMEDOUT 
-				|| WSAError == WSAECONNRESET 
-				|| WSAError == WSAESHUTDOWN 
-				|| WSAError == WSAEINVAL 
-				|| connectSocket == INVALID_SOCKET 
-				|| connectSocket == SOCKET_ERROR)
-			{
-				closesocket(connectSocket);
-					LOG_TRACE_NETWORK_N("[XNetQoSLookup][Socket: %08X] Winsock Error Occured: %i - Socket Closed", connectSocket, WSAError);
-			}*/
+			default:
+				break;
+			}
+		}
+	}
 
-			closesocket(connectSocket);
+	// whatever is left didn't make it in time, report what we have
+	for (UINT i = 0; i < cxna; i++)
+	{
+		if (probes[i].state != XNetQoSProbe::eState::done)
+			completeProbe(&probes[i]);
+	}
 
-			if (recvResult <= 0 || recvResult != recvBufLen)
-			{
-				//	LOG_TRACE_NETWORK_N("[XNetQoSLookup][Socket: %08X] Disconnected!",connectSocket);
+	if (hEvent != NULL)
+		WSASetEvent(hEvent);
+}
 
-				xnqosinfo->cProbesRecv = 0;
-				xnqosinfo->cProbesXmit = 0;
-				xnqosinfo->bFlags |= XNET_XNQOSINFO_TARGET_DISABLED;
+bool CXNetQoS::IsListening()
+{
+	return m_listenerThreadRunning;
+}
 
-				if (pqos->cxnqosPending > 0)
-					pqos->cxnqosPending--;
+void CXNetQoS::SetBitsPerSec(DWORD dwBitsPerSec)
+{
+	m_dwBitsPerSec = dwBitsPerSec;
+}
 
-				continue;
-			}
+void CXNetQoS::GetListenStats(XNQOSLISTENSTATS* pQosListenStats)
+{
+	std::lock_guard<std::mutex> lg(m_listenStatsMutex);
+	memcpy(pQosListenStats, &m_listenStats, sizeof(XNQOSLISTENSTATS));
+	pQosListenStats->dwSizeOfStruct = sizeof(XNQOSLISTENSTATS);
+}
+
+void CXNetQoS::RefillTokens()
+{
+	ULONGLONG timeNow = _Shell::QPCToTimeNowMsec();
+	double bytesPerSec = (double)m_dwBitsPerSec / 8.0;
 
-			auto ping_result = std::minmax_element(ping_storage.begin(), ping_storage.end());
-			long long min_ping = *ping_result.first;
-			long long max_ping = *ping_result.second;
-			unsigned int average = (std::accumulate(ping_storage.begin(), ping_storage.end(), 0) / ping_storage.size());
+	// let a whole reply or a quarter of a second worth of data through at once
+	double bucketSize = (std::max)((double)gXnIpMgr.GetReqQoSBufferSize(), bytesPerSec / 4.0);
 
-			ping_storage.clear();
+	m_tokens = (std::min)(bucketSize, m_tokens + (double)(timeNow - m_lastTokensRefillTime) * bytesPerSec / 1000.0);
+	m_lastTokensRefillTime = timeNow;
+}
+
+DWORD CXNetQoS::GetWaitTimeout() const
+{
+	const DWORD idleTimeout = 1000;
 
-			//	LOG_TRACE_NETWORK_N("[XNetQoSLookup][Client] Finished Probes max_ping: {0}, min_ping: {1}, average: {2}", (WORD)max_ping, (WORD)min_ping,average);
+	DWORD dwBitsPerSec = m_dwBitsPerSec;
+	if (dwBitsPerSec == 0)
+		return idleTimeout;
 
-			xnqosinfo->wRttMinInMsecs = (WORD)min_ping;
-			xnqosinfo->wRttMedInMsecs = (WORD)average;
-			xnqosinfo->cProbesRecv = 4;
-			xnqosinfo->cProbesXmit = 4;
-			xnqosinfo->pbData = recvBuf;
-			xnqosinfo->cbData = recvBufLen;
-			xnqosinfo->dwUpBitsPerSec = dwBitsPerSec;
-			xnqosinfo->dwDnBitsPerSec = dwBitsPerSec;
-			xnqosinfo->bFlags |= (XNET_XNQOSINFO_TARGET_CONTACTED | XNET_XNQOSINFO_COMPLETE | XNET_XNQOSINFO_DATA_RECEIVED);
+	for (const auto& client : m_clients)
+	{
+		// replies waiting on the bandwidth limit, wake up when there's enough for some data to go out
+		if (client.pendingReplies > 0 && !client.sendBlocked)
+		{
+			double bytesNeeded = (std::min)(512.0, (double)(gXnIpMgr.GetReqQoSBufferSize() - client.replyBytesSent)) - m_tokens;
+			if (bytesNeeded <= 0.0)
+				return 0;
 
-			if (pqos->cxnqosPending > 0)
-				pqos->cxnqosPending--;
+			return (std::max)(1ul, (DWORD)(bytesNeeded * 8000.0 / (double)dwBitsPerSec));
 		}
 	}
 
-	// XNADDR
-	delete[] pxna;
+	return idleTimeout;
 }
 
-bool CXNetQoS::IsListening()
+void CXNetQoS::CloseClient(XNetQoSListenClient* client)
 {
-	return m_listenerThreadRunning;
+	closesocket(client->socket);
+	WSACloseEvent(client->event);
+	client->socket = INVALID_SOCKET;
+	client->event = WSA_INVALID_EVENT;
 }
 
-LPFN_ACCEPTEX lpfnAcceptEx = nullptr;
-
-void CALLBACK CXNetQoS::HandleClient(DWORD dwError, DWORD cbTransferred, LPWSAOVERLAPPED lpOverlapped, DWORD dwFlags)
+void CXNetQoS::AcceptClients()
 {
-	LPSOCKET_INFORMATION acceptSockInfo = reinterpret_cast<LPSOCKET_INFORMATION>(lpOverlapped);
-	//LOG_TRACE_NETWORK_N("{} - socket: {}", __FUNCTION__, acceptSockInfo->Socket);
-
-	do
-		// while (0) for the break functionality
-		// break in this context is goto cleanup; equivalent
+	while (true)
 	{
-		if (dwError != 0)
+		SOCKET acceptSocket = accept(m_ListenSocket, NULL, NULL);
+		if (acceptSocket == INVALID_SOCKET)
 		{
-			LOG_TRACE_NETWORK("{} - closing connection, dwError: {}", __FUNCTION__, dwError);
-			break;
+			if (WSAGetLastError() != WSAEWOULDBLOCK)
+				LOG_TRACE_NETWORK("{} - accept() failed with error: {}", __FUNCTION__, WSAGetLastError());
+			return;
 		}
 
-		if (cbTransferred == 0)
+		if (m_clients.size() >= XNET_QOS_LISTEN_MAX_CLIENTS)
 		{
-			//LOG_TRACE_NETWORK("{} - no bytes sent!", __FUNCTION__);
-			break;
+			closesocket(acceptSocket);
+
+			std::lock_guard<std::mutex> lg(m_listenStatsMutex);
+			m_listenStats.dwNumSlotsFullDiscards++;
+			continue;
 		}
 
-		// delete memory allocated inside SendBack callback
-		delete[] acceptSockInfo->DataBuf.buf;
+		XNetQoSListenClient client;
+		ZeroMemory(&client, sizeof(client));
+		client.socket = acceptSocket;
+		client.event = WSACreateEvent();
+		client.lastActivityTime = _Shell::QPCToTimeNowMsec();
 
-		acceptSockInfo->DataBuf.len = 4;
-		acceptSockInfo->DataBuf.buf = new char[acceptSockInfo->DataBuf.len];
-		ZeroMemory(&acceptSockInfo->Overlapped, sizeof(acceptSockInfo->Overlapped));
+		BOOL noDelay = TRUE;
+		setsockopt(acceptSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
 
-		DWORD flags = 0;
-		int recvResult = WSARecv(acceptSockInfo->Socket, &acceptSockInfo->DataBuf, 1, NULL, &flags, &acceptSockInfo->Overlapped, SendBack);
-		if (recvResult == 0)
+		// the accepted socket inherits the listen socket's event selection, replace it
+		if (client.event == WSA_INVALID_EVENT
+			|| WSAEventSelect(acceptSocket, client.event, FD_READ | FD_WRITE | FD_CLOSE) == SOCKET_ERROR)
 		{
-			// the operation will be completed synchronously
-			return;
+			LOG_TRACE_NETWORK("{} - failed to setup client socket events, error: {}", __FUNCTION__, WSAGetLastError());
+			CloseClient(&client);
+			continue;
 		}
-		else if (recvResult == SOCKET_ERROR)
-		{
-			if (WSAGetLastError() == WSA_IO_PENDING)
-			{
-				// the operation will be completed asynchronously, don't clear memory because it will be used
-				return;
-			}
-			else
-			{
-				LOG_TRACE_NETWORK("{} - WSARecv operation failed with error: {}", __FUNCTION__, WSAGetLastError());
-				break;
-			}
-		}
-	} while (0);
 
-	closesocket(acceptSockInfo->Socket);
-	delete[] acceptSockInfo->DataBuf.buf;
-	delete acceptSockInfo;
-	return;
+		m_clients.push_back(client);
+	}
 }
 
-void CALLBACK CXNetQoS::SendBack(DWORD dwError, DWORD cbTransferred, LPWSAOVERLAPPED lpOverlapped, DWORD dwFlags)
+bool CXNetQoS::ReadClient(XNetQoSListenClient* client)
 {
-	LPSOCKET_INFORMATION acceptSockInfo = reinterpret_cast<LPSOCKET_INFORMATION>(lpOverlapped);
+	while (true)
+	{
+		int recvResult = recv(client->socket, (char*)&client->recvData + client->recvBytes, (int)sizeof(client->recvData) - client->recvBytes, 0);
+		if (recvResult == 0)
+			return false;
 
-	//LOG_TRACE_NETWORK("{} - callback -> socket: {}", __FUNCTION__, acceptSockInfo->Socket);
+		if (recvResult == SOCKET_ERROR)
+			return WSAGetLastError() == WSAEWOULDBLOCK;
 
-	do
-		// while (0) for the break functionality
-		// break in this context is goto cleanup; equivalent
-	{
-		if (dwError != (DWORD)0)
+		client->lastActivityTime = _Shell::QPCToTimeNowMsec();
+		client->recvBytes += recvResult;
+		if (client->recvBytes < (int)sizeof(client->recvData))
+			continue;
+
+		client->recvBytes = 0;
+		if (client->recvData != XNET_QOS_PROBE_MAGIC)
 		{
-			LOG_TRACE_NETWORK("{} - dwError: {}, cleaning up", __FUNCTION__, dwError);
-			break;
+			// LOG_TRACE_NETWORK("{} - Unknown data received! (wtf)", __FUNCTION__);
+			return false;
 		}
 
-		if (cbTransferred == 0)
+		client->pendingReplies++;
+
+		std::lock_guard<std::mutex> lg(m_listenStatsMutex);
+		m_listenStats.dwNumProbesReceived++;
+		m_listenStats.dwNumDataRequestsReceived++;
+	}
+}
+
+bool CXNetQoS::SendReplies(XNetQoSListenClient* client)
+{
+	const int replySize = gXnIpMgr.GetReqQoSBufferSize();
+	const bool bandwidthLimited = m_dwBitsPerSec != 0;
+
+	while (client->pendingReplies > 0
+		&& !client->sendBlocked)
+	{
+		int bytesToSend = replySize - client->replyBytesSent;
+		if (bandwidthLimited)
 		{
-			//LOG_TRACE_NETWORK("{} - no data received!", __FUNCTION__);
-			break;
+			bytesToSend = (std::min)(bytesToSend, (int)m_tokens);
+			if (bytesToSend <= 0)
+				return true; // wait for the bucket to refill
 		}
 
-		if (*(DWORD*)acceptSockInfo->DataBuf.buf == 0xAABBCCDD)
+		int sendResult = send(client->socket, (const char*)pbData + client->replyBytesSent, bytesToSend, 0);
+		if (sendResult == SOCKET_ERROR)
 		{
-			//LOG_TRACE_NETWORK("{} - magic is right, sending data back on socket {}", __FUNCTION__, acceptSockInfo->Socket);
+			if (WSAGetLastError() != WSAEWOULDBLOCK)
+				return false;
 
-			delete[] acceptSockInfo->DataBuf.buf;
+			// wait for FD_WRITE
+			client->sendBlocked = true;
+			return true;
+		}
 
-			// copy the data passed by the game
-			acceptSockInfo->DataBuf.len = gXnIpMgr.GetReqQoSBufferSize();
-			acceptSockInfo->DataBuf.buf = new CHAR[gXnIpMgr.GetReqQoSBufferSize()];
-			memcpy(acceptSockInfo->DataBuf.buf, XNetQoS.pbData, gXnIpMgr.GetReqQoSBufferSize());
+		if (bandwidthLimited)
+			m_tokens -= sendResult;
 
-			ZeroMemory(&acceptSockInfo->Overlapped, sizeof(acceptSockInfo->Overlapped));
-			int sendResult = WSASend(acceptSockInfo->Socket, &acceptSockInfo->DataBuf, 1, NULL, 0, &acceptSockInfo->Overlapped, HandleClient);
-			if (sendResult == 0)
-			{
-				// the operation will be completed synchronously
-				return;
-			}
-			else if (sendResult == SOCKET_ERROR)
-			{
-				if (WSAGetLastError() == WSA_IO_PENDING)
-				{
-					// the operation will be completed asynchronously, don't clear memory because it will be used
-					return;
-				}
-				else
-				{
-					// LOG_TRACE_NETWORK("{} - WSASend() failed with error {}", __FUNCTION__, WSAGetLastError());
-					break;
-				}
-			}
-		}
-		else
+		client->replyBytesSent += sendResult;
+
+		std::lock_guard<std::mutex> lg(m_listenStatsMutex);
+		m_listenStats.dwNumDataReplyBytesSent += sendResult;
+		if (client->replyBytesSent >= replySize)
 		{
-			// LOG_TRACE_NETWORK("{} - Unknown data received! (wtf)", __FUNCTION__);
-			break;
+			client->replyBytesSent = 0;
+			client->pendingReplies--;
+			m_listenStats.dwNumDataRepliesSent++;
+			m_listenStats.dwNumProbeRepliesSent++;
 		}
+	}
 
-	} while (0);
-
-	closesocket(acceptSockInfo->Socket);
-	delete[] acceptSockInfo->DataBuf.buf;
-	delete acceptSockInfo;
-	return;
+	return true;
 }
 
 void CXNetQoS::Listener()
@@ -328,9 +481,6 @@ void CXNetQoS::Listener()
 		serverAddr.sin_addr.s_addr = INADDR_ANY; // anyone can connect
 		serverAddr.sin_port = htons(H2Config_base_port + 10);
 
-		DWORD dwBytes = 0;
-		GUID GuidAcceptEx = WSAID_ACCEPTEX;
-
 		m_WsaEvents[0] = WSACreateEvent();
 		m_WsaEvents[1] = WSACreateEvent();
 		if (m_WsaEvents[0] == WSA_INVALID_EVENT
@@ -340,7 +490,7 @@ void CXNetQoS::Listener()
 			break;
 		}
 
-		m_ListenSocket = WSASocket(serverAddr.sin_family, SOCK_STREAM, 0, NULL, 0, WSA_FLAG_OVERLAPPED);
+		m_ListenSocket = socket(serverAddr.sin_family, SOCK_STREAM, IPPROTO_TCP);
 		if (m_ListenSocket == INVALID_SOCKET)
 		{
 			LOG_TRACE_NETWORK("{} - listener socket creation failed.", __FUNCTION__);
@@ -353,100 +503,103 @@ void CXNetQoS::Listener()
 			break;
 		}
 
-		if (WSAIoctl(m_ListenSocket, SIO_GET_EXTENSION_FUNCTION_POINTER,
-			&GuidAcceptEx, sizeof(GuidAcceptEx),
-			&lpfnAcceptEx, sizeof(lpfnAcceptEx),
-			&dwBytes, NULL, NULL) == SOCKET_ERROR)
+		if (listen(m_ListenSocket, SOMAXCONN) == SOCKET_ERROR)
 		{
-			LOG_TRACE_NETWORK("{} - failed to get AcceptEx function pointer, WSAIoctl() error: {}", __FUNCTION__, WSAGetLastError());
+			LOG_TRACE_NETWORK("{} - listen() error: {}", __FUNCTION__, WSAGetLastError());
 			break;
 		}
 
-		if (listen(m_ListenSocket, SOMAXCONN) == SOCKET_ERROR)
+		// this also sets the socket in non-blocking mode
+		if (WSAEventSelect(m_ListenSocket, m_WsaEvents[1], FD_ACCEPT) == SOCKET_ERROR)
 		{
-			LOG_TRACE_NETWORK("{} - listen() error: {}", __FUNCTION__, WSAGetLastError());
+			LOG_TRACE_NETWORK("{} - WSAEventSelect() error: {}", __FUNCTION__, WSAGetLastError());
 			break;
 		}
 
-		// if listen socket initialization went fine, wait for client connections
+		m_tokens = 0.0;
+		m_lastTokensRefillTime = _Shell::QPCToTimeNowMsec();
+
+		// if listen socket initialization went fine, serve the clients
+		// everything is driven by this loop: accepting, reading the probes and sending the replies
 		while (true)
 		{
-			OVERLAPPED acceptOvelapped;
-			ZeroMemory(&acceptOvelapped, sizeof(acceptOvelapped));
-
-			acceptOvelapped.hEvent = m_WsaEvents[1];
-			SOCKET acceptSocket = WSASocket(AF_INET, SOCK_STREAM, 0, NULL, 0, WSA_FLAG_OVERLAPPED);
-			if (acceptSocket == INVALID_SOCKET)
-			{
-				LOG_TRACE_NETWORK("{} - WSASocket failed with error: {}", __FUNCTION__, WSAGetLastError());
-				continue;
-			}
-
-			char acceptBuffer[2 * (sizeof(sockaddr_in) + 16)];
-			DWORD dwBytesReceived = 0;
-			if (lpfnAcceptEx(m_ListenSocket, acceptSocket, (PVOID)acceptBuffer, 0, sizeof(sockaddr_in) + 16, sizeof(sockaddr_in) + 16, &dwBytesReceived, &acceptOvelapped) == FALSE)
-			{
-				if (WSAGetLastError() != ERROR_IO_PENDING) {
-					LOG_TRACE_NETWORK("{} - AcceptEx failed with error: {}", __FUNCTION__, WSAGetLastError());
-					closesocket(acceptSocket);
-					continue;
-				}
-			}
+			WSAEVENT waitEvents[ARRAYSIZE(m_WsaEvents) + XNET_QOS_LISTEN_MAX_CLIENTS];
+			DWORD waitEventCount = 0;
 
-			bool bConnectionInbound = false;
+			for (int i = 0; i < ARRAYSIZE(m_WsaEvents); i++)
+				waitEvents[waitEventCount++] = m_WsaEvents[i];
 
-			// Wait for AcceptEx events
-			// We use the async version of AcceptEx because we want to have the abillity to exit the thread
-			DWORD eventWaitRet;
-			do 
-				eventWaitRet = WSAWaitForMultipleEvents(ARRAYSIZE(m_WsaEvents), m_WsaEvents, FALSE, WSA_INFINITE, TRUE);
-			while (eventWaitRet == WSA_WAIT_IO_COMPLETION);
+			for (const auto& client : m_clients)
+				waitEvents[waitEventCount++] = client.event;
 
+			DWORD eventWaitRet = WSAWaitForMultipleEvents(waitEventCount, waitEvents, FALSE, GetWaitTimeout(), FALSE);
 			if (eventWaitRet == WSA_WAIT_FAILED)
 			{
 				LOG_TRACE_NETWORK("{} - WSAWaitForMultipleEvents() failed with error {}", __FUNCTION__, WSAGetLastError());
-				closesocket(acceptSocket);
-				continue;
+				break;
 			}
 			else if (eventWaitRet - WSA_WAIT_EVENT_0 == 0u)
 			{
 				LOG_TRACE_NETWORK("{} - signaled to terminate thread, last WSAError - {}", __FUNCTION__, WSAGetLastError());
-				closesocket(acceptSocket);
 				break;
 			}
-			else if (eventWaitRet - WSA_WAIT_EVENT_0 == 1u)
+
+			WSANETWORKEVENTS networkEvents;
+			if (WSAEnumNetworkEvents(m_ListenSocket, m_WsaEvents[1], &networkEvents) == 0
+				&& (networkEvents.lNetworkEvents & FD_ACCEPT) != 0)
 			{
-				// connection inbound, continue normally
-				WSAResetEvent(m_WsaEvents[1]);
+				AcceptClients();
 			}
 
-			LPSOCKET_INFORMATION lpSockInfo = new SOCKET_INFORMATION;
-			ZeroMemory(lpSockInfo, sizeof(SOCKET_INFORMATION));
+			RefillTokens();
 
-			lpSockInfo->BytesSEND = 0;
-			lpSockInfo->BytesRECV = 0;
-			lpSockInfo->Socket = acceptSocket;
+			ULONGLONG timeNow = _Shell::QPCToTimeNowMsec();
+			for (auto& client : m_clients)
+			{
+				bool keepClient = true;
 
-			// recv buffer prep
-			lpSockInfo->DataBuf.len = 4;
-			lpSockInfo->DataBuf.buf = new char[lpSockInfo->DataBuf.len];
+				if (WSAEnumNetworkEvents(client.socket, client.event, &networkEvents) == SOCKET_ERROR)
+				{
+					keepClient = false;
+				}
+				else
+				{
+					if (networkEvents.lNetworkEvents & FD_WRITE)
+						client.sendBlocked = false;
 
-			DWORD flags = 0;
-			// LOG_TRACE_NETWORK("{} - WSARecv about to receive data on socket: {}", __FUNCTION__, acceptSocket);
-			if (WSARecv(lpSockInfo->Socket, &lpSockInfo->DataBuf, 1, NULL, &flags, &lpSockInfo->Overlapped, SendBack) == SOCKET_ERROR)
-			{
-				if (WSAGetLastError() != WSA_IO_PENDING)
+					if (networkEvents.lNetworkEvents & (FD_READ | FD_CLOSE))
+						keepClient = ReadClient(&client);
+
+					if (networkEvents.lNetworkEvents & FD_CLOSE)
+						keepClient = false;
+				}
+
+				if (keepClient)
+					keepClient = SendReplies(&client);
+
+				if (keepClient
+					&& client.pendingReplies == 0
+					&& timeNow - client.lastActivityTime >= XNET_QOS_LISTEN_CLIENT_TIMEOUT_MSEC)
 				{
-					LOG_TRACE_NETWORK("{} - WSARecv failed with error: {}", __FUNCTION__, WSAGetLastError());
-					closesocket(acceptSocket);
-					delete lpSockInfo;
+					keepClient = false;
 				}
+
+				if (!keepClient)
+					CloseClient(&client);
 			}
+
+			m_clients.erase(
+				std::remove_if(m_clients.begin(), m_clients.end(), [](const XNetQoSListenClient& client) { return client.socket == INVALID_SOCKET; }),
+				m_clients.end());
 		}
 
 	} while (0);
 
 	// cleanup
+	for (auto& client : m_clients)
+		CloseClient(&client);
+	m_clients.clear();
+
 	if (m_ListenSocket != INVALID_SOCKET)
 	{
 		closesocket(m_ListenSocket);
@@ -496,6 +649,11 @@ DWORD WINAPI XNetQosListen(XNKID *pxnkid, PBYTE pb, UINT cb, DWORD dwBitsPerSec,
 		}
 	}
 
+	if (dwFlags & XNET_QOS_LISTEN_SET_BITSPERSEC)
+	{
+		XNetQoS.SetBitsPerSec(dwBitsPerSec);
+	}
+
 	if ((dwFlags & XNET_QOS_LISTEN_ENABLE) && XNetQoS.IsListening() == false)
 	{
 		std::thread(&CXNetQoS::Listener, &XNetQoS).detach();
@@ -539,12 +697,7 @@ DWORD WINAPI XNetQosLookup(UINT cxna, XNADDR * apxna[], XNKID * apxnkid[], XNKEY
 	pqos->cxnqos = cxna;
 	pqos->cxnqosPending = cxna;
 
-	/*
-	This is gonna hit some CPUs hard when there's a lot of servers on the list, we'll probably want to queue this a bit and only allow X number of threads to run at a time.
-	We want to abuse the CPU where possible considering more modern systems will have decent CPUs so we'll be able to force things to happen faster but still want to keep compatibility with older setups.
-	*/
-
-	std::thread(ClientQoSLookUp, cxna, pxna, cProbes, aina, pxnqos, dwBitsPerSec, pqos).detach();
+	std::thread(ClientQoSLookUp, cxna, pxna, cProbes, dwBitsPerSec, pqos, hEvent).detach();
 
 	return 0;
 }
@@ -582,5 +735,11 @@ INT WINAPI XNetQosRelease(XNQOS* pxnqos)
 DWORD WINAPI XNetQosGetListenStats(XNKID *pxnKid, XNQOSLISTENSTATS *pQosListenStats)
 {
 	LOG_TRACE_NETWORK("XNetQosGetListenStats()");
+
+	if (pQosListenStats == nullptr
+		|| pQosListenStats->dwSizeOfStruct != sizeof(XNQOSLISTENSTATS))
+		return WSAEINVAL;
+
+	XNetQoS.GetListenStats(pQosListenStats);
 	return 0;
 }
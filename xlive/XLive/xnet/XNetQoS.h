@@ -1,13 +1,27 @@
 #pragma once
 
-typedef struct _SOCKET_INFORMATION 
+// max probe connections served at the same time, the listener waits on one event per connection
+// and WSAWaitForMultipleEvents can wait on WSA_MAXIMUM_WAIT_EVENTS at most
+#define XNET_QOS_LISTEN_MAX_CLIENTS 32
+
+// drop probe connections that didn't send anything in this time
+#define XNET_QOS_LISTEN_CLIENT_TIMEOUT_MSEC (5 * 1000)
+
+struct XNetQoSListenClient
 {
-	WSAOVERLAPPED Overlapped;
-	SOCKET Socket;
-	WSABUF DataBuf;
-	DWORD BytesSEND;
-	DWORD BytesRECV;
-} SOCKET_INFORMATION, *LPSOCKET_INFORMATION;
+	SOCKET socket;
+	WSAEVENT event;
+
+	DWORD recvData;
+	int recvBytes;
+
+	// replies waiting to be sent, and how much of the current one was sent
+	int pendingReplies;
+	int replyBytesSent;
+	bool sendBlocked;
+
+	ULONGLONG lastActivityTime;
+};
 
 class CXNetQoS
 {
@@ -15,6 +29,9 @@ public:
 	void Listener();
 	bool IsListening();
 
+	void SetBitsPerSec(DWORD dwBitsPerSec);
+	void GetListenStats(XNQOSLISTENSTATS* pQosListenStats);
+
 	SOCKET m_ListenSocket = INVALID_SOCKET;
 	// first is used to alert the thread it has to cleanup
 	// second is used for connections
@@ -23,12 +40,25 @@ public:
 	UINT cbData = 0;
 	PBYTE pbData = nullptr;
 
-	static void CALLBACK HandleClient(DWORD dwError, DWORD cbTransferred, LPWSAOVERLAPPED lpOverlapped, DWORD dwFlags);
-	static void CALLBACK SendBack(DWORD dwError, DWORD cbTransferred, LPWSAOVERLAPPED lpOverlapped, DWORD dwFlags);
-
 	std::atomic<bool> m_listenerThreadRunning = false;
 private:
-	
+	void AcceptClients();
+	bool ReadClient(XNetQoSListenClient* client);
+	bool SendReplies(XNetQoSListenClient* client);
+	void CloseClient(XNetQoSListenClient* client);
+	void RefillTokens();
+	DWORD GetWaitTimeout() const;
+
+	std::vector<XNetQoSListenClient> m_clients;
+
+	// token bucket limiting the bandwidth used by replies, in bytes
+	// if m_dwBitsPerSec is 0, replies are not limited
+	std::atomic<DWORD> m_dwBitsPerSec = 0;
+	double m_tokens = 0.0;
+	ULONGLONG m_lastTokensRefillTime = 0;
+
+	std::mutex m_listenStatsMutex;
+	XNQOSLISTENSTATS m_listenStats = {};
 };
 
 #define XNET_XNQOSINFO_COMPLETE         0x01    // Qos has finished processing this entry
@@ -6,6 +6,7 @@
 #include "XLive/XAM/xam.h"
 #include "XLive/ServerList/ServerList.h"
 #include "XLive/achievements/XAchievements.h"
+#include "XLive/XOverlapped/XOverlapped.h"
 
 HANDLE g_dwFakeContent = INVALID_HANDLE_VALUE;
 HANDLE g_dwMarketplaceContent = INVALID_HANDLE_VALUE;
@@ -313,7 +314,8 @@ void Check_Overlapped( PXOVERLAPPED pOverlapped )
 		//LOG_TRACE_XLIVE( "- pCompletionRoutine = %X", pOverlapped->pCompletionRoutine );
 
 
-		pOverlapped->pCompletionRoutine( pOverlapped->InternalLow, pOverlapped->InternalHigh, pOverlapped->dwCompletionContext );
+		// the routine gets the overlapped, the context is read from it
+		pOverlapped->pCompletionRoutine( pOverlapped->InternalLow, pOverlapped->InternalHigh, (DWORD)pOverlapped );
 	}
 }
 
@@ -335,7 +337,7 @@ DWORD WINAPI XGetOverlappedExtendedError(PXOVERLAPPED pOverlapped)
 		return GetLastError();
 	}
 
-	if (pOverlapped->InternalLow != ERROR_IO_PENDING)
+	if (pOverlapped->InternalLow != ERROR_IO_INCOMPLETE)
 		return pOverlapped->dwExtendedError;
 
 	return ERROR_IO_INCOMPLETE;
@@ -348,11 +350,18 @@ DWORD WINAPI XGetOverlappedResult(PXOVERLAPPED pOverlapped, LPDWORD pResult, BOO
 	//LOG_TRACE_XLIVE("XGetOverlappedResult  (bWait = %d)  (internalLow = %X, internalHigh = %X)",
 	// bWait, pOverlapped->InternalLow, pOverlapped->InternalHigh );
 
-	if (bWait)
+	if (pOverlapped->InternalLow == ERROR_IO_INCOMPLETE)
 	{
-		while (pOverlapped->InternalLow == ERROR_IO_INCOMPLETE)
+		if (!bWait)
+			return ERROR_IO_INCOMPLETE;
+
+		// operations that aren't driven by the scheduler (the server list) are polled
+		if (!xoverlapped_wait(pOverlapped))
 		{
-			Sleep(1);
+			while (pOverlapped->InternalLow == ERROR_IO_INCOMPLETE)
+			{
+				Sleep(1);
+			}
 		}
 	}
 
@@ -506,6 +515,9 @@ int WINAPI XCancelOverlapped (PXOVERLAPPED pOverlapped)
 	if (pOverlapped == NULL)
 		return ERROR_INVALID_PARAMETER;
 
+	// completed operations and the ones not driven by the scheduler are left as they are
+	xoverlapped_cancel(pOverlapped);
+
     return ERROR_SUCCESS;
 }
 